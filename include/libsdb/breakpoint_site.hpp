@@ -3,7 +3,10 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <optional>
+#include <utility>
 #include <libsdb/types.hpp>
+#include <libsdb/condition.hpp>
 
 namespace sdb {
     class Process; //forward declaration
@@ -40,6 +43,13 @@ namespace sdb {
             bool in_range(virt_addr low, virt_addr high) const {
                 return low <= address_ and high > address_;
             }
+
+            /* only stop when the condition holds, Process resumes from the others by itself */
+            void set_condition(std::optional<condition> cond) { condition_ = std::move(cond); }
+            const std::optional<condition>& get_condition() const { return condition_; }
+
+            /* times the tracee reached the site while continuing, stopped at or not */
+            std::uint64_t hit_count() const { return hit_count_; }
         private:
             friend Process;
 
@@ -56,6 +66,8 @@ namespace sdb {
             bool is_internal_; //whether breakpoint is for internal usage
             bool is_hardware_; //software or hardware breakpoint
             int hardware_register_index_ = -1; //tracks the breakpoint index being used
+            std::optional<condition> condition_;
+            std::uint64_t hit_count_ = 0;
     };
 }
 
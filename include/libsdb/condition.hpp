@@ -0,0 +1,62 @@
+#ifndef SDB_CONDITION_HPP
+#define SDB_CONDITION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sdb {
+    class registers;
+
+    /* what a condition can look at when it is evaluated */
+    struct condition_context {
+        const registers* regs = nullptr;
+        std::uint64_t hits = 0;     /* hits of the stoppoint, this one included */
+        std::uint64_t value = 0;    /* watched value after the access, 0 for breakpoints */
+        std::uint64_t old = 0;      /* watched value before it */
+    };
+
+    /*
+    * A stop condition compiled once into bytecode for a small stack machine, so checking it on every hit
+    * costs no parsing and no allocation
+    * Expressions use C operators and precedence over unsigned 64-bit values: || && | ^ & == != < <= > >=
+    * << >> + - * / % and unary ! - ~, with parentheses, decimal and 0x literals, integer register names,
+    * hits, value and old. Division by zero gives 0
+    */
+    class condition {
+        public:
+            /* parse text, sends an error describing the first problem found */
+            static condition compile(std::string_view text);
+
+            bool evaluate(const condition_context& context) const;
+
+            const std::string& text() const { return text_; }
+
+        private:
+            enum class opcode : std::uint8_t {
+                constant, reg, hits, value, old,
+                logical_or, logical_and, bit_or, bit_xor, bit_and,
+                equal, not_equal, less, less_equal, greater, greater_equal,
+                shift_left, shift_right, add, subtract, multiply, divide, modulo,
+                logical_not, negate, bit_not
+            };
+
+            struct instruction {
+                opcode op;
+                std::uint64_t operand; /* the constant, or the index into g_register_infos */
+            };
+
+            /* the evaluation stack lives on the C++ stack */
+            static constexpr std::size_t max_depth = 32;
+
+            friend class condition_parser;
+            condition() = default;
+
+            std::string text_;
+            std::vector<instruction> code_;
+    };
+}
+
+#endif
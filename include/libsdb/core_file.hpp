@@ -0,0 +1,20 @@
+#ifndef SDB_CORE_FILE_HPP
+#define SDB_CORE_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/***********************************
+* Results for Process::write_core
+************************************/
+
+namespace sdb {
+    struct core_file_stats {
+        std::uint64_t file_size = 0;        /* apparent size, including holes */
+        std::uint64_t bytes_written = 0;    /* memory bytes actually written, zero and unreadable pages are holes */
+        std::size_t segments = 0;           /* PT_LOAD segments */
+        double seconds = 0;
+    };
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <libsdb/process.hpp>
+#include <libsdb/emulated_instruction.hpp>
 #include <optional>
 
 namespace sdb {
@@ -18,6 +19,16 @@ namespace sdb {
             Process * proc_;
 
         public:
+            /* where an instruction starts and ends, and what stops it running from another address */
+            struct relocatable_instruction {
+                virt_addr address;
+                std::size_t length;
+                bool is_relative_branch;    /* jmp, jcc, call or loop to a relative target */
+                std::optional<std::size_t> rip_displacement; /* offset of the 32-bit displacement of a rip-relative operand */
+                bool is_call;               /* pushes the address of the next instruction */
+                bool is_system;             /* syscall, interrupt or other instruction the kernel may see the pc of */
+            };
+
             disassembler(Process& proc) : proc_(&proc){}
 
             /* 
@@ -27,6 +38,15 @@ namespace sdb {
             */
             std::vector<instruction> disassemble(std::size_t n_instructions, 
                     std::optional<virt_addr> address = std::nullopt);
+
+            /*
+            * Decode whole instructions from address until they cover at least n_bytes, ignoring our int3s
+            * Used to move code out of the way of a patch
+            */
+            std::vector<relocatable_instruction> decode_covering(virt_addr address, std::size_t n_bytes);
+
+            /* decode the instruction at address, ignoring our int3s, if Process can emulate it */
+            std::optional<emulated_instruction> decode_emulatable(virt_addr address);
     };
 }
 #endif
\ No newline at end of file
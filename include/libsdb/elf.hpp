@@ -11,6 +11,8 @@
 #include <libsdb/types.hpp>
 #include <span>
 #include <map>
+#include <deque>
+#include <regex>
 
 
 /* wrapper class around an ELF file and stores metadata*/
@@ -78,6 +80,12 @@ namespace sdb {
             /* Retrieve a symbol containing address */
             std::optional<const Elf64_Sym*> get_symbol_containing_address(file_addr addr) const;
             std::optional<const Elf64_Sym*> get_symbol_containing_address(virt_addr addr) const;
+
+            /*
+            * Defined function symbols with a mangled or demangled name containing a match for pattern,
+            * sorted by address with one symbol per address. Names are matched in parallel
+            */
+            std::vector<const Elf64_Sym*> get_functions_matching(const std::regex& pattern) const;
         private:
             int fd_;
             std::filesystem::path path_;
@@ -102,10 +110,18 @@ namespace sdb {
             void parse_symbol_table();
             std::vector<Elf64_Sym> symbol_table_;
 
+            /* a name in .strtab or .dynstr, viewing the mapped file */
+            std::string_view get_string_view(std::size_t index) const;
+
             /* maps names to multiple potential symbol table entries */
             /* a single name to a range of Elf64 symbols */
+            /* keys view the mapped file, or demangled_names_ */
             std::unordered_multimap<std::string_view, Elf64_Sym*> 
             symbol_name_map_;
+            std::deque<std::string> demangled_names_;
+
+            /* the same entries in a flat list, to split between threads */
+            std::vector<std::pair<std::string_view, const Elf64_Sym*>> symbol_names_;
 
             /* struct with custom comparator function */
             /* lhs is lower address, rhs is higher address */
@@ -0,0 +1,45 @@
+#ifndef SDB_EMULATED_INSTRUCTION_HPP
+#define SDB_EMULATED_INSTRUCTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <libsdb/types.hpp>
+#include <libsdb/register_info.hpp>
+
+namespace sdb {
+    /*
+    * One of the handful of instructions breakpoints usually sit on, decoded far enough that
+    * Process can apply its effect to registers and memory without running it
+    * Only 32 and 64-bit operands, and memory operands without an index or segment
+    */
+    struct emulated_instruction {
+        enum class operation {
+            nop,    /* nop, endbr64 */
+            push,
+            mov,
+            add,
+            sub,
+            lea,
+            call,   /* relative, source holds the absolute target */
+            jmp     /* relative, source holds the absolute target */
+        };
+
+        struct operand {
+            enum class kind { none, reg, imm, mem };
+            kind type = kind::none;
+            register_id reg = register_id::rax;     /* always the full 64-bit register */
+            std::optional<register_id> base;        /* memory operands are base + value, or value alone */
+            std::int64_t value = 0;                 /* immediate, sign extended, or displacement */
+        };
+
+        virt_addr address;
+        std::size_t length;
+        operation op;
+        std::size_t size;   /* operand size in bytes, 4 or 8 */
+        operand dest;
+        operand source;
+    };
+}
+
+#endif
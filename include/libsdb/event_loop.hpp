@@ -0,0 +1,73 @@
+#ifndef SDB_EVENT_LOOP_HPP
+#define SDB_EVENT_LOOP_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <signal.h>
+#include <vector>
+#include <libsdb/process.hpp>
+
+/***********************************
+* Single-threaded event loop on epoll. Tracees are watched through a pidfd for each of their threads and
+* a signalfd for SIGCHLD, which the kernel sends us for every ptrace stop, so any number of them are waited
+* on at once and nothing blocks in waitpid. The terminal and other fds share the same epoll set
+************************************/
+
+namespace sdb {
+    class event_loop {
+        public:
+            /* SIGINT and SIGCHLD are blocked and read from a signalfd while this lives */
+            event_loop();
+            ~event_loop();
+
+            event_loop(const event_loop&) = delete;
+            event_loop& operator=(const event_loop&) = delete;
+
+            /* every stop poll_stop returns for the process, its end included */
+            using stop_handler = std::function<void(Process&, const stop_reason&)>;
+            void watch(Process& process, stop_handler on_stop);
+            void unwatch(Process& process);
+
+            /* look for stops now, after a resume that may already have one to report */
+            void poll(Process& process);
+
+            /* stop a running process as Ctrl-C would, with a SIGSTOP sent through the pidfd of its leader */
+            void interrupt(Process& process);
+
+            /* call on_ready whenever fd is readable */
+            void add_fd(int fd, std::function<void()> on_ready);
+            void remove_fd(int fd);
+
+            /* SIGINT arrives here instead of killing us */
+            void on_interrupt(std::function<void()> handler) { on_interrupt_ = std::move(handler); }
+
+            /* wait up to timeout_ms, -1 for ever, and dispatch what came in. Returns false on a timeout */
+            bool run_once(int timeout_ms = -1);
+
+        private:
+            struct watched_process {
+                Process* process;
+                stop_handler on_stop;
+                std::map<pid_t, int> pidfds;   /* by tid, the leader's also signals the process */
+            };
+
+            watched_process* find(Process& process);
+            /* thread_gone: a pidfd is readable, there's an exit to reap whatever state the process is in */
+            void poll(watched_process& watched, bool thread_gone = false);
+            void read_signals();
+
+            /* open pidfds for new threads and close those of threads that are gone */
+            void sync_pidfds(watched_process& watched);
+            void close_pidfds(watched_process& watched);
+
+            int epoll_fd_ = -1;
+            int signal_fd_ = -1;
+            sigset_t old_mask_;
+            std::function<void()> on_interrupt_;
+            std::map<int, std::function<void()>> fd_handlers_;
+            std::vector<std::unique_ptr<watched_process>> watched_;
+    };
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SDB_MEMORY_MAP_HPP
+#define SDB_MEMORY_MAP_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <libsdb/types.hpp>
+
+/***********************************
+* Parsed index of /proc/<pid>/maps
+************************************/
+
+namespace sdb {
+    /* one line of /proc/<pid>/maps */
+    struct memory_region {
+        virt_addr low;          /* first address of the mapping */
+        virt_addr high;         /* one past the last address */
+        bool readable;
+        bool writable;
+        bool executable;
+        bool shared;            /* 's' for shared mappings, 'p' for private copy-on-write */
+        std::uint64_t offset;   /* offset into the backing file */
+        std::string device;     /* major:minor of the backing device */
+        std::uint64_t inode;
+        std::string path;       /* backing file or pseudo name like [heap], empty for anonymous memory */
+
+        std::uint64_t size() const { return high.addr() - low.addr(); }
+        bool contains(virt_addr address) const { return low <= address and address < high; }
+    };
+
+    /* sorted, non-overlapping set of mapped regions of a process */
+    class memory_map {
+        public:
+            memory_map() = default;
+
+            /* read /proc/<pid>/maps, replacing whatever was indexed before */
+            void load(pid_t pid);
+
+            /* region containing an address or nullptr if it isn't mapped - O(log n) */
+            const memory_region* find(virt_addr address) const;
+
+            /* all regions overlapping [low, high) in address order */
+            std::vector<const memory_region*> get_in_region(virt_addr low, virt_addr high) const;
+
+            bool is_mapped(virt_addr address) const { return find(address) != nullptr; }
+            bool is_readable(virt_addr address) const;
+            bool is_writable(virt_addr address) const;
+            bool is_executable(virt_addr address) const;
+
+            /*
+            * Number of bytes from address that lie in contiguous readable mappings, at most amount
+            * Lets callers clip reads instead of failing on the first unmapped page
+            */
+            std::size_t readable_extent(virt_addr address, std::size_t amount) const;
+
+            std::vector<memory_region>::const_iterator begin() const { return regions_.begin(); }
+            std::vector<memory_region>::const_iterator end() const { return regions_.end(); }
+            std::size_t size() const { return regions_.size(); }
+            bool empty() const { return regions_.empty(); }
+
+        private:
+            /* kept sorted by low address, the kernel already reports them in order */
+            std::vector<memory_region> regions_;
+    };
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SDB_MEMORY_SEARCH_HPP
+#define SDB_MEMORY_SEARCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <libsdb/types.hpp>
+
+/***********************************
+* Options and results for Process::search_memory
+************************************/
+
+namespace sdb {
+    struct memory_search_options {
+        /* only scan [low, high) */
+        virt_addr low{ 0 };
+        virt_addr high{ std::numeric_limits<std::uint64_t>::max() };
+
+        /* required permissions on top of readable */
+        bool writable = false;
+        bool executable = false;
+
+        /* stop after this many matches, 0 for no limit */
+        std::size_t max_matches = 0;
+
+        /* size of the reusable buffer mappings are streamed through */
+        std::size_t buffer_size = 4 << 20;
+    };
+
+    struct memory_search_result {
+        std::vector<virt_addr> matches;
+        std::uint64_t bytes_scanned = 0;
+        std::size_t regions_scanned = 0;
+        double seconds = 0;
+        const char* kernel = "";    /* SIMD kernel set that ran */
+
+        /* MB/s over the bytes scanned */
+        double throughput() const {
+            return seconds > 0 ? bytes_scanned / seconds / (1 << 20) : 0;
+        }
+    };
+}
+
+#endif
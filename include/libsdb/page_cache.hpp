@@ -0,0 +1,62 @@
+#ifndef SDB_PAGE_CACHE_HPP
+#define SDB_PAGE_CACHE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <libsdb/types.hpp>
+
+/***********************************
+* Page-granular cache of tracee memory
+************************************/
+
+namespace sdb {
+    /*
+    * Holds copies of whole tracee pages read during the current stop.
+    * Process fills it on read_memory misses and drops everything once the tracee runs again
+    */
+    class page_cache {
+        public:
+            static constexpr std::size_t page_size = 0x1000;
+            using page = std::array<std::byte, page_size>;
+
+            /* page number containing an address */
+            static std::uint64_t page_of(virt_addr address) {
+                return address.addr() & ~(page_size - 1);
+            }
+
+            /*
+            * Look up a cached page and count the hit or miss
+            * @param page_addr page-aligned address of the page
+            * Returns a pointer to the page's bytes or nullptr if it isn't cached
+            */
+            const std::byte* lookup(std::uint64_t page_addr) const;
+
+            /* allocate a slot for a page, the caller fills in its bytes */
+            std::byte* insert(std::uint64_t page_addr);
+
+            /* drop a single page, used when a fill didn't complete */
+            void erase(std::uint64_t page_addr) { pages_.erase(page_addr); }
+
+            /* copy data written to the tracee into any cached page it overlaps */
+            void patch(virt_addr address, span<const std::byte> data);
+
+            /* drop every cached page - tracee memory may have changed */
+            void invalidate() { pages_.clear(); }
+
+            /* statistics */
+            std::uint64_t hits() const { return hits_; }
+            std::uint64_t misses() const { return misses_; }
+            std::size_t size() const { return pages_.size(); }
+            void reset_stats() { hits_ = 0; misses_ = 0; }
+
+        private:
+            /* nodes of unordered_map don't move on rehash so page pointers stay valid */
+            std::unordered_map<std::uint64_t, page> pages_;
+            mutable std::uint64_t hits_ = 0;
+            mutable std::uint64_t misses_ = 0;
+    };
+}
+
+#endif
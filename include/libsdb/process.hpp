@@ -6,8 +6,19 @@
 #include "stoppoint_collection.hpp"
 #include "types.hpp"
 #include "watchpoint.hpp"
+#include "page_cache.hpp"
+#include "memory_map.hpp"
+#include "memory_search.hpp"
+#include "snapshot.hpp"
+#include "core_file.hpp"
+#include "tracepoint.hpp"
+#include "trace_buffer.hpp"
+#include "emulated_instruction.hpp"
+#include "syscall_log.hpp"
 #include <vector>
 #include <filesystem>
+#include <iosfwd>
+#include <initializer_list>
 #include <memory>
 #include <sys/types.h>
 #include <sys/user.h>
@@ -19,6 +30,9 @@
 #include <libsdb/bits.hpp>
 #include <variant>
 #include <unordered_map>
+#include <map>
+#include <utility>
+#include <array>
 
 /* organize my code inside to avoid conflicts, in this case code for sdb */
 namespace sdb 
@@ -40,6 +54,7 @@ namespace sdb
         software_break,
         hardware_break,
         syscall,
+        software_watch, /* an access to memory a software watchpoint covers */
         unknown
     };
 
@@ -65,12 +80,90 @@ namespace sdb
         std::optional<trap_type> trap_reason; //if the stop occurs due to SIGTRAP
 
         std::optional<sdb::syscall_info> syscall_info;
+        std::optional<watchpoint_site::id_type> software_watchpoint; /* the watchpoint behind a software_watch trap */
         process_state reason; /* holds the reason for a stop */
         std::uint8_t info;
+        pid_t tid = 0;  /* the thread that stopped, the process for an exit or termination */
+        bool interrupted = false;   /* the SIGSTOP of an interrupt we sent, not one of the program's */
 
     };
+
+    /* one thread of the tracee, in all-stop mode every thread is stopped whenever the process is */
+    struct thread_state
+    {
+        pid_t tid;
+        process_state state = process_state::running;
+        std::optional<stop_reason> reason;  /* why it last stopped */
+        std::unique_ptr<registers> regs;    /* fetched on first use after each of its stops */
+
+        /* the syscall the thread is inside of, from its entry stop until its exit stop */
+        std::optional<std::uint16_t> current_syscall;
+
+        /* stopped where it can't be on a breakpoint it hit: syscall stops, clone events and our SIGSTOPs.
+           Resuming skips the breakpoint step-over and its register read */
+        bool skip_step_over = false;
+        bool pending_sigstop = false;   /* we sent it a SIGSTOP it hasn't stopped with yet */
+        bool pending_report = false;    /* stopped for something the next wait_on_signal returns without waiting */
+        bool is_new = false;            /* cloned, its first SIGSTOP hasn't arrived */
+        bool stepping = false;          /* resumed with PTRACE_SINGLESTEP, bookkeeping stops step it again */
+        bool on_displaced_copy = false; /* continued from a displaced copy, its pc may still be in the slot */
+        bool debug_registers_stale = false;    /* hardware stoppoints changed while it ran, written at its next stop */
+        int pending_signal = 0;         /* the program's own signal it was reported stopped with, delivered as it goes on */
+    };
     /* wraps around an inferior/tracee process, storing its PID */
 
+    /* mechanisms write_memory can use to reach tracee memory */
+    enum class memory_write_path
+    {
+        automatic,  /* process_vm_writev, then /proc/<pid>/mem, then PTRACE_POKEDATA */
+        vm_writev,  /* process_vm_writev - writable pages only */
+        proc_mem,   /* pwrite on /proc/<pid>/mem - also reaches read-only text */
+        poke_data   /* PTRACE_POKEDATA, 8 bytes per syscall */
+    };
+
+    /* one entry of a scatter-gather memory read */
+    struct memory_read_request
+    {
+        virt_addr address;      /* tracee address to read from */
+        span<std::byte> data;   /* caller-owned destination, fully filled on success */
+        bool success = false;   /* set by Process::read_memory_batch */
+    };
+
+    /* a page whose protection software watchpoints changed */
+    struct watched_page
+    {
+        int original_protection;    /* PROT_* of the mapping, put back when nothing watches the page */
+        int protection;             /* what we changed it to */
+    };
+
+    /* faults taken on pages protected for software watchpoints */
+    struct software_watch_stats {
+        std::uint64_t faults = 0;
+        std::uint64_t hits = 0;             /* touched a watched range */
+        std::uint64_t false_positives = 0;  /* touched something else on the page, stepped past */
+    };
+
+    /* a forked copy of the tracee frozen at the point it was taken, see Process::create_checkpoint */
+    struct checkpoint
+    {
+        using id_type = std::int32_t;
+
+        id_type id;
+        pid_t pid;      /* stopped copy, traced by us and never resumed */
+        virt_addr pc;   /* where execution continues after a restart */
+        bool has_scratch_code;  /* the copy has the scratch code pages */
+        bool has_fast_trace;    /* the copy has the fast tracepoint shared buffer */
+        std::map<std::uint64_t, watched_page> watched_pages;   /* protections in force in the copy */
+        std::vector<int> filtered_syscalls;     /* syscalls the copy's seccomp filters stop on */
+    };
+
+    /* how resume got past the software breakpoints it started on */
+    struct step_over_stats {
+        std::uint64_t emulated = 0;     /* applied by us, the tracee never ran it */
+        std::uint64_t displaced = 0;    /* ran from a copy in scratch code */
+        std::uint64_t stepped = 0;      /* int3 removed, single-stepped in place and put back */
+    };
+
     /* tracks which syscalls we are tracing*/
     class syscall_catch_policy {
         public:
@@ -139,22 +232,65 @@ namespace sdb
             process_state get_state() const { return state_; }
 
             /* class member functions */
-            void resume();
+
+            /*
+            * Resume every stopped thread, or only tid, each is first stepped past the breakpoint it stopped on
+            * Threads with a stop wait_on_signal hasn't returned yet stay where they are
+            */
+            void resume(std::optional<pid_t> tid = std::nullopt);
 
             /*
             * Checks if the tracee process has changed state to stopped
+            * Tracepoint hits are recorded and resumed from here and never returned, as are
+            * stoppoints whose condition is false
+            * The thread that stopped becomes the current thread, in all-stop mode the others are stopped before returning
             * Returns a reason why the tracee process halts to a stop
             */
             stop_reason wait_on_signal();
+
+            /*
+            * wait_on_signal without blocking, for event loops woken by SIGCHLD or a pidfd. Returns nullopt once
+            * nothing that happened so far is left to report, stops handled without returning are dealt with on the way
+            */
+            std::optional<stop_reason> poll_stop();
+
+            /*
+            * A SIGSTOP of ours is on its way to stop the process as Ctrl-C would. The stop it brings is reported
+            * as interrupted, and unlike the program's own signals isn't delivered once the thread is resumed
+            */
+            void expect_interrupt() { interrupt_pending_ = true; }
             ~Process();
 
-            /* registers handling function */
-            void write_user_area(std::size_t offset, std::uint64_t data);
-            registers& get_registers() { return *registers_;}
-            const registers& get_registers() const { return *registers_;}
+            /*
+            * Threads of the tracee by tid. New threads are picked up from clone events, the ones that
+            * exit are dropped
+            */
+            const std::map<pid_t, thread_state>& threads() const { return threads_; }
 
-            void write_fprs(const user_fpregs_struct& fprs);
-            void write_gprs(const user_regs_struct& gprs);
+            /* the thread that reported the last stop, registers and the pc are read from it by default */
+            pid_t current_thread() const { return current_thread_; }
+            void set_current_thread(pid_t tid);
+
+            /*
+            * Non-stop mode: only the thread that reports a stop is stopped, the others keep running, and resume
+            * can continue one thread at a time. The process counts as stopped while any of its threads is.
+            * Breakpoints are stepped over by emulation or from a displaced copy so the int3 stays in place, an
+            * instruction that can be neither is stepped with the other threads paused for that one step
+            */
+            void set_non_stop(bool enable);
+            bool is_non_stop() const { return non_stop_; }
+
+            /* registers handling function, tid defaults to the current thread */
+            void write_user_area(std::size_t offset, std::uint64_t data, std::optional<pid_t> tid = std::nullopt);
+            registers& get_registers(std::optional<pid_t> tid = std::nullopt) {
+                return *get_thread(tid.value_or(current_thread_)).regs;
+            }
+            const registers& get_registers(std::optional<pid_t> tid = std::nullopt) const {
+                return *get_thread(tid.value_or(current_thread_)).regs;
+            }
+
+            void write_fprs(const user_fpregs_struct& fprs, std::optional<pid_t> tid = std::nullopt);
+            void write_gprs(const user_regs_struct& gprs, std::optional<pid_t> tid = std::nullopt);
 
             /* 
             * handling breakpoints 
@@ -164,9 +300,28 @@ namespace sdb
             breakpoint_site& create_breakpoint_site(virt_addr address, 
                                     bool hardware = false, bool internal = false);
 
-            /* create watchpoints */
+            /*
+            * Create software breakpoint sites at many addresses at once, disabled
+            * Addresses repeated or already holding a site are skipped, returns the new sites
+            * An address inside the jump of a fast tracepoint is an error, and then no site is created
+            */
+            std::vector<breakpoint_site*> create_breakpoint_sites(std::vector<virt_addr> addresses);
+
+            /*
+            * Enable or disable many breakpoint sites at once. Software sites are grouped by page,
+            * each page is read and written back once rather than peeked and poked per site
+            * Sites already in the requested state, or listed more than once, are only changed once
+            */
+            void enable_breakpoint_sites(const std::vector<breakpoint_site*>& sites);
+            void disable_breakpoint_sites(const std::vector<breakpoint_site*>& sites);
+
+            /*
+            * Create watchpoints
+            * @param software watch any range by protecting its pages and checking the faults, write and rw only.
+            *                 Syscalls that write to a protected page fail with EFAULT instead of stopping
+            */
             watchpoint_site& create_watchpoint(
-                virt_addr address, stoppoint_mode mode, std::size_t size);
+                virt_addr address, stoppoint_mode mode, std::size_t size, bool software = false);
 
             /* returns the reference to a breakpoint site, expensive otherwise */
             stoppoint_collection<breakpoint_site>&
@@ -181,19 +336,65 @@ namespace sdb
             const stoppoint_collection<watchpoint_site>&
             watchpoint_sites() const {return watchpoints_; }
 
+            /*
+            * Create a tracepoint, a breakpoint that records state on each hit and continues
+            * @param address   address to trace
+            * @param registers registers captured on each hit
+            * @param memory    memory ranges captured on each hit
+            */
+            tracepoint& create_tracepoint(virt_addr address, std::vector<register_id> registers,
+                                          std::vector<tracepoint::memory_range> memory = {});
+
+            /* delete a tracepoint along with the internal breakpoint site that traps for it */
+            void delete_tracepoint(tracepoint::id_type id);
+
+            /*
+            * Create a fast tracepoint. The instructions under a 5-byte jmp at address move to a trampoline in a
+            * scratch page of the tracee, which stores all general purpose registers and rflags into memory shared
+            * with us and jumps back, so hits cost nanoseconds and never stop the tracee
+            * The code at address must not contain relative branches and nothing may jump into it past its first byte
+            */
+            tracepoint& create_fast_tracepoint(virt_addr address);
+
+            /*
+            * Move fast tracepoint hits from shared memory into the trace buffer, safe while the tracee runs
+            * dump_trace does this first. Returns the number of records moved
+            */
+            std::size_t collect_fast_trace();
+
+            /* fast tracepoint hits lost because the shared buffer was full */
+            std::uint64_t fast_trace_dropped() const;
+
+            stoppoint_collection<tracepoint>& tracepoints() { return tracepoints_; }
+            const stoppoint_collection<tracepoint>& tracepoints() const { return tracepoints_; }
+
+            /* records of tracepoint hits, allocated with the first tracepoint */
+            const trace_buffer* get_trace_buffer() const { return trace_buffer_.get(); }
+
+            /*
+            * Drain the trace buffer into out
+            * binary: "SDBTRACE", uint32 version, uint32 tracepoint count, then for each tracepoint
+            *         int32 id, uint64 address, uint32 register count, uint32 memory range count,
+            *         (uint32 register id, uint32 size) per register, uint32 size per range,
+            *         followed by uint32 length prefixed records as described in tracepoint.hpp
+            * csv:    one row per captured value, tracepoint,hit,time_ns,field,value
+            * Returns the number of records written
+            */
+            std::size_t dump_trace(std::ostream& out, trace_format format);
+
             /* get the program counter */
-            virt_addr get_pc () const {
+            virt_addr get_pc (std::optional<pid_t> tid = std::nullopt) const {
                 return virt_addr{
-                    get_registers().read_by_id_as<std::uint64_t>(register_id::rip)
+                    get_registers(tid).read_by_id_as<std::uint64_t>(register_id::rip)
                 };
             }
 
             /* writes to rip register */
-            void set_pc(virt_addr address) {
-                get_registers().write_by_id(register_id::rip, address.addr());
+            void set_pc(virt_addr address, std::optional<pid_t> tid = std::nullopt) {
+                get_registers(tid).write_by_id(register_id::rip, address.addr());
             }
 
-            /* step over machine instruction */
+            /* step over machine instruction in the current thread, the others stay as they are */
             sdb::stop_reason step_instruction();
 
             //a virtual address to read from and the number of bytes to read
@@ -209,11 +410,95 @@ namespace sdb
             std::vector<std::byte> read_memory_without_traps(sdb::virt_addr address, size_t amount) const;
 
             /*
-            * Write to a virtual address with a span of memory
+            * Read many small regions with as few process_vm_readv calls as possible (one per IOV_MAX pieces)
+            * @param requests regions to read, each is filled in place and marked with whether it succeeded
+            * Returns the number of requests that couldn't be read, an unmapped page only fails the requests touching it
+            * Pages software watchpoints made unreadable are read through /proc/<pid>/mem
+            */
+            std::size_t read_memory_batch(span<memory_read_request> requests) const;
+
+            /*
+            * Write to a virtual address with a span of memory. Bytes past the end of data are never touched
             * @param address virtual address to write to in process
-            * @param 
+            * @param data    bytes to write
+            * @param path    force a single write mechanism, by default each one falls back to the next
+            */
+            void write_memory(virt_addr address, span<const std::byte> data,
+                              memory_write_path path = memory_write_path::automatic);
+
+            /*
+            * Read up to amount bytes, stopping at the first unmapped or unreadable page instead of throwing
+            * Returns the readable prefix, which may be empty
+            */
+            std::vector<std::byte> read_memory_partial(sdb::virt_addr address, size_t amount) const;
+
+            /* 
+            * Index of /proc/<pid>/maps, reloaded on first use after the tracee has run
+            * mmap, munmap and exec can only happen while it runs
+            */
+            const memory_map& get_memory_map() const;
+
+            /*
+            * Scan every readable mapping for a byte pattern, streaming it through a reusable buffer
+            * @param pattern bytes to look for
+            * @param options restrict the search by address range and permissions
+            * Returns the match addresses along with how much was scanned and how fast
             */
-            void write_memory(virt_addr address, span<const std::byte> data);
+            memory_search_result search_memory(span<const std::byte> pattern,
+                                               const memory_search_options& options = {}) const;
+
+            /* address space queries answered from the index without a syscall */
+            bool is_mapped(virt_addr address) const { return get_memory_map().is_mapped(address); }
+            bool is_executable(virt_addr address) const { return get_memory_map().is_executable(address); }
+
+            /* page cache backing read_memory, exposes hit and miss counters */
+            const page_cache& memory_cache() const { return memory_cache_; }
+            void reset_memory_cache_stats() { memory_cache_.reset_stats(); }
+
+            /* counts of breakpoints passed by emulation, displaced stepping and in-place stepping */
+            const step_over_stats& get_step_over_stats() const { return step_over_stats_; }
+            void reset_step_over_stats() { step_over_stats_ = {}; }
+
+            /* page faults software watchpoints took, and how many were false positives */
+            const software_watch_stats& get_software_watch_stats() const { return software_watch_stats_; }
+            void reset_software_watch_stats() { software_watch_stats_ = {}; }
+
+            /*
+            * Capture every writable mapping of the tracee
+            * After the first snapshot only pages the kernel marked soft-dirty are read again,
+            * the rest are copied from the previous snapshot
+            * Returns the new snapshot, owned by the process
+            */
+            snapshot& take_snapshot();
+            const snapshot& get_snapshot(snapshot::id_type id) const;
+            const std::vector<std::unique_ptr<snapshot>>& snapshots() const { return snapshots_; }
+
+            /*
+            * Write an ELF core file of the stopped tracee
+            * Memory is streamed from the tracee a chunk at a time, zero and unreadable pages are left as holes
+            * @param path file to create or overwrite
+            */
+            core_file_stats write_core(const std::filesystem::path& path) const;
+
+            /*
+            * Make the stopped tracee fork a copy of itself that stays frozen, copy-on-write makes this
+            * cheap however large the process is. The copy holds no int3s
+            * Returns the id of the new checkpoint
+            */
+            checkpoint::id_type create_checkpoint();
+
+            /*
+            * Continue from a checkpoint in place of the current process. The checkpoint forks again so it can
+            * be restarted any number of times. Breakpoints and watchpoints are applied to the new process,
+            * the old one is killed, or detached from if we attached to it
+            */
+            void restart_checkpoint(checkpoint::id_type id);
+
+            void delete_checkpoint(checkpoint::id_type id);
+            const std::vector<checkpoint>& checkpoints() const { return checkpoints_; }
+
+            /* whether the next snapshot can be taken incrementally */
+            bool soft_dirty_tracking() const { return soft_dirty_tracking_; }
 
             /* reads a block of memory as an object with a strong type */
             template<typename T>
@@ -248,27 +533,75 @@ namespace sdb
             std::variant<sdb::breakpoint_site::id_type, sdb::watchpoint_site::id_type>
             get_current_hardware_stoppoint() const;
 
-            /* sets the current policy of catching the syscall of the tracee */
+            /*
+            * sets the current policy of catching the syscall of the tracee
+            * Some syscalls are caught through a seccomp filter installed in the tracee on the next resume,
+            * which also sets no_new_privs for it. The filter outlives us, processes we attached to and leave
+            * running are caught with PTRACE_SYSCALL instead, as are all syscalls
+            */
             void set_syscall_catch_policy(syscall_catch_policy info) {
                 syscall_catch_policy_ = std::move(info);
+                syscall_filter_ready_ = false;
+                syscall_filter_failed_ = false;
             }
 
+            /*
+            * Record every syscall into the syscall log with its arguments, result and timestamps
+            * Syscall stops the catch policy doesn't catch are resumed from inside wait_on_signal
+            */
+            void set_syscall_tracing(bool enable) { tracing_syscalls_ = enable; }
+            bool is_tracing_syscalls() const { return tracing_syscalls_; }
+            const syscall_log& get_syscall_log() const { return syscall_log_; }
+            void clear_syscall_log() { syscall_log_.clear(); }
+
             /* retrieve Linux auxiliary vectors */
             std::unordered_map<int, std::uint64_t> get_aux_vect() const;
 
         private:
+            /* breakpoint sites patch memory with ptrace directly and must keep the cache coherent */
+            friend breakpoint_site;
+
+            /* software watchpoints change page protections through the process */
+            friend watchpoint_site;
+
+            /* fast tracepoints patch code threads, or the displaced copies they run, may be in the middle of */
+            friend tracepoint;
+
             pid_t pid_ = 0; //pid of inferior process
             bool terminate_on_end_ = true; /* track termination */
             process_state state_ = process_state::stopped;
             bool is_attached_ = true;
 
-            /* stopped from syscall entry or exit */
-            bool expecting_syscall_exit_ = false; 
+            /* every thread we trace, and the one stops are reported from */
+            std::map<pid_t, thread_state> threads_;
+            pid_t current_thread_ = 0;
+            bool non_stop_ = false;
+            bool interrupt_pending_ = false;
 
             /* tracee should trace syscalls or not */
             syscall_catch_policy syscall_catch_policy_ = 
                 syscall_catch_policy::catch_none();
 
+            /*
+            * Install a seccomp filter in the tracee that stops it on entry to caught syscalls no earlier filter
+            * covers. Filters can't be removed, stops for syscalls no longer caught are resumed from
+            */
+            void install_syscall_filter();
+            std::vector<int> filtered_syscalls_;    /* syscalls the filters in the tracee stop on */
+            bool syscall_filter_ready_ = false;     /* the filters cover the catch policy */
+            bool syscall_filter_failed_ = false;    /* couldn't install one, catch with PTRACE_SYSCALL */
+
+            /* options every thread is traced with, forks are followed while the tracee has filters */
+            static long ptrace_options(bool follow_forks);
+
+            /*
+            * Forked children keep the filters, and with nothing tracing them their caught syscalls fail with ENOSYS.
+            * Once the tracee has filters its children are traced too and run freely, their stops are taken in
+            * wait_for_thread and never reported. Maps their tids to whether the first SIGSTOP is still to come
+            */
+            void take_followed_event(pid_t tid, int wait_status);
+            std::map<pid_t, bool> followed_;
+
             /* Process constructor for use by factory methods
             * @param pid              process id 
             * @param terminate_on_end process terminates or not when it's finished. Leave this true for launched process and false if attaching
@@ -276,8 +609,11 @@ namespace sdb
             */
             Process(pid_t pid, bool terminate_on_end, bool is_attached) : 
                 pid_(pid), terminate_on_end_(terminate_on_end), 
-                is_attached_(is_attached), registers_(new registers(*this))
-            {}
+                is_attached_(is_attached), current_thread_(pid)
+            {
+                add_thread(pid);
+                live_processes_.push_back(this);
+            }
 
             /* following the rule of three, since we explicitly defined destructor, we need to have copy move and copy operator disabled */
             /**********************************************************************/
@@ -290,9 +626,111 @@ namespace sdb
             Process(Process&&) = delete;
             Process& operator=(Process&&) = delete;
 
-            /* handling registers */
-            void read_all_registers();
-            std::unique_ptr<registers> registers_;
+            /* handling registers, registers fetches each class through these on first use after a stop */
+            friend registers;
+            void read_gprs(pid_t tid, user_regs_struct& gprs) const;
+            void read_fprs(pid_t tid, user_fpregs_struct& fprs) const;
+            std::uint64_t read_debug_register(pid_t tid, int index) const;
+
+            /* 
+            * Thread bookkeeping, see threads.cpp
+            */
+            thread_state& get_thread(pid_t tid);
+            const thread_state& get_thread(pid_t tid) const;
+            thread_state& current_thread_state() { return get_thread(current_thread_); }
+
+            /* start tracking a thread, running until we see it stop */
+            thread_state& add_thread(pid_t tid);
+
+            /* attach to the threads of an attached process besides the one PTRACE_ATTACH stopped */
+            void attach_threads();
+
+            /* run f with tid as the current thread, which is put back afterwards */
+            template <typename F>
+            decltype(auto) on_thread(pid_t tid, F&& f) {
+                struct thread_guard {
+                    Process* proc;
+                    pid_t previous;
+                    ~thread_guard() { proc->current_thread_ = previous; }
+                } guard{ this, std::exchange(current_thread_, tid) };
+                return f();
+            }
+
+            /*
+            * Next wait status of one thread, or of any of ours. Statuses of other children reaped on the way are
+            * kept for the process they belong to, a new thread's are picked up after its clone event
+            * Without block a tid of 0 means nothing has happened yet
+            */
+            std::pair<pid_t, int> wait_for_thread(std::optional<pid_t> tid, bool block = true);
+
+            /*
+            * Update the thread from its wait status. Returns the decoded stop if the thread stopped or the process
+            * ended, nullopt for events that are only bookkeeping: clone events, our own SIGSTOPs and threads exiting
+            */
+            std::optional<stop_reason> take_thread_event(pid_t tid, int wait_status);
+
+            /* the thread stopped for something of its own, work out what. Runs on the stopped thread */
+            std::optional<stop_reason> decode_stop(thread_state& thread, int wait_status);
+
+            /*
+            * All-stop: SIGSTOP every running thread with one tgkill each, then collect a stop from each of them
+            * Threads that stopped for something else on the way are decoded and reported from later wait_on_signal calls
+            */
+            void stop_running_threads();
+            bool has_pending_report() const;
+
+            /* non-stop, some threads run while we look at the others, nothing read from the tracee stays valid */
+            bool has_running_thread() const;
+
+            /*
+            * Threads stop_running_threads stopped only for us, continued again when this goes out of scope. For
+            * the moments no other thread may run, an int3 taken out or code patched at the pc, in either mode
+            */
+            struct paused_threads
+            {
+                paused_threads(Process* proc, std::vector<pid_t> tids) : proc(proc), tids(std::move(tids)) {}
+                paused_threads(paused_threads&& other) noexcept
+                    : proc(other.proc), tids(std::exchange(other.tids, {})) {}
+                ~paused_threads();
+
+                Process* proc;
+                std::vector<pid_t> tids;
+            };
+            paused_threads pause_running_threads();
+
+            /* false if wait_on_signal handles the stop itself: tracepoint hits, false conditions and the like */
+            bool should_report(stop_reason& reason);
+
+            /* move the stopped thread past the breakpoint at its pc, pausing the others if the int3 comes out */
+            void step_over_breakpoint(pid_t tid);
+
+            /*
+            * Single-step one thread and wait for it, picking up a thread it clones and our SIGSTOPs on the way
+            * Returns the wait status of the stop that ended the step
+            */
+            int single_step_thread(pid_t tid);
+
+            /* continue a stopped thread with PTRACE_CONT or PTRACE_SYSCALL as the catch policy needs */
+            void continue_thread(thread_state& thread);
+
+            /* debug registers are per thread, hardware stoppoints are written to every one of them */
+            void write_debug_register(register_id id, std::uint64_t value);
+            void write_debug_registers(thread_state& thread);
+            std::array<std::uint64_t, 8> debug_registers_{};   /* what every thread should hold in dr0-dr7 */
+
+            /* wait statuses single_step_thread took that are reported as if the thread had been running */
+            std::vector<std::pair<pid_t, int>> early_stops_;
+
+            /*
+            * wait_for_thread reaps whatever child comes next. Statuses go to the early_stops_ of the live process
+            * that knows the tid, or wait in unclaimed_events_ until one does
+            */
+            static std::vector<Process*> live_processes_;
+            static std::vector<std::pair<pid_t, int>> unclaimed_events_;
+
+            /* stop, clean up and detach from or kill every thread, for the destructor and restarts */
+            void detach_threads();
+            void kill_threads();
 
             /* dynamically allocating breakpoint sites and store their info here */
             //std::vector<std::unique_ptr<breakpoint_site>> breakpoint_sites_;
@@ -301,6 +739,39 @@ namespace sdb
             /* collection of watchpoints */
             stoppoint_collection<watchpoint_site> watchpoints_;
 
+            /* tracee pages read since the last stop, dropped whenever the tracee runs and unused while any thread does */
+            mutable page_cache memory_cache_;
+
+            /* parsed /proc/<pid>/maps and whether the tracee ran since it was loaded */
+            mutable memory_map memory_map_;
+            mutable bool memory_map_stale_ = true;
+
+            /* persistent /proc/<pid>/mem descriptor, opened on first use */
+            mutable int mem_fd_ = -1;
+            int get_mem_fd() const;
+
+            /* write engines used by write_memory, each returns how many leading bytes it wrote */
+            std::size_t write_memory_vm(virt_addr address, span<const std::byte> data);
+            std::size_t write_memory_proc_mem(virt_addr address, span<const std::byte> data);
+            void write_memory_poke(virt_addr address, span<const std::byte> data);
+
+            /* put back the bytes our int3s and fast tracepoint jmps replaced in memory read from address */
+            void remove_traps(virt_addr address, span<std::byte> memory) const;
+
+            /* snapshots in the order they were taken, and whether clear_refs reset the soft-dirty bits after the last one */
+            std::vector<std::unique_ptr<snapshot>> snapshots_;
+            bool soft_dirty_tracking_ = false;
+
+            /* frozen copies to restart from */
+            std::vector<checkpoint> checkpoints_;
+            checkpoint::id_type next_checkpoint_id_ = 1;
+
+            /* patch int3s in or out of every page holding one of the sites */
+            void set_breakpoint_sites_enabled(const std::vector<breakpoint_site*>& sites, bool enable);
+
+            /* write back the original bytes under enabled software breakpoints in another copy of the tracee */
+            void remove_traps_from(pid_t pid) const;
+
             /* 
             * Set hardware breakpoints and watchpoints internally
             * @param address    address to set breakpoint at
@@ -314,11 +785,158 @@ namespace sdb
             */
             void augment_stop_reason(stop_reason& reason);
 
+            /*
+            * Decode a syscall stop with PTRACE_GET_SYSCALL_INFO alone, without touching the registers
+            * Returns false if the stop needs augment_stop_reason instead
+            */
+            bool read_syscall_stop(stop_reason& reason);
+
+            /* entry/exit bookkeeping and logging shared by both ways of decoding a syscall stop */
+            void finish_syscall_stop(stop_reason& reason);
+
             /* 
-            * Resume the process if current stopped syscall isn't the one requested for tracing
             * Checks if a syscall is in the list of requested syscall for tracing or not
+            * wait_on_signal resumes from the syscall stops that aren't
             */
-            sdb::stop_reason maybe_resume_from_syscall(const stop_reason& reason);
+            bool is_syscall_caught(const stop_reason& reason);
+
+            /* every syscall entry and exit goes into the log while tracing */
+            bool tracing_syscalls_ = false;
+            syscall_log syscall_log_;
+
+            /*
+            * waits for one state change of the thread, or any thread, and works out why it happened,
+            * wait_on_signal adds tracepoint handling. Without block nullopt if there is nothing to work out yet
+            */
+            std::optional<stop_reason> wait_for_stop(std::optional<pid_t> tid = std::nullopt, bool block = true);
+
+            /* wait_on_signal and poll_stop */
+            std::optional<stop_reason> next_reported_stop(bool block);
+
+            /* tracepoints and the buffer their hits are recorded into */
+            static constexpr std::size_t trace_buffer_size = 16 << 20;
+            stoppoint_collection<tracepoint> tracepoints_;
+            std::unique_ptr<trace_buffer> trace_buffer_;
+
+            /* record a hit if the process stopped at an enabled tracepoint, returns whether it did */
+            bool record_tracepoint_hit(const stop_reason& reason);
+
+            /* count a hit on the breakpoint or watchpoint that stopped the process, false if its condition doesn't hold */
+            bool passes_condition(const stop_reason& reason);
+
+            /* false if the hardware stoppoint or software watchpoint behind a trap was removed after the stop came in */
+            bool stoppoint_still_exists(const stop_reason& reason) const;
+
+            /* reused between hits so recording doesn't allocate */
+            std::vector<std::byte> trace_record_;
+            std::vector<memory_read_request> trace_reads_;
+
+            /*
+            * Run one syscall in the stopped tracee as if the instruction at the pc made it,
+            * registers and code are put back afterwards
+            * Returns the raw result, a negative errno on failure
+            */
+            std::int64_t inject_syscall(long number, std::initializer_list<std::uint64_t> args = {});
+
+            /*
+            * Executable scratch pages in the tracee for fast tracepoint trampolines and displaced instructions,
+            * mapped within rel32 range of near on first use. The first page holds displaced instruction slots
+            */
+            void setup_scratch_code(virt_addr near);
+
+            /* copy code into the scratch pages for good, returns where it went */
+            virt_addr allocate_scratch_code(span<const std::byte> code);
+
+            /* write code at an address in the scratch pages, keeping the shadow copy up to date */
+            void write_scratch_code(virt_addr address, span<const std::byte> code);
+
+            virt_addr scratch_code_;        /* zero until mapped */
+            std::size_t scratch_code_used_ = 0;
+            std::vector<std::byte> scratch_code_shadow_;    /* what we wrote, to put back in a restarted checkpoint */
+            bool scratch_code_failed_ = false;              /* couldn't be mapped, don't keep trying */
+
+            /* map the shared record buffer for fast tracepoints */
+            void setup_fast_trace();
+
+            /* an instruction under a software breakpoint, copied to scratch code to run there with the int3 left in place */
+            struct displaced_copy {
+                virt_addr original;
+                virt_addr slot;             /* the instruction, then a jmp back to the one after the original */
+                std::size_t length;
+                bool is_relative_branch;    /* computes its target from the pc */
+                bool is_call;               /* pushes the pc */
+            };
+
+            /* the copy for the site, made on first use, or nullptr when it can't run displaced */
+            const displaced_copy* get_displaced_copy(const breakpoint_site& site);
+
+            /* instructions overlapping [low, high) may have changed, copy them again next time */
+            void drop_displaced_copies(virt_addr low, virt_addr high);
+
+            /*
+            * After a stop, move a pc inside a displaced slot back to the original code, and fix up the pc and
+            * return address of a relative branch or call that was single-stepped from its slot
+            */
+            void finish_displaced_step();
+
+            /* the copy whose slot the pc is in, on the instruction or the jmp back after it */
+            const displaced_copy* displaced_copy_at(virt_addr pc) const;
+
+            /* the current thread was continued from a slot and stopped before it got back, move it back. False if it wasn't */
+            bool leave_displaced_copy();
+
+            /* the same for a stop of ours, after which the thread is continued as it was: the copy is run first if it hasn't */
+            void run_out_of_displaced_copy(thread_state& thread);
+
+            /*
+            * Apply the effect of the instruction at address to the registers and memory, moving the pc past it,
+            * if it is one of the common ones we know. Returns false, without changing anything, otherwise
+            */
+            bool emulate_instruction(virt_addr address);
+
+            /*
+            * Bring the protection of every page in [low, high) in line with the enabled software watchpoints
+            * covering it: write watches drop PROT_WRITE, rw watches drop everything
+            */
+            void protect_watched_pages(virt_addr low, virt_addr high);
+
+            /* give every watched page its original protection back and forget them, before we let go of the tracee */
+            void restore_watched_pages();
+
+            /* a region of the memory map with the protection it had before software watchpoints changed it */
+            memory_region unwatched_region(const memory_region& region) const;
+
+            /*
+            * After a SIGSEGV on a page we protected, lift the protection, step the instruction and protect it again
+            * A hit turns reason into a software_watch trap. Returns true when the access missed every watched range,
+            * reason is then the single step past it
+            */
+            bool handle_software_watch_fault(stop_reason& reason);
+
+            /* pages protected for software watchpoints */
+            std::map<std::uint64_t, watched_page> watched_pages_;
+            software_watch_stats software_watch_stats_;
+
+            /* inside step_instruction, so a fault passed over is reported as the step */
+            bool single_stepping_ = false;
+
+            /* decoded instructions under breakpoints by address, nullopt when they can't be emulated */
+            std::unordered_map<std::uint64_t, std::optional<emulated_instruction>> emulated_instructions_;
+            step_over_stats step_over_stats_;
+
+            /* copies by original address, nullopt for instructions that have to be stepped in place */
+            std::unordered_map<std::uint64_t, std::optional<displaced_copy>> displaced_copies_;
+            std::vector<virt_addr> displaced_slots_;    /* original address of the copy in each slot */
+            std::optional<displaced_copy> displaced_step_;  /* branch or call being single-stepped from its slot */
+
+            /* record buffer as mapped in the tracee and in our own address space */
+            virt_addr fast_trace_shared_address_;
+            std::byte* fast_trace_shared_ = nullptr;
+            std::size_t fast_trace_shared_size_ = 0;
+
+            /* a timestamp counter reading taken with the steady clock, to convert record times */
+            std::uint64_t fast_trace_base_tsc_ = 0;
+            std::uint64_t fast_trace_base_ns_ = 0;
     };
 
 
@@ -5,6 +5,7 @@
 #include <atomic>
 #include <cstdint>
 #include <variant>
+#include <sys/types.h>
 #include <sys/user.h>
 #include <libsdb/register_info.hpp>
 #include <libsdb/types.hpp>
@@ -18,6 +19,7 @@ namespace sdb {
     class Process;
     /* 
     * Process handles reading, from registers then debugger handles writing
+    * Each thread of the tracee has its own set
      */
     class registers {
         public:
@@ -48,11 +50,37 @@ namespace sdb {
             }
         private:
             friend Process;
-            registers(Process& proc) : proc_(&proc){}
+            registers(Process& proc, pid_t tid) : proc_(&proc), tid_(tid) {}
 
+            /*
+            * Register classes are fetched from the tracee on first access after a stop.
+            * GPR and FPR writes only mark the class dirty, Process flushes them with one SETREGS/SETFPREGS
+            * before the tracee runs. Debug registers are written through and stay cached across stops,
+            * only the kernel changes DR6 behind our back
+            */
+            void load_gprs() const;
+            void load_fprs() const;
+            void load_debug_register(int index) const;
+            void load(const register_info& info) const;
 
-            user data_; /* stores raw bytes and uses the user struct from sys/user.h - register values */
+            /* push dirty GPRs and FPRs to the tracee */
+            void flush();
+
+            /* the tracee ran, drop GPRs, FPRs and DR6 */
+            void invalidate();
+
+            /* now tracing a different process, drop the debug registers as well */
+            void invalidate_all();
+
+            mutable user data_; /* stores raw bytes and uses the user struct from sys/user.h - register values */
             Process * proc_; /* responsibe for handling */
+            pid_t tid_;      /* thread the registers belong to */
+
+            mutable bool gprs_loaded_ = false;
+            mutable bool fprs_loaded_ = false;
+            mutable std::uint8_t debug_registers_loaded_ = 0;  /* one bit per DR0-DR7 */
+            bool gprs_dirty_ = false;
+            bool fprs_dirty_ = false;
 
     };
 }
@@ -0,0 +1,89 @@
+#ifndef SDB_SNAPSHOT_HPP
+#define SDB_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <libsdb/types.hpp>
+
+/***********************************
+* Copies of the tracee's writable memory, kept in an unlinked mmap-ed file
+************************************/
+
+namespace sdb {
+    class Process;
+
+    class snapshot {
+        public:
+            /* snapshots own a mapping and a file descriptor so they can't be copied or moved */
+            snapshot() = delete;
+            snapshot(const snapshot&) = delete;
+            snapshot& operator=(const snapshot&) = delete;
+            snapshot(snapshot&&) = delete;
+            snapshot& operator=(snapshot&&) = delete;
+            ~snapshot();
+
+            using id_type = std::int32_t;
+
+            /* one writable mapping captured in the snapshot */
+            struct region {
+                virt_addr low;
+                virt_addr high;
+                std::string path;
+                std::size_t file_offset;        /* where its bytes start in the backing file */
+                std::vector<bool> fetched;      /* pages read from the tracee rather than copied from the base */
+
+                std::uint64_t size() const { return high.addr() - low.addr(); }
+            };
+
+            id_type id() const { return id_; }
+            const std::vector<region>& regions() const { return regions_; }
+
+            /* captured bytes of a region */
+            const std::byte* data(const region& r) const { return data_ + r.file_offset; }
+
+            std::uint64_t size() const { return size_; }
+
+            /* pages read from the tracee, the rest was copied from the base snapshot */
+            std::uint64_t pages_fetched() const { return pages_fetched_; }
+
+            /* id of the snapshot clean pages were copied from, 0 for a full snapshot */
+            id_type base_id() const { return base_id_; }
+
+        private:
+            friend Process;
+            snapshot(id_type id, std::vector<region> regions);
+
+            id_type id_;
+            id_type base_id_ = 0;
+            std::vector<region> regions_;
+            std::uint64_t size_ = 0;
+            std::uint64_t pages_fetched_ = 0;
+
+            int fd_ = -1;
+            std::byte* data_ = nullptr;
+
+            std::byte* data(const region& r) { return data_ + r.file_offset; }
+    };
+
+    /* what changed between two snapshots */
+    struct snapshot_diff {
+        struct range {
+            virt_addr address;
+            std::size_t size;
+        };
+
+        std::uint64_t pages_compared = 0;
+        std::uint64_t pages_changed = 0;
+        std::vector<range> ranges;  /* maximal runs of differing bytes in address order */
+    };
+
+    /*
+    * Compare two snapshots of the same process. Only address ranges captured by both are compared,
+    * and if after was built incrementally on top of before only its fetched pages can differ
+    */
+    snapshot_diff diff_snapshots(const snapshot& before, const snapshot& after);
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <memory>
 #include <libsdb/types.hpp>
 #include <algorithm>
+#include <unordered_map>
 #include <libsdb/error.hpp>
 
 // covers breakpoint sites, source-level breakpoints and watchpoints
@@ -44,6 +45,13 @@ namespace sdb {
             void for_each(F f) const;
 
             std::size_t size() const { return stoppoints_.size(); }
+
+            /* make room for n more stop points before adding many at once */
+            void reserve(std::size_t n) {
+                stoppoints_.reserve(stoppoints_.size() + n);
+                by_id_.reserve(by_id_.size() + n);
+                by_address_.reserve(by_address_.size() + n);
+            }
             bool empty() const { return stoppoints_.empty(); }
 
             /* get all sites in a region of memory */
@@ -51,13 +59,23 @@ namespace sdb {
 
         private:
             using points_t = std::vector<std::unique_ptr<Stoppoint>>;
-            points_t stoppoints_;
+            points_t stoppoints_; /* owns the stop points, in the order they were added */
+
+            /*
+            * Indexes over stoppoints_ so stops don't scan the whole collection.
+            * Ids and addresses are hashed for O(1) lookups. When several stop points share a key the index holds
+            * the first one added, like the linear search it replaces did. Region queries use a flat vector sorted
+            * by address that is rebuilt lazily, so adding many stop points in a row doesn't shift it every time
+            */
+            std::unordered_map<typename Stoppoint::id_type, Stoppoint*> by_id_;
+            std::unordered_map<std::uint64_t, Stoppoint*> by_address_;
+            mutable std::vector<Stoppoint*> by_region_;
+            mutable bool by_region_stale_ = false;
+
+            const std::vector<Stoppoint*>& sorted_by_address() const;
 
-            /* returns iterator to the stop point's vector */
-            typename points_t::iterator find_by_id(typename Stoppoint::id_type id);
-            typename points_t::const_iterator find_by_id(typename Stoppoint::id_type id) const;
-            typename points_t::iterator find_by_address(sdb::virt_addr address);
-            typename points_t::const_iterator find_by_address(sdb::virt_addr address) const;
+            /* remove a stop point from the indexes and the collection */
+            void erase(Stoppoint& point);
     };
 
     /* function implementations */
@@ -65,52 +83,72 @@ namespace sdb {
     Stoppoint& stoppoint_collection<Stoppoint>::push(std::unique_ptr<Stoppoint> bs) {
         //vector. cannot copy unique_ptr so we need to use std::move
         stoppoints_.push_back(std::move(bs));
-        return *stoppoints_.back();
-    }
+        auto point = stoppoints_.back().get();
 
-    //points_t::iterator is a member of type of sdb::stoppoint_collection<Stoppoint>
-    //avoid this by making the return type auto
-    template<typename Stoppoint>
-    auto stoppoint_collection<Stoppoint>::find_by_id(typename Stoppoint::id_type id) -> typename points_t::iterator {
-        return std::find_if(begin(stoppoints_), end (stoppoints_), [=] (auto &point) { return point->id() == id; });
+        //emplace keeps an existing entry, so the first stop point with a key stays indexed
+        by_id_.emplace(point->id(), point);
+        by_address_.emplace(point->address().addr(), point);
+        by_region_stale_ = true;
+        return *point;
     }
 
     template<typename Stoppoint>
-    auto stoppoint_collection<Stoppoint>::find_by_id(typename Stoppoint::id_type id) const -> typename points_t::const_iterator {
-        //remove the const of this and call the non-const overload
-        //still converts iterator to const_iterator so not in danger of breaking const_correctness
-        return const_cast<stoppoint_collection*>(this)->find_by_id(id);
+    auto stoppoint_collection<Stoppoint>::sorted_by_address() const -> const std::vector<Stoppoint*>& {
+        if (by_region_stale_) {
+            by_region_.clear();
+            for (auto& point : stoppoints_) {
+                by_region_.push_back(point.get());
+            }
+            //stable so stop points at the same address stay in the order they were added
+            std::stable_sort(by_region_.begin(), by_region_.end(),
+                             [](auto lhs, auto rhs) { return lhs->address() < rhs->address(); });
+            by_region_stale_ = false;
+        }
+        return by_region_;
     }
 
-    /* returns an iterator to the satisfied element or last */
     template<typename Stoppoint>
-    auto stoppoint_collection<Stoppoint>::find_by_address(virt_addr address) 
-        -> typename points_t::iterator {
-        return std::find_if(begin(stoppoints_), end(stoppoints_), [=](auto& point) { return point->at_address(address);});
-    }
+    void stoppoint_collection<Stoppoint>::erase(Stoppoint& point) {
+        auto owner = std::find_if(begin(stoppoints_), end(stoppoints_), [&](auto& p) { return p.get() == &point; });
 
-    template<typename Stoppoint>
-    auto stoppoint_collection<Stoppoint>::find_by_address(virt_addr address) const
-        -> typename points_t::const_iterator {
-        //iterator converted to const::iterator
-        return const_cast<stoppoint_collection*>(this)->find_by_address(address); 
+        if (!by_region_stale_) {
+            by_region_.erase(std::find(by_region_.begin(), by_region_.end(), &point));
+        }
+
+        //hand an index entry over to the next stop point with the same key, if there is one
+        auto id = point.id();
+        auto address = point.address();
+        bool reindex_id = by_id_.at(id) == &point;
+        bool reindex_address = by_address_.at(address.addr()) == &point;
+        if (reindex_id) by_id_.erase(id);
+        if (reindex_address) by_address_.erase(address.addr());
+
+        stoppoints_.erase(owner);
+
+        if (reindex_id or reindex_address) {
+            for (auto& p : stoppoints_) {
+                if (reindex_id and p->id() == id) by_id_.emplace(id, p.get());
+                if (reindex_address and p->at_address(address)) by_address_.emplace(address.addr(), p.get());
+            }
+        }
     }
 
     /* check if there's a stoppoint by this id in the collection */
     template<typename Stoppoint>
     bool stoppoint_collection<Stoppoint>::contains_id(typename Stoppoint::id_type id) const {
-        return find_by_id(id) != end(stoppoints_);
+        return by_id_.count(id) != 0;
     }
 
     template<typename Stoppoint>
     bool stoppoint_collection<Stoppoint>::contains_address(virt_addr address) const {
-        return find_by_address(address) != end(stoppoints_);
+        return by_address_.count(address.addr()) != 0;
     }
 
     template<typename Stoppoint>
     bool stoppoint_collection<Stoppoint>::enabled_stoppoint_at_address(
         virt_addr address) const {
-        return contains_address(address) and get_by_address(address).is_enabled();
+        auto it = by_address_.find(address.addr());
+        return it != by_address_.end() and it->second->is_enabled();
     }
 
     /***** GET FUNCTIONS *****/
@@ -118,12 +156,12 @@ namespace sdb {
     template<typename Stoppoint>
     Stoppoint& stoppoint_collection<Stoppoint>::get_by_id(
         typename Stoppoint::id_type id) {
-        auto it = find_by_id(id);
-        if (it == end(stoppoints_)) {
+        auto it = by_id_.find(id);
+        if (it == by_id_.end()) {
             error::send("Invalid stoppoint id");
         }
 
-        return **it; //one for the iterator, and one for the std::unique_ptr it references
+        return *it->second;
     }
 
     /* same as above, remove const casting and call non-const overload */
@@ -135,11 +173,11 @@ namespace sdb {
 
     template<typename Stoppoint>
     Stoppoint& stoppoint_collection<Stoppoint>::get_by_address(virt_addr address) {
-        auto it = find_by_address(address);
-        if (it == end(stoppoints_)) {
+        auto it = by_address_.find(address.addr());
+        if (it == by_address_.end()) {
             error::send("Stoppoint with given address not found");
         }
-        return **it;
+        return *it->second;
     }
 
     template<typename Stoppoint>
@@ -150,16 +188,16 @@ namespace sdb {
     /* find the relevant stop point, disable it then erase them from the container */
     template<typename Stoppoint>
     void stoppoint_collection<Stoppoint>::remove_by_id(typename Stoppoint::id_type id) {
-        auto it = find_by_id(id);
-        (**it).disable();
-        stoppoints_.erase(it);
+        auto& point = get_by_id(id);
+        point.disable();
+        erase(point);
     }
 
     template<typename Stoppoint>
     void stoppoint_collection<Stoppoint>::remove_by_address(virt_addr address) {
-        auto it = find_by_address(address);
-        (**it).disable();
-        stoppoints_.erase(it);
+        auto& point = get_by_address(address);
+        point.disable();
+        erase(point);
     }
     
     /* loops over the stop points in the collection, calling f parameter with each one */
@@ -183,16 +221,12 @@ namespace sdb {
     }
     template<typename Stoppoint>
     std::vector<Stoppoint*> stoppoint_collection<Stoppoint>::get_in_region(virt_addr low, virt_addr high) const {
-        std::vector<Stoppoint*> ret;
-        //get each pointer out
-        for (const auto & point : stoppoints_) {
-            if (point->in_range(low, high)) {
-
-                //extract the raw pointer from unique_ptr and push into vector 
-                ret.push_back(point.get());
-            }
-        }
-        return ret;
+        //binary search the address-ordered index for [low, high), results come in address order
+        auto& sorted = sorted_by_address();
+        auto by_address = [](auto point, virt_addr address) { return point->address() < address; };
+        auto first = std::lower_bound(sorted.begin(), sorted.end(), low, by_address);
+        auto last = std::lower_bound(first, sorted.end(), high, by_address);
+        return { first, last };
     }
 
 }
@@ -0,0 +1,78 @@
+#ifndef SDB_SYSCALL_LOG_HPP
+#define SDB_SYSCALL_LOG_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+/***********************************
+* Every syscall the tracee made while tracing was on, one column per field so summaries only touch the
+* columns they need and the binary dump is a handful of contiguous writes
+************************************/
+
+namespace sdb {
+    /* count and latency of one syscall number */
+    struct syscall_summary {
+        std::uint16_t id;
+        std::uint64_t count;
+        std::uint64_t errors;       /* returned -4095 to -1 */
+        std::uint64_t total_ns;
+        std::uint64_t p50_ns;
+        std::uint64_t p99_ns;
+    };
+
+    class syscall_log {
+        public:
+            /* called from the syscall stops of thread tid, times are steady clock nanoseconds */
+            void record_entry(pid_t tid, std::uint16_t id, const std::array<std::int64_t, 6>& args, std::uint64_t time_ns);
+            /* returns false if the entry wasn't seen, nothing is added then */
+            bool record_exit(pid_t tid, std::int64_t ret, std::uint64_t time_ns);
+
+            /* strace-style text of a row, decoded at its exit stop while the tracee still held its buffers */
+            void set_text(std::size_t row, std::string text) { texts_[row] = std::move(text); }
+            const std::string& text(std::size_t row) const { return texts_[row]; }
+
+            /* completed syscalls */
+            std::size_t size() const { return ids_.size(); }
+            bool empty() const { return ids_.empty(); }
+            void clear();
+
+            std::uint16_t id(std::size_t row) const { return ids_[row]; }
+            std::int64_t arg(std::size_t row, std::size_t index) const { return args_[index][row]; }
+            std::int64_t ret(std::size_t row) const { return rets_[row]; }
+            std::uint64_t entry_ns(std::size_t row) const { return entry_ns_[row]; }
+            std::uint64_t exit_ns(std::size_t row) const { return exit_ns_[row]; }
+
+            /* one entry per syscall number seen, busiest in total time first */
+            std::vector<syscall_summary> summarize() const;
+
+            /*
+            * binary: "SDBSYSLG", uint32 version, uint64 row count, then each column in turn:
+            *         uint16 id, int64 arg0 to arg5, int64 ret, uint64 entry_ns, uint64 exit_ns
+            */
+            void dump(std::ostream& out) const;
+
+        private:
+            std::vector<std::uint16_t> ids_;
+            std::array<std::vector<std::int64_t>, 6> args_;
+            std::vector<std::int64_t> rets_;
+            std::vector<std::uint64_t> entry_ns_;
+            std::vector<std::uint64_t> exit_ns_;
+            std::vector<std::string> texts_;    /* not part of the dump */
+
+            /* entered and not yet returned, by thread */
+            struct pending_syscall {
+                std::uint16_t id;
+                std::array<std::int64_t, 6> args;
+                std::uint64_t time_ns;
+            };
+            std::unordered_map<pid_t, pending_syscall> pending_;
+    };
+}
+
+#endif
@@ -1,11 +1,56 @@
 #ifndef SDB_SYSCALLS_HPP
 #define SDB_SYSCALLS_HPP
 
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
 #include <string_view>
 
 /* conversion between syscall ids to names */
 namespace sdb {
+    class Process; //forward declaration
+
     std::string_view syscall_id_to_name(int id);
     int name_to_syscall_id(std::string_view name);
+
+    /* the name, or syscall_<id> for ids newer than our table, for output that must not throw */
+    std::string syscall_display_name(int id);
+
+    /* how a syscall argument is shown when decoded */
+    enum class syscall_arg_kind : std::uint8_t {
+        none,           /* past the last argument */
+        signed_int,
+        unsigned_int,
+        hex,
+        octal,          /* modes */
+        fd,
+        string,         /* NUL-terminated */
+        buffer,         /* read by the syscall, its size is in the argument length_arg */
+        out_buffer,     /* filled by the syscall, the return value says how much */
+        open_flags,
+        mmap_prot,
+        mmap_flags,
+        signal,
+        pointer         /* to a struct, only the address is shown */
+    };
+
+    struct syscall_arg_type {
+        syscall_arg_kind kind = syscall_arg_kind::none;
+        std::uint8_t length_arg = 0;
+    };
+
+    using syscall_signature = std::array<syscall_arg_type, 6>;
+
+    /* nullptr for syscalls without a known signature, their six registers are shown as raw hex */
+    const syscall_signature* get_syscall_signature(int id);
+
+    /*
+    * strace-style "write(1, "hi\n", 3)" from the arguments of a syscall entry. Strings and buffers are read
+    * from the stopped tracee, all of them in one batch. Given the return value, at the syscall exit, buffers
+    * the syscall filled are shown too and " = ret" is appended
+    */
+    std::string decode_syscall(const Process& proc, int id, const std::array<std::int64_t, 6>& args,
+                               std::optional<std::int64_t> ret = std::nullopt);
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,60 @@
+#ifndef SDB_TRACE_BUFFER_HPP
+#define SDB_TRACE_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <libsdb/types.hpp>
+
+/***********************************
+* Preallocated single-producer single-consumer ring of variable length records.
+* The producer never blocks or allocates, a record that doesn't fit is dropped and counted
+************************************/
+
+namespace sdb {
+    class trace_buffer {
+        public:
+            trace_buffer() = delete;
+            trace_buffer(const trace_buffer&) = delete;
+            trace_buffer& operator=(const trace_buffer&) = delete;
+            trace_buffer(trace_buffer&&) = delete;
+            trace_buffer& operator=(trace_buffer&&) = delete;
+
+            /* capacity in bytes, rounded up to a power of two */
+            explicit trace_buffer(std::size_t capacity);
+
+            /* producer side, returns false if the record was dropped for lack of space */
+            bool push(span<const std::byte> record);
+
+            /* consumer side, replaces record with the oldest one, returns false if the buffer is empty */
+            bool pop(std::vector<std::byte>& record);
+
+            std::size_t capacity() const { return data_.size(); }
+
+            /* bytes in use, including the length prefix of each record */
+            std::size_t used() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+
+            std::uint64_t pushed() const { return pushed_.load(std::memory_order_relaxed); }
+            std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+        private:
+            /* each record is stored as a 32-bit length followed by its bytes, wrapping at the end */
+            using length_type = std::uint32_t;
+
+            void copy_in(std::uint64_t pos, const std::byte* data, std::size_t size);
+            void copy_out(std::uint64_t pos, std::byte* data, std::size_t size) const;
+
+            std::vector<std::byte> data_;
+            std::size_t mask_;
+
+            /* monotonically increasing byte positions, only ever written by one side each */
+            alignas(64) std::atomic<std::uint64_t> head_{ 0 };     /* producer */
+            alignas(64) std::atomic<std::uint64_t> tail_{ 0 };     /* consumer */
+
+            std::atomic<std::uint64_t> pushed_{ 0 };
+            std::atomic<std::uint64_t> dropped_{ 0 };
+    };
+}
+
+#endif
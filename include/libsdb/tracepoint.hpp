@@ -0,0 +1,105 @@
+#ifndef SDB_TRACEPOINT_HPP
+#define SDB_TRACEPOINT_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <vector>
+#include <libsdb/types.hpp>
+#include <libsdb/register_info.hpp>
+
+namespace sdb {
+    class Process;
+    class breakpoint_site;
+
+    /* output formats for Process::dump_trace */
+    enum class trace_format {
+        binary,
+        csv
+    };
+
+    /*
+    * A breakpoint that records state and lets the tracee continue without stopping the caller of wait_on_signal
+    * Each hit appends one record to the process trace buffer:
+    *   int32 tracepoint id, uint64 hit number, uint64 steady clock nanoseconds,
+    *   then the value of each selected register in its own size, then the bytes of each memory range
+    *
+    * Fast tracepoints replace the code at the address with a jmp to a trampoline instead of an int3,
+    * the tracee records its own hits into shared memory and never stops. See Process::create_fast_tracepoint
+    */
+    class tracepoint {
+        public:
+            tracepoint() = delete;
+            tracepoint(const tracepoint&) = delete;
+            tracepoint& operator=(const tracepoint&) = delete;
+            tracepoint(tracepoint&&) = delete;
+            tracepoint& operator=(tracepoint&&) = delete;
+
+            using id_type = std::int32_t;
+
+            /* memory captured on each hit, at a fixed address or relative to a register value */
+            struct memory_range {
+                std::optional<register_id> base;
+                std::int64_t offset;    /* the address itself when there is no base register */
+                std::size_t size;
+            };
+
+            id_type id() const { return id_; }
+            virt_addr address() const { return address_; }
+            bool is_enabled() const { return is_enabled_; }
+            bool is_fast() const { return site_ == nullptr; }
+
+            void enable();
+            void disable();
+
+            bool at_address(virt_addr addr) const {
+                return address_ == addr;
+            }
+
+            bool in_range(virt_addr low, virt_addr high) const {
+                return low <= address_ and high > address_;
+            }
+
+            /* bytes overwritten by the jmp of a fast tracepoint, nothing may jump past its first byte */
+            std::size_t patch_size() const { return original_code_.size(); }
+
+            const std::vector<register_id>& registers() const { return registers_; }
+            const std::vector<memory_range>& memory() const { return memory_; }
+
+            /*
+            * hits so far, including ones dropped because the trace buffer was full
+            * Fast tracepoint hits are only counted once Process::collect_fast_trace picks them up
+            */
+            std::uint64_t hit_count() const { return hits_; }
+
+            /* size of one record, fixed for a given tracepoint */
+            std::size_t record_size() const;
+
+        private:
+            friend Process;
+
+            tracepoint(Process& proc, breakpoint_site& site,
+                       std::vector<register_id> registers, std::vector<memory_range> memory);
+
+            /* fast tracepoint jumping to trampoline in place of original_code */
+            tracepoint(Process& proc, virt_addr address, std::vector<register_id> registers,
+                       std::vector<std::byte> original_code, virt_addr trampoline);
+
+            /* put the jmp, or the original code, at the address of a fast tracepoint */
+            void write_code(bool jump);
+
+            id_type id_;
+            Process* process_;
+            breakpoint_site* site_;     /* internal site that traps for us, null for fast tracepoints */
+            virt_addr address_;
+            bool is_enabled_ = false;
+            std::vector<register_id> registers_;
+            std::vector<memory_range> memory_;
+            std::uint64_t hits_ = 0;
+
+            std::vector<std::byte> original_code_;
+            virt_addr trampoline_;
+    };
+}
+
+#endif
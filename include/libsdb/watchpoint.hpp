@@ -3,7 +3,10 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <optional>
+#include <utility>
 #include <libsdb/types.hpp>
+#include <libsdb/condition.hpp>
 
 namespace sdb{
     class Process;
@@ -26,6 +29,9 @@ namespace sdb{
             stoppoint_mode mode() const { return mode_;}
             std::size_t size() const { return size_;}
 
+            /* watches by protecting the pages it covers instead of with a debug register */
+            bool is_software() const { return is_software_;}
+
             /* enable and disable watchpoints */
             void enable();
             void disable();
@@ -40,17 +46,24 @@ namespace sdb{
                 return low <= address_ and high > address_;
             }
 
-            /* dealing with watchpoint data */
+            /* dealing with watchpoint data, the first 8 bytes for larger software watchpoints */
             std::uint64_t data() const { return data_;} 
             std::uint64_t previous_data() const { return previous_data_;} 
 
             /* re-reads the value at the watched memory location and updates data and previous data  */
             void update_data();
+
+            /* only stop when the condition holds, it sees data as value and previous data as old */
+            void set_condition(std::optional<condition> cond) { condition_ = std::move(cond); }
+            const std::optional<condition>& get_condition() const { return condition_; }
+
+            /* times the watchpoint fired while continuing, stopped at or not */
+            std::uint64_t hit_count() const { return hit_count_; }
         private:
             friend Process;
 
             watchpoint_site(Process & proc, virt_addr address,
-                            sdb::stoppoint_mode mode, size_t size);
+                            sdb::stoppoint_mode mode, size_t size, bool software);
 
             id_type id_;
             Process * process_;
@@ -58,10 +71,14 @@ namespace sdb{
             sdb::stoppoint_mode mode_;
             size_t size_;
             bool is_enabled_;
+            bool is_software_;
             int hardware_register_index_ = -1; 
 
             std::uint64_t data_ = 0; //current value at read address
             std::uint64_t previous_data_ = 0; //previously read value
+
+            std::optional<condition> condition_;
+            std::uint64_t hit_count_ = 0;
     };
 }
 #endif
\ No newline at end of file
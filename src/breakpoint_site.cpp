@@ -2,6 +2,7 @@
 #include <libsdb/breakpoint_site.hpp>
 #include <libsdb/process.hpp>
 #include <libsdb/error.hpp>
+#include <libsdb/bits.hpp>
 
 namespace {
     /* in gdb, the id of breakpoints are local to a session */
@@ -31,7 +32,7 @@ void sdb::breakpoint_site::enable() {
         hardware_register_index_ = process_->set_hardware_breakpoint(id_, address_);
     } else {
         errno = 0;
-        std::uint64_t data = ptrace(PTRACE_PEEKDATA, process_->get_pid(), address_, nullptr);
+        std::uint64_t data = ptrace(PTRACE_PEEKDATA, process_->current_thread(), address_, nullptr);
         if (errno != 0) {
             error::send_errno("Enable breakpoint site failed!");
         }
@@ -46,9 +47,12 @@ void sdb::breakpoint_site::enable() {
         /* replace the first 8 bits with int3 opcode */
         std::uint64_t data_int3 = ((data & ~0xff) | int3);
     
-        if (ptrace(PTRACE_POKEDATA, process_->get_pid(), address_, data_int3) < 0) {
+        if (ptrace(PTRACE_POKEDATA, process_->current_thread(), address_, data_int3) < 0) {
             error::send_errno("Enable breakpoint site failed");
         }
+
+        /* keep cached copies of this page in sync with the int3 we just wrote */
+        process_->memory_cache_.patch(address_, {as_bytes(data_int3), 1});
     }
 
     is_enabled_ = true;
@@ -67,7 +71,7 @@ void sdb::breakpoint_site::disable() {
         hardware_register_index_ = -1;
     } else {
         errno = 0;
-        std::uint64_t data = ptrace(PTRACE_PEEKDATA, process_->get_pid(), address_, nullptr);
+        std::uint64_t data = ptrace(PTRACE_PEEKDATA, process_->current_thread(), address_, nullptr);
         if (errno != 0) {
             error::send_errno("Disabling breakpoint site failed");
         }
@@ -75,9 +79,11 @@ void sdb::breakpoint_site::disable() {
         /* zeroed out the opcode of int3, which is 0xcc and then replace the old instruction back in */
         auto restored_data = ((data & ~0xff) | static_cast<std::uint8_t>(saved_data_));
     
-        if (ptrace(PTRACE_POKEDATA, process_->get_pid(), address_, restored_data) < 0) {
+        if (ptrace(PTRACE_POKEDATA, process_->current_thread(), address_, restored_data) < 0) {
             error::send_errno("Disabling breakpoint site failed");
         }
+
+        process_->memory_cache_.patch(address_, {as_bytes(restored_data), 1});
     
     }
 
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cstddef>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+
+namespace {
+    /* x86-64 syscall instruction */
+    constexpr std::uint8_t syscall_instruction[] = { 0x0f, 0x05 };
+
+    int open_mem(pid_t pid) {
+        auto path = "/proc/" + std::to_string(pid) + "/mem";
+        auto fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            sdb::error::send_errno("Could not open " + path);
+        }
+        return fd;
+    }
+
+    void write_mem(int fd, std::uint64_t address, const void* data, std::size_t size) {
+        if (pwrite(fd, data, size, address) != static_cast<ssize_t>(size)) {
+            sdb::error::send_errno("Could not write process memory");
+        }
+    }
+
+    /* put a process back exactly as it was before we injected the fork */
+    void restore(pid_t pid, int mem_fd, const user_regs_struct& regs, const std::uint8_t* code) {
+        write_mem(mem_fd, regs.rip, code, sizeof(syscall_instruction));
+        if (ptrace(PTRACE_SETREGS, pid, nullptr, &regs) < 0) {
+            sdb::error::send_errno("Could not restore registers");
+        }
+    }
+
+    /*
+    * Make a stopped tracee call fork() at its current pc and return the pid of the child,
+    * which is auto-attached through PTRACE_O_TRACEFORK and left in its initial SIGSTOP.
+    * Both processes end up with the registers and code bytes the tracee had before
+    * pid may be any thread, the child only has a copy of that one. Both are left with the given ptrace options,
+    * forks are otherwise only traced while we make one
+    */
+    pid_t fork_stopped_copy(pid_t pid, long options) {
+        user_regs_struct saved;
+        if (ptrace(PTRACE_GETREGS, pid, nullptr, &saved) < 0) {
+            sdb::error::send_errno("Could not read registers");
+        }
+
+        auto mem_fd = open_mem(pid);
+        std::uint8_t code[sizeof(syscall_instruction)];
+        if (pread(mem_fd, code, sizeof(code), saved.rip) != sizeof(code)) {
+            close(mem_fd);
+            sdb::error::send_errno("Could not read process memory");
+        }
+
+        pid_t child = 0;
+        try {
+            write_mem(mem_fd, saved.rip, syscall_instruction, sizeof(syscall_instruction));
+
+            //orig_rax of -1 keeps the kernel from treating this stop as an interrupted syscall to restart
+            auto regs = saved;
+            regs.rax = SYS_fork;
+            regs.orig_rax = -1;
+            if (ptrace(PTRACE_SETREGS, pid, nullptr, &regs) < 0) {
+                sdb::error::send_errno("Could not set registers");
+            }
+            if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, options | PTRACE_O_TRACEFORK) < 0) {
+                sdb::error::send_errno("Could not trace fork");
+            }
+
+            //the first step stops at the fork event, the second once the syscall has returned
+            int status;
+            if (ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) < 0 or waitpid(pid, &status, __WALL) < 0) {
+                sdb::error::send_errno("Could not run fork");
+            }
+            //a seccomp filter catching fork stops before it runs
+            if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8)) and
+                (ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) < 0 or waitpid(pid, &status, __WALL) < 0)) {
+                sdb::error::send_errno("Could not run fork");
+            }
+            if (status >> 8 != (SIGTRAP | (PTRACE_EVENT_FORK << 8))) {
+                sdb::error::send("Process did not fork");
+            }
+
+            unsigned long message;
+            ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &message);
+            child = static_cast<pid_t>(message);
+
+            if (ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr) < 0 or waitpid(pid, &status, __WALL) < 0) {
+                sdb::error::send_errno("Could not finish fork");
+            }
+            ptrace(PTRACE_SETOPTIONS, pid, nullptr, options);
+            restore(pid, mem_fd, saved, code);
+        } catch (...) {
+            ptrace(PTRACE_SETOPTIONS, pid, nullptr, options);
+            ptrace(PTRACE_SETREGS, pid, nullptr, &saved);
+            pwrite(mem_fd, code, sizeof(code), saved.rip);
+            close(mem_fd);
+            if (child) {
+                kill(child, SIGKILL);
+                waitpid(child, nullptr, __WALL);
+            }
+            throw;
+        }
+        close(mem_fd);
+
+        //the child inherited our options and the patched code
+        int status;
+        if (waitpid(child, &status, __WALL) < 0 or !WIFSTOPPED(status)) {
+            sdb::error::send_errno("Forked process did not stop");
+        }
+
+        auto child_mem_fd = open_mem(child);
+        try {
+            restore(child, child_mem_fd, saved, code);
+        } catch (...) {
+            close(child_mem_fd);
+            kill(child, SIGKILL);
+            waitpid(child, nullptr, __WALL);
+            throw;
+        }
+        close(child_mem_fd);
+        ptrace(PTRACE_SETOPTIONS, child, nullptr, options);
+
+        return child;
+    }
+
+    void kill_checkpoint(pid_t pid) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, __WALL);
+    }
+}
+
+void sdb::Process::remove_traps_from(pid_t pid) const {
+    auto mem_fd = open_mem(pid);
+    try {
+        breakpoint_sites_.for_each([&](auto& site) {
+            if (site.is_enabled() and !site.is_hardware()) {
+                write_mem(mem_fd, site.address().addr(), &site.saved_data_, 1);
+            }
+        });
+    } catch (...) {
+        close(mem_fd);
+        throw;
+    }
+    close(mem_fd);
+}
+
+sdb::checkpoint::id_type sdb::Process::create_checkpoint() {
+    if (state_ != process_state::stopped) {
+        error::send("Process must be stopped to checkpoint");
+    }
+    auto& thread = current_thread_state();
+    if (thread.current_syscall) {
+        error::send("Cannot checkpoint inside a syscall");
+    }
+
+    //the copy has to see register changes made during this stop, it is forked from the current thread
+    thread.regs->flush();
+    auto pid = fork_stopped_copy(thread.tid, ptrace_options(!filtered_syscalls_.empty()));
+
+    //stepping the injected syscall changed DR6
+    thread.regs->invalidate();
+    try {
+        remove_traps_from(pid);
+    } catch (...) {
+        kill_checkpoint(pid);
+        throw;
+    }
+
+    checkpoints_.push_back({ next_checkpoint_id_++, pid, get_pc(), scratch_code_.addr() != 0, fast_trace_shared_ != nullptr,
+                             watched_pages_, filtered_syscalls_ });
+    return checkpoints_.back().id;
+}
+
+void sdb::Process::restart_checkpoint(checkpoint::id_type id) {
+    auto it = std::find_if(checkpoints_.begin(), checkpoints_.end(), [=](auto& cp) { return cp.id == id; });
+    if (it == checkpoints_.end()) {
+        error::send("Invalid checkpoint id");
+    }
+
+    //trampolines and the shared buffer exist only in processes forked after they were set up
+    if (fast_trace_shared_ and !it->has_fast_trace) {
+        error::send("Checkpoint was taken before fast tracepoints were set up");
+    }
+
+    //keep the checkpoint itself pristine for later restarts, and the old process is going away
+    //so pending register changes are dropped
+    auto pid = fork_stopped_copy(it->pid, ptrace_options(!it->filtered_syscalls.empty()));
+
+    //let go of the current process
+    if (terminate_on_end_) {
+        kill_threads();
+    } else if (is_attached_ and (state_ == process_state::stopped or state_ == process_state::running)) {
+        stop_running_threads();
+        remove_traps_from(pid_);
+        detach_threads();
+    }
+
+    //the copy is ours to kill whoever started the original, and has a single thread
+    pid_ = pid;
+    terminate_on_end_ = true;
+    is_attached_ = true;
+    state_ = process_state::stopped;
+    threads_.clear();
+    early_stops_.clear();
+    current_thread_ = pid;
+    add_thread(pid).state = process_state::stopped;
+
+    //the copy has the seccomp filters installed before it was taken, the next resume adds any missing
+    filtered_syscalls_ = it->filtered_syscalls;
+    syscall_filter_ready_ = false;
+    syscall_filter_failed_ = false;
+
+    //nothing we knew about the old process carries over
+    if (mem_fd_ >= 0) {
+        close(mem_fd_);
+        mem_fd_ = -1;
+    }
+    memory_cache_.invalidate();
+    memory_map_stale_ = true;
+    soft_dirty_tracking_ = false;
+
+    //fork doesn't inherit debug registers, and the checkpoint holds no int3s
+    debug_registers_ = {};
+    breakpoint_sites_.for_each([](auto& site) {
+        if (site.is_enabled()) {
+            site.is_enabled_ = false;
+            site.hardware_register_index_ = -1;
+            site.enable();
+        }
+    });
+    //the copy has the page protections software watchpoints had when it was taken
+    watched_pages_ = it->watched_pages;
+    watchpoints_.for_each([](auto& site) {
+        if (site.is_enabled()) {
+            site.is_enabled_ = false;
+            site.hardware_register_index_ = -1;
+            site.enable();
+        }
+    });
+    for (auto& [page, protection] : it->watched_pages) {
+        protect_watched_pages(virt_addr{ page }, virt_addr{ page + page_cache::page_size });
+    }
+
+    //scratch code mapped after the checkpoint doesn't exist in the copy, what was there may since have been overwritten
+    if (scratch_code_.addr() != 0 and !it->has_scratch_code) {
+        scratch_code_ = virt_addr{ 0 };
+        scratch_code_used_ = 0;
+        scratch_code_shadow_.clear();
+        displaced_copies_.clear();
+        displaced_slots_.clear();
+    } else if (scratch_code_.addr() != 0) {
+        write_memory(scratch_code_, { scratch_code_shadow_.data(), scratch_code_used_ }, memory_write_path::proc_mem);
+    }
+    scratch_code_failed_ = false;
+    displaced_step_.reset();
+    emulated_instructions_.clear();
+
+    //the copy has the jmps that were in place when the checkpoint was taken
+    tracepoints_.for_each([](auto& tp) {
+        if (tp.is_fast()) {
+            tp.write_code(tp.is_enabled());
+        }
+    });
+}
+
+void sdb::Process::delete_checkpoint(checkpoint::id_type id) {
+    auto it = std::find_if(checkpoints_.begin(), checkpoints_.end(), [=](auto& cp) { return cp.id == id; });
+    if (it == checkpoints_.end()) {
+        error::send("Invalid checkpoint id");
+    }
+
+    kill_checkpoint(it->pid);
+    checkpoints_.erase(it);
+}
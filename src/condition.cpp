@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <iterator>
+#include <type_traits>
+#include <libsdb/condition.hpp>
+#include <libsdb/registers.hpp>
+#include <libsdb/error.hpp>
+
+namespace sdb {
+    /* recursive descent over the text, emitting postfix code as each operand and operator is recognized */
+    class condition_parser {
+        public:
+            explicit condition_parser(std::string_view text) : text_(text) {}
+
+            condition parse() {
+                condition result;
+                result.text_ = std::string(text_);
+                code_ = &result.code_;
+
+                next_token();
+                parse_binary(0);
+                if (!token_.empty()) {
+                    fail("unexpected '" + std::string(token_) + "'");
+                }
+                if (code_->empty()) {
+                    fail("empty expression");
+                }
+                return result;
+            }
+
+        private:
+            using opcode = condition::opcode;
+
+            struct binary_operator {
+                std::string_view token;
+                opcode op;
+            };
+
+            //lowest precedence first, operators on one level associate left
+            static constexpr std::size_t levels = 10;
+            static inline const std::vector<binary_operator> operators_[levels] = {
+                { { "||", opcode::logical_or } },
+                { { "&&", opcode::logical_and } },
+                { { "|", opcode::bit_or } },
+                { { "^", opcode::bit_xor } },
+                { { "&", opcode::bit_and } },
+                { { "==", opcode::equal }, { "!=", opcode::not_equal } },
+                { { "<", opcode::less }, { "<=", opcode::less_equal },
+                  { ">", opcode::greater }, { ">=", opcode::greater_equal } },
+                { { "<<", opcode::shift_left }, { ">>", opcode::shift_right } },
+                { { "+", opcode::add }, { "-", opcode::subtract } },
+                { { "*", opcode::multiply }, { "/", opcode::divide }, { "%", opcode::modulo } },
+            };
+
+            [[noreturn]] void fail(const std::string& what) {
+                error::send("Invalid condition: " + what);
+            }
+
+            void next_token() {
+                while (pos_ < text_.size() and std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+                    ++pos_;
+                }
+                auto begin = pos_;
+                if (pos_ == text_.size()) {
+                    token_ = {};
+                    return;
+                }
+
+                auto c = text_[pos_];
+                if (std::isalnum(static_cast<unsigned char>(c)) or c == '_') {
+                    while (pos_ < text_.size() and
+                           (std::isalnum(static_cast<unsigned char>(text_[pos_])) or text_[pos_] == '_')) {
+                        ++pos_;
+                    }
+                } else {
+                    static constexpr std::string_view two_chars[] = { "||", "&&", "==", "!=", "<=", ">=", "<<", ">>" };
+                    auto two = text_.substr(pos_, 2);
+                    bool is_two = std::find(std::begin(two_chars), std::end(two_chars), two) != std::end(two_chars);
+                    pos_ += is_two ? 2 : 1;
+                }
+                token_ = text_.substr(begin, pos_ - begin);
+            }
+
+            void emit(opcode op, std::uint64_t operand = 0) {
+                code_->push_back({ op, operand });
+                switch (op) {
+                    case opcode::constant:
+                    case opcode::reg:
+                    case opcode::hits:
+                    case opcode::value:
+                    case opcode::old:
+                        if (++depth_ > condition::max_depth) {
+                            fail("expression too deeply nested");
+                        }
+                        break;
+                    case opcode::logical_not:
+                    case opcode::negate:
+                    case opcode::bit_not:
+                        break;
+                    default:
+                        --depth_;
+                }
+            }
+
+            void parse_binary(std::size_t level) {
+                if (level == levels) {
+                    parse_unary();
+                    return;
+                }
+
+                parse_binary(level + 1);
+                for (;;) {
+                    auto& ops = operators_[level];
+                    auto it = std::find_if(ops.begin(), ops.end(), [&](auto& op) { return op.token == token_; });
+                    if (it == ops.end()) {
+                        return;
+                    }
+                    next_token();
+                    parse_binary(level + 1);
+                    emit(it->op);
+                }
+            }
+
+            //unary operators and parentheses recurse without growing the evaluation stack, they are counted apart
+            void enter() {
+                if (++nesting_ > condition::max_depth) {
+                    fail("expression too deeply nested");
+                }
+            }
+
+            void parse_unary() {
+                if (token_ == "!" or token_ == "-" or token_ == "~") {
+                    auto op = token_ == "!" ? opcode::logical_not : token_ == "-" ? opcode::negate : opcode::bit_not;
+                    enter();
+                    next_token();
+                    parse_unary();
+                    emit(op);
+                    --nesting_;
+                    return;
+                }
+                parse_primary();
+            }
+
+            void parse_primary() {
+                if (token_.empty()) {
+                    fail("expression ends early");
+                }
+
+                if (token_ == "(") {
+                    enter();
+                    next_token();
+                    parse_binary(0);
+                    if (token_ != ")") {
+                        fail("missing ')'");
+                    }
+                    next_token();
+                    --nesting_;
+                    return;
+                }
+
+                if (std::isdigit(static_cast<unsigned char>(token_[0]))) {
+                    std::string digits(token_);
+                    std::size_t used = 0;
+                    std::uint64_t value = 0;
+                    try {
+                        value = std::stoull(digits, &used, 0);
+                    } catch (...) {}
+                    if (used != digits.size()) {
+                        fail("bad number '" + digits + "'");
+                    }
+                    emit(opcode::constant, value);
+                    next_token();
+                    return;
+                }
+
+                if (token_ == "hits") emit(opcode::hits);
+                else if (token_ == "value") emit(opcode::value);
+                else if (token_ == "old") emit(opcode::old);
+                else {
+                    auto it = std::find_if(std::begin(g_register_infos), std::end(g_register_infos),
+                                           [&](auto& info) { return info.name == token_; });
+                    if (it == std::end(g_register_infos) or it->format != register_format::uint) {
+                        fail("unknown name '" + std::string(token_) + "'");
+                    }
+                    emit(opcode::reg, it - std::begin(g_register_infos));
+                }
+                next_token();
+            }
+
+            std::string_view text_;
+            std::size_t pos_ = 0;
+            std::string_view token_;
+            std::vector<condition::instruction>* code_ = nullptr;
+            std::size_t depth_ = 0;     /* values on the evaluation stack */
+            std::size_t nesting_ = 0;   /* unary operators and parentheses we are inside of */
+    };
+}
+
+sdb::condition sdb::condition::compile(std::string_view text) {
+    return condition_parser(text).parse();
+}
+
+bool sdb::condition::evaluate(const condition_context& context) const {
+    std::array<std::uint64_t, max_depth> stack;
+    std::size_t top = 0;
+
+    for (auto& instr : code_) {
+        //binary operators take the top two, a is the left operand
+        auto& a = top >= 2 ? stack[top - 2] : stack[0];
+        auto b = top >= 1 ? stack[top - 1] : 0;
+
+        switch (instr.op) {
+            case opcode::constant: stack[top++] = instr.operand; continue;
+            case opcode::hits: stack[top++] = context.hits; continue;
+            case opcode::value: stack[top++] = context.value; continue;
+            case opcode::old: stack[top++] = context.old; continue;
+            case opcode::reg: {
+                auto value = context.regs->read(g_register_infos[instr.operand]);
+                stack[top++] = std::visit([](auto v) -> std::uint64_t {
+                    if constexpr (std::is_integral_v<decltype(v)>) return static_cast<std::uint64_t>(v);
+                    else return 0;
+                }, value);
+                continue;
+            }
+            case opcode::logical_not: stack[top - 1] = !b; continue;
+            case opcode::negate: stack[top - 1] = -b; continue;
+            case opcode::bit_not: stack[top - 1] = ~b; continue;
+
+            case opcode::logical_or: a = a or b; break;
+            case opcode::logical_and: a = a and b; break;
+            case opcode::bit_or: a |= b; break;
+            case opcode::bit_xor: a ^= b; break;
+            case opcode::bit_and: a &= b; break;
+            case opcode::equal: a = a == b; break;
+            case opcode::not_equal: a = a != b; break;
+            case opcode::less: a = a < b; break;
+            case opcode::less_equal: a = a <= b; break;
+            case opcode::greater: a = a > b; break;
+            case opcode::greater_equal: a = a >= b; break;
+            case opcode::shift_left: a = b >= 64 ? 0 : a << b; break;
+            case opcode::shift_right: a = b >= 64 ? 0 : a >> b; break;
+            case opcode::add: a += b; break;
+            case opcode::subtract: a -= b; break;
+            case opcode::multiply: a *= b; break;
+            case opcode::divide: a = b == 0 ? 0 : a / b; break;
+            case opcode::modulo: a = b == 0 ? 0 : a % b; break;
+        }
+        --top;
+    }
+    return stack[0] != 0;
+}
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <elf.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/procfs.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+#include "simd.hpp"
+
+namespace {
+    constexpr std::size_t page_size = sdb::page_cache::page_size;
+
+    /* memory is streamed through a buffer this big, whatever the size of the mapping */
+    constexpr std::size_t chunk_size = 1 << 20;
+
+    static_assert(sizeof(elf_gregset_t) == sizeof(user_regs_struct));
+
+    std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    /* whole file contents, for the small /proc files copied into notes */
+    std::vector<std::byte> read_proc_file(pid_t pid, const char* name) {
+        std::ifstream file("/proc/" + std::to_string(pid) + "/" + name, std::ios::binary);
+        std::vector<char> contents(std::istreambuf_iterator<char>(file), {});
+        auto begin = reinterpret_cast<const std::byte*>(contents.data());
+        return { begin, begin + contents.size() };
+    }
+
+    /* note records are a header, the padded owner name, then the padded descriptor */
+    void add_note(std::vector<std::byte>& notes, std::uint32_t type, const void* desc, std::size_t size) {
+        static constexpr char name[] = "CORE";
+        Elf64_Nhdr header{ sizeof(name), static_cast<Elf64_Word>(size), type };
+
+        auto append = [&](const void* data, std::size_t amount) {
+            auto bytes = static_cast<const std::byte*>(data);
+            notes.insert(notes.end(), bytes, bytes + amount);
+            notes.resize(align_up(notes.size(), 4));
+        };
+        append(&header, sizeof(header));
+        append(name, sizeof(name));
+        append(desc, size);
+    }
+
+    /* pwrite until everything is out, the kernel may write less than asked */
+    void write_all(int fd, const void* data, std::size_t size, std::uint64_t offset) {
+        auto bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            auto written = pwrite(fd, bytes, size, offset);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                sdb::error::send_errno("Could not write core file");
+            }
+            bytes += written;
+            size -= written;
+            offset += written;
+        }
+    }
+
+    bool is_zero_page(const std::byte* page, std::size_t size) {
+        static const std::byte zeros[page_size] = {};
+        return sdb::simd::mismatch(page, zeros, size) == size;
+    }
+}
+
+sdb::core_file_stats sdb::Process::write_core(const std::filesystem::path& path) const {
+    if (state_ != process_state::stopped) {
+        error::send("Process must be stopped to write a core file");
+    }
+
+    core_file_stats stats;
+    auto start_time = std::chrono::steady_clock::now();
+
+    //pages software watchpoints protected are described and dumped as the program has them
+    std::vector<memory_region> regions;
+    for (auto& region : get_memory_map()) {
+        regions.push_back(unwatched_region(region));
+    }
+
+    /*** notes ***/
+    std::vector<std::byte> notes;
+
+    //one NT_PRSTATUS per thread, each followed by its NT_FPREGSET. Debuggers take the first for the
+    //thread that stopped, so the current thread goes first and its fp registers come after the process notes
+    auto add_thread_status = [&](pid_t tid) {
+        elf_prstatus status{};
+        siginfo_t info;
+        if (ptrace(PTRACE_GETSIGINFO, tid, nullptr, &info) == 0) {
+            status.pr_info.si_signo = status.pr_cursig = info.si_signo;
+            status.pr_info.si_code = info.si_code;
+        }
+        status.pr_pid = tid;
+        auto& regs = get_registers(tid);
+        regs.load_gprs();
+        std::memcpy(&status.pr_reg, &regs.data_.regs, sizeof(status.pr_reg));
+        add_note(notes, NT_PRSTATUS, &status, sizeof(status));
+    };
+    auto add_thread_fprs = [&](pid_t tid) {
+        auto& regs = get_registers(tid);
+        regs.load_fprs();
+        add_note(notes, NT_FPREGSET, &regs.data_.i387, sizeof(user_fpregs_struct));
+    };
+    add_thread_status(current_thread_);
+
+    elf_prpsinfo process_info{};
+    process_info.pr_state = 3;
+    process_info.pr_sname = 't';
+    process_info.pr_pid = pid_;
+    auto comm = read_proc_file(pid_, "comm");
+    std::transform(comm.begin(), comm.begin() + std::min(comm.size(), sizeof(process_info.pr_fname) - 1),
+                   process_info.pr_fname, [](auto b) { return b == std::byte{ '\n' } ? '\0' : char(b); });
+    auto cmdline = read_proc_file(pid_, "cmdline");
+    std::transform(cmdline.begin(), cmdline.begin() + std::min(cmdline.size(), sizeof(process_info.pr_psargs) - 1),
+                   process_info.pr_psargs, [](auto b) { return b == std::byte{ 0 } ? ' ' : char(b); });
+    add_note(notes, NT_PRPSINFO, &process_info, sizeof(process_info));
+
+    add_thread_fprs(current_thread_);
+
+    auto auxv = read_proc_file(pid_, "auxv");
+    add_note(notes, NT_AUXV, auxv.data(), auxv.size());
+
+    //NT_FILE: count, page size, (start, end, offset in pages) per mapping, then the NUL-terminated names
+    std::vector<std::uint64_t> file_entries{ 0, page_size };
+    std::string file_names;
+    for (auto& region : regions) {
+        if (region.inode == 0 or region.path.empty()) {
+            continue;
+        }
+        file_entries.insert(file_entries.end(), { region.low.addr(), region.high.addr(), region.offset / page_size });
+        file_names += region.path;
+        file_names += '\0';
+        ++file_entries[0];
+    }
+    std::vector<std::byte> file_note(file_entries.size() * sizeof(std::uint64_t) + file_names.size());
+    std::memcpy(file_note.data(), file_entries.data(), file_entries.size() * sizeof(std::uint64_t));
+    std::memcpy(file_note.data() + file_entries.size() * sizeof(std::uint64_t), file_names.data(), file_names.size());
+    add_note(notes, NT_FILE, file_note.data(), file_note.size());
+
+    for (auto& [tid, thread] : threads_) {
+        if (tid != current_thread_ and thread.state == process_state::stopped) {
+            add_thread_status(tid);
+            add_thread_fprs(tid);
+        }
+    }
+
+    /*** headers ***/
+    //more than PN_XNUM segments, the real count goes in the sh_info of a single section header
+    auto phnum = regions.size() + 1;
+    bool extended = phnum >= PN_XNUM;
+
+    Elf64_Ehdr header{};
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_NONE;
+    header.e_type = ET_CORE;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = extended ? PN_XNUM : phnum;
+
+    std::uint64_t offset = header.e_phoff + phnum * sizeof(Elf64_Phdr);
+    Elf64_Shdr section{};
+    if (extended) {
+        header.e_shoff = offset;
+        header.e_shentsize = sizeof(Elf64_Shdr);
+        header.e_shnum = 1;
+        section.sh_info = phnum;
+        offset += sizeof(Elf64_Shdr);
+    }
+
+    std::vector<Elf64_Phdr> program_headers;
+    program_headers.push_back({ PT_NOTE, 0, offset, 0, 0, notes.size(), 0, 4 });
+    offset = align_up(offset + notes.size(), page_size);
+
+    //memory of unreadable mappings is left out entirely, its segment is only there to describe the mapping
+    for (auto& region : regions) {
+        Elf64_Word flags = (region.readable ? PF_R : 0) | (region.writable ? PF_W : 0)
+                         | (region.executable ? PF_X : 0);
+        auto file_size = region.readable ? region.size() : 0;
+        program_headers.push_back({ PT_LOAD, flags, offset, region.low.addr(), 0,
+                                    file_size, region.size(), page_size });
+        offset += file_size;
+    }
+    stats.file_size = offset;
+    stats.segments = regions.size();
+
+    /*** contents ***/
+    auto fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        error::send_errno("Could not open " + path.string());
+    }
+
+    try {
+        write_all(fd, &header, sizeof(header), 0);
+        write_all(fd, program_headers.data(), program_headers.size() * sizeof(Elf64_Phdr), header.e_phoff);
+        if (extended) {
+            write_all(fd, &section, sizeof(section), header.e_shoff);
+        }
+        write_all(fd, notes.data(), notes.size(), program_headers[0].p_offset);
+
+        std::vector<std::byte> buffer(chunk_size);
+        std::vector<bool> readable(chunk_size / page_size);
+
+        for (std::size_t i = 0; i < regions.size(); ++i) {
+            auto& region = regions[i];
+            if (!region.readable) {
+                continue;
+            }
+
+            auto file_offset = program_headers[i + 1].p_offset;
+            for (std::uint64_t pos = 0; pos < region.size(); pos += chunk_size) {
+                auto size = std::min<std::uint64_t>(chunk_size, region.size() - pos);
+                auto pages = size / page_size;
+                auto address = region.low + pos;
+
+                iovec local_desc{ buffer.data(), size };
+                iovec remote_desc{ reinterpret_cast<void*>(address.addr()), size };
+                if (process_vm_readv(pid_, &local_desc, 1, &remote_desc, 1, /*flags=*/0)
+                    == static_cast<ssize_t>(size)) {
+                    std::fill(readable.begin(), readable.begin() + pages, true);
+                } else {
+                    //find which pages failed, they become holes just like zero pages
+                    std::vector<memory_read_request> requests;
+                    for (std::size_t page = 0; page < pages; ++page) {
+                        requests.push_back({ address + page * page_size, { buffer.data() + page * page_size, page_size } });
+                    }
+                    read_memory_batch({ requests.data(), requests.size() });
+                    for (std::size_t page = 0; page < pages; ++page) {
+                        readable[page] = requests[page].success;
+                    }
+                }
+
+                //the core should show the program, not our int3s or fast tracepoint jmps
+                remove_traps(address, { buffer.data(), size });
+
+                //write each run of non-zero pages with one pwrite
+                for (std::size_t page = 0; page < pages; ) {
+                    auto skip = [&](std::size_t p) {
+                        return !readable[p] or is_zero_page(buffer.data() + p * page_size, page_size);
+                    };
+                    if (skip(page)) {
+                        ++page;
+                        continue;
+                    }
+
+                    auto run_end = page + 1;
+                    while (run_end < pages and !skip(run_end)) {
+                        ++run_end;
+                    }
+
+                    auto run_size = (run_end - page) * page_size;
+                    write_all(fd, buffer.data() + page * page_size, run_size, file_offset + pos + page * page_size);
+                    stats.bytes_written += run_size;
+                    page = run_end;
+                }
+            }
+        }
+
+        //trailing holes still count towards the file size
+        if (ftruncate(fd, stats.file_size) < 0) {
+            error::send_errno("Could not size core file");
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    stats.seconds = elapsed.count();
+    return stats;
+}
@@ -1,4 +1,5 @@
 #include <libsdb/disassembler.hpp>
+#include <libsdb/error.hpp>
 #include <Zydis/Zydis.h>
 
 
@@ -42,3 +43,160 @@ std::vector<sdb::disassembler::instruction> sdb::disassembler::disassemble(std::
 
     return ret;
 }
+
+std::vector<sdb::disassembler::relocatable_instruction>
+sdb::disassembler::decode_covering(virt_addr address, std::size_t n_bytes) {
+    std::vector<relocatable_instruction> ret;
+
+    //the last instruction may start just before n_bytes and run 15 bytes past it
+    auto code = proc_->read_memory_without_traps(address, n_bytes + 15);
+
+    ZydisDecoder decoder;
+    ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+    ZydisDecodedInstruction instr;
+    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+
+    std::size_t offset = 0;
+    while (offset < n_bytes) {
+        if (!ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, code.data() + offset, code.size() - offset,
+                                                 &instr, operands))) {
+            error::send("Could not decode instruction");
+        }
+
+        relocatable_instruction decoded{ address + offset, instr.length, false, std::nullopt,
+                                         instr.meta.category == ZYDIS_CATEGORY_CALL,
+                                         instr.meta.category == ZYDIS_CATEGORY_SYSCALL
+                                         or instr.meta.category == ZYDIS_CATEGORY_INTERRUPT
+                                         or instr.meta.category == ZYDIS_CATEGORY_SYSTEM };
+        for (std::size_t i = 0; i < instr.operand_count_visible; ++i) {
+            auto& op = operands[i];
+            if (op.type == ZYDIS_OPERAND_TYPE_IMMEDIATE and op.imm.is_relative) {
+                decoded.is_relative_branch = true;
+            } else if (op.type == ZYDIS_OPERAND_TYPE_MEMORY and op.mem.base == ZYDIS_REGISTER_RIP) {
+                decoded.rip_displacement = instr.raw.disp.offset;
+            }
+        }
+        ret.push_back(decoded);
+        offset += instr.length;
+    }
+
+    return ret;
+}
+
+namespace {
+    /* Zydis numbers the 64-bit registers in encoding order */
+    constexpr sdb::register_id gprs_by_encoding[] = {
+        sdb::register_id::rax, sdb::register_id::rcx, sdb::register_id::rdx, sdb::register_id::rbx,
+        sdb::register_id::rsp, sdb::register_id::rbp, sdb::register_id::rsi, sdb::register_id::rdi,
+        sdb::register_id::r8, sdb::register_id::r9, sdb::register_id::r10, sdb::register_id::r11,
+        sdb::register_id::r12, sdb::register_id::r13, sdb::register_id::r14, sdb::register_id::r15
+    };
+
+    /* the 64-bit register holding reg, if reg is a 32 or 64-bit general purpose register */
+    std::optional<sdb::register_id> full_gpr(ZydisRegister reg) {
+        auto width = ZydisRegisterGetWidth(ZYDIS_MACHINE_MODE_LONG_64, reg);
+        if (width != 32 and width != 64) {
+            return std::nullopt;
+        }
+        auto full = ZydisRegisterGetLargestEnclosing(ZYDIS_MACHINE_MODE_LONG_64, reg);
+        if (full < ZYDIS_REGISTER_RAX or full > ZYDIS_REGISTER_R15) {
+            return std::nullopt;
+        }
+        return gprs_by_encoding[full - ZYDIS_REGISTER_RAX];
+    }
+}
+
+std::optional<sdb::emulated_instruction> sdb::disassembler::decode_emulatable(virt_addr address) {
+    auto code = proc_->read_memory_without_traps(address, 15);
+
+    ZydisDecoder decoder;
+    ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+    ZydisDecodedInstruction instr;
+    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+    if (!ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, code.data(), code.size(), &instr, operands))) {
+        return std::nullopt;
+    }
+
+    using operation = emulated_instruction::operation;
+    using kind = emulated_instruction::operand::kind;
+    emulated_instruction ret{ address, instr.length, operation::nop, instr.operand_width / 8u, {}, {} };
+
+    switch (instr.mnemonic) {
+        case ZYDIS_MNEMONIC_NOP:
+        case ZYDIS_MNEMONIC_ENDBR64:
+            return ret;
+        case ZYDIS_MNEMONIC_PUSH: ret.op = operation::push; break;
+        case ZYDIS_MNEMONIC_MOV: ret.op = operation::mov; break;
+        case ZYDIS_MNEMONIC_ADD: ret.op = operation::add; break;
+        case ZYDIS_MNEMONIC_SUB: ret.op = operation::sub; break;
+        case ZYDIS_MNEMONIC_LEA: ret.op = operation::lea; break;
+        case ZYDIS_MNEMONIC_CALL: ret.op = operation::call; break;
+        case ZYDIS_MNEMONIC_JMP: ret.op = operation::jmp; break;
+        default: return std::nullopt;
+    }
+    if (ret.size != 4 and ret.size != 8) {
+        return std::nullopt;
+    }
+    if (instr.attributes & (ZYDIS_ATTRIB_HAS_LOCK | ZYDIS_ATTRIB_HAS_REP | ZYDIS_ATTRIB_HAS_REPNE)) {
+        return std::nullopt;
+    }
+
+    //calls and jumps only when the target is in the instruction
+    if (ret.op == operation::call or ret.op == operation::jmp) {
+        ZyanU64 target;
+        if (operands[0].type != ZYDIS_OPERAND_TYPE_IMMEDIATE
+            or !ZYAN_SUCCESS(ZydisCalcAbsoluteAddress(&instr, &operands[0], address.addr(), &target))) {
+            return std::nullopt;
+        }
+        ret.source.type = kind::imm;
+        ret.source.value = static_cast<std::int64_t>(target);
+        return ret;
+    }
+
+    auto convert = [&](const ZydisDecodedOperand& op, emulated_instruction::operand& out) {
+        switch (op.type) {
+            case ZYDIS_OPERAND_TYPE_REGISTER: {
+                auto reg = full_gpr(op.reg.value);
+                if (!reg) return false;
+                out.type = kind::reg;
+                out.reg = *reg;
+                return true;
+            }
+            case ZYDIS_OPERAND_TYPE_IMMEDIATE:
+                out.type = kind::imm;
+                out.value = op.imm.value.s;
+                return true;
+            case ZYDIS_OPERAND_TYPE_MEMORY: {
+                //fs and gs bases aren't in the registers we cache
+                if (op.mem.index != ZYDIS_REGISTER_NONE or op.mem.segment == ZYDIS_REGISTER_FS
+                    or op.mem.segment == ZYDIS_REGISTER_GS) {
+                    return false;
+                }
+                out.type = kind::mem;
+                out.value = op.mem.disp.value;
+                if (op.mem.base == ZYDIS_REGISTER_RIP) {
+                    out.value += (address + instr.length).addr();
+                } else if (op.mem.base != ZYDIS_REGISTER_NONE) {
+                    auto base = full_gpr(op.mem.base);
+                    if (!base or ZydisRegisterGetWidth(ZYDIS_MACHINE_MODE_LONG_64, op.mem.base) != 64) return false;
+                    out.base = base;
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+    };
+
+    //push has a single visible operand, the rest have a destination and a source
+    if (ret.op == operation::push) {
+        return instr.operand_count_visible == 1 and convert(operands[0], ret.source)
+            ? std::optional(ret) : std::nullopt;
+    }
+    if (instr.operand_count_visible != 2 or !convert(operands[0], ret.dest) or !convert(operands[1], ret.source)) {
+        return std::nullopt;
+    }
+    return ret;
+}
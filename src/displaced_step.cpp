@@ -0,0 +1,176 @@
+#include <utility>
+#include <csignal>
+#include <sys/wait.h>
+#include <libsdb/process.hpp>
+#include <libsdb/disassembler.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/bits.hpp>
+#include "relocation.hpp"
+
+/*
+* Displaced stepping
+*
+* Stepping over a software breakpoint used to mean putting the original byte back, single-stepping and
+* writing the int3 again, three writes and a stop on every hit. Instead the instruction is copied once into
+* a slot in the scratch code pages, followed by a jmp back to the instruction after it, and the pc is moved
+* to the slot. The int3 never leaves memory, so other threads can't run past it while we step.
+*
+* Most instructions don't care where they run once rip-relative operands are adjusted, and the tracee is just
+* continued from the slot. Relative branches and calls see the pc, so they are single-stepped from the slot
+* and the pc or pushed return address is moved back to the original code afterwards. Syscalls and other
+* instructions the kernel may report the pc of are stepped in place the old way.
+*/
+
+namespace {
+    constexpr std::size_t slot_size = 32;
+    constexpr std::size_t slot_count = sdb::page_cache::page_size / slot_size;
+    static_assert(15 + sdb::relocation::absolute_jump_size <= slot_size);
+}
+
+const sdb::Process::displaced_copy* sdb::Process::get_displaced_copy(const breakpoint_site& site) {
+    //injecting the scratch mapping needs a syscall, which can't happen in the middle of another one
+    if (state_ != process_state::stopped or current_thread_state().current_syscall or scratch_code_failed_) {
+        return nullptr;
+    }
+
+    auto address = site.address();
+    if (auto it = displaced_copies_.find(address.addr()); it != displaced_copies_.end()) {
+        return it->second ? &*it->second : nullptr;
+    }
+
+    if (scratch_code_.addr() == 0) {
+        try {
+            setup_scratch_code(address);
+        } catch (const error&) {
+            scratch_code_failed_ = true;
+            return nullptr;
+        }
+    }
+
+    auto& cached = displaced_copies_[address.addr()];
+    disassembler::relocatable_instruction instruction;
+    try {
+        instruction = disassembler(*this).decode_covering(address, 1).front();
+    } catch (const error&) {
+        return nullptr;
+    }
+    if (instruction.is_system) {
+        return nullptr;
+    }
+
+    //slots are handed out in order, once they run out every copy is made again from scratch. A thread
+    //still running a copy would run whatever replaces it, every stop takes a thread out of its copy
+    if (displaced_slots_.size() == slot_count) {
+        auto paused = pause_running_threads();
+        if (state_ != process_state::stopped) {
+            return nullptr;
+        }
+        displaced_copies_.clear();
+        displaced_slots_.clear();
+        return get_displaced_copy(site);
+    }
+    auto slot = scratch_code_ + displaced_slots_.size() * slot_size;
+
+    auto original = read_memory_without_traps(address, instruction.length);
+    std::vector<std::byte> code;
+    if (!relocation::append_moved_instruction(code, original.data(), instruction, slot)) {
+        return nullptr;
+    }
+    relocation::append_absolute_jump(code, address + instruction.length);
+    write_scratch_code(slot, { code.data(), code.size() });
+
+    displaced_slots_.push_back(address);
+    cached = displaced_copy{ address, slot, instruction.length, instruction.is_relative_branch, instruction.is_call };
+    return &*cached;
+}
+
+void sdb::Process::drop_displaced_copies(virt_addr low, virt_addr high) {
+    for (auto it = displaced_copies_.begin(); it != displaced_copies_.end(); ) {
+        //an instruction is at most 15 bytes, nullopt entries only know where they start
+        auto start = virt_addr{ it->first };
+        auto length = it->second ? it->second->length : 15;
+        if (start < high and start + length > low) {
+            it = displaced_copies_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+const sdb::Process::displaced_copy* sdb::Process::displaced_copy_at(virt_addr pc) const {
+    if (scratch_code_.addr() == 0 or pc < scratch_code_ or pc >= scratch_code_ + displaced_slots_.size() * slot_size) {
+        return nullptr;
+    }
+
+    //on the copy, or on the jmp back after it
+    auto index = (pc.addr() - scratch_code_.addr()) / slot_size;
+    auto it = displaced_copies_.find(displaced_slots_[index].addr());
+    if (it == displaced_copies_.end() or !it->second or pc > it->second->slot + it->second->length) {
+        return nullptr;
+    }
+    return &*it->second;
+}
+
+bool sdb::Process::leave_displaced_copy() {
+    current_thread_state().on_displaced_copy = false;
+    auto pc = get_pc();
+    auto copy = displaced_copy_at(pc);
+    if (!copy) {
+        return false;
+    }
+    set_pc(copy->original + (pc.addr() - copy->slot.addr()));
+    return true;
+}
+
+void sdb::Process::run_out_of_displaced_copy(thread_state& thread) {
+    //continued without a step-over afterwards, so the copied instruction has to run before the pc moves back
+    auto copy = displaced_copy_at(get_pc());
+    if (copy and get_pc() == copy->slot) {
+        auto wait_status = single_step_thread(thread.tid);
+        if (!WIFSTOPPED(wait_status) or WSTOPSIG(wait_status) != SIGTRAP) {
+            //reported later as if the thread was running, decode_stop moves it back then
+            return;
+        }
+    }
+    if (leave_displaced_copy()) {
+        get_registers().flush();
+    }
+}
+
+void sdb::Process::finish_displaced_step() {
+    auto step = std::exchange(displaced_step_, std::nullopt);
+    if (scratch_code_.addr() == 0) {
+        return;
+    }
+
+    auto pc = get_pc();
+    auto on_copy = [&](const displaced_copy& copy) {
+        return pc >= copy.slot and pc <= copy.slot + copy.length;
+    };
+
+    //stopped on the copy, or on the jmp back after it
+    if (step and on_copy(*step)) {
+        set_pc(step->original + (pc.addr() - step->slot.addr()));
+        return;
+    }
+
+    if (!step) {
+        leave_displaced_copy();
+        return;
+    }
+
+    //a taken branch landed relative to the slot
+    if (step->is_relative_branch) {
+        set_pc(virt_addr{ pc.addr() + (step->original.addr() - step->slot.addr()) });
+    }
+
+    //the call pushed the address after the slot
+    if (step->is_call) {
+        auto rsp = virt_addr{ get_registers().read_by_id_as<std::uint64_t>(register_id::rsp) };
+        auto pushed = from_bytes<std::uint64_t>(read_memory(rsp, sizeof(std::uint64_t)).data());
+        if (pushed == (step->slot + step->length).addr()) {
+            auto fixed = (step->original + step->length).addr();
+            write_memory(rsp, { reinterpret_cast<const std::byte*>(&fixed), sizeof(fixed) });
+        }
+    }
+}
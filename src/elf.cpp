@@ -12,6 +12,7 @@
 #include <libsdb/elf.hpp>
 #include <cxxabi.h>
 #include <algorithm>
+#include "parallel.hpp"
 
 
 
@@ -112,15 +113,19 @@ void sdb::elf::build_section_map() {
 
 void sdb::elf::build_symbol_maps() {
     for (auto& symbol : symbol_table_) {
-        auto mangled_name = get_string(symbol.st_name);
+        auto mangled_name = get_string_view(symbol.st_name);
         int demangle_status;
         auto demangled_name = abi::__cxa_demangle(
             mangled_name.data(), nullptr, nullptr, &demangle_status);
         if (demangle_status == 0) {
-            symbol_name_map_.insert({demangled_name, &symbol});
+            //the map only holds views, the demangled string has to outlive it
+            std::string_view name = demangled_names_.emplace_back(demangled_name);
+            symbol_name_map_.insert({name, &symbol});
+            symbol_names_.push_back({name, &symbol});
             free(demangled_name);
         }
         symbol_name_map_.insert({ mangled_name, &symbol});
+        symbol_names_.push_back({ mangled_name, &symbol});
 
         /* if the symbol has an address and a name and not thread-local storage */
         if (symbol.st_value != 0 
@@ -156,6 +161,10 @@ sdb::span<const std::byte> sdb::elf::get_section_contents(std::string_view name)
 }
 
 std::string sdb::elf::get_string(std::size_t index) const {
+    return std::string(get_string_view(index));
+}
+
+std::string_view sdb::elf::get_string_view(std::size_t index) const {
     /* try getting it from .strtab */
     auto strtab = get_section(".strtab");
 
@@ -285,3 +294,34 @@ std::optional<const Elf64_Sym*> sdb::elf::get_symbol_containing_address(virt_add
     return get_symbol_containing_address(address.convert_to_file_addr(*this));
 }
 
+std::vector<const Elf64_Sym*> sdb::elf::get_functions_matching(const std::regex& pattern) const {
+    //each worker keeps its own matches and its own copy of the pattern
+    constexpr std::size_t chunk_size = 1024;
+    std::vector<std::vector<const Elf64_Sym*>> matches(parallel::worker_count(symbol_names_.size(), chunk_size));
+    std::vector<std::regex> patterns(matches.size(), pattern);
+
+    parallel::for_each_chunk(symbol_names_.size(), chunk_size, [&](auto worker, auto begin, auto end) {
+        for (auto i = begin; i < end; ++i) {
+            auto [name, symbol] = symbol_names_[i];
+            if (ELF64_ST_TYPE(symbol->st_info) != STT_FUNC or symbol->st_value == 0
+                or symbol->st_shndx == SHN_UNDEF) {
+                continue;
+            }
+            if (std::regex_search(name.begin(), name.end(), patterns[worker])) {
+                matches[worker].push_back(symbol);
+            }
+        }
+    });
+
+    //a symbol matches under both of its names, and aliases share an address
+    std::vector<const Elf64_Sym*> ret;
+    for (auto& worker_matches : matches) {
+        ret.insert(ret.end(), worker_matches.begin(), worker_matches.end());
+    }
+    std::sort(ret.begin(), ret.end(), [](auto lhs, auto rhs) {
+        return lhs->st_value != rhs->st_value ? lhs->st_value < rhs->st_value : lhs < rhs;
+    });
+    ret.erase(std::unique(ret.begin(), ret.end(), [](auto lhs, auto rhs) { return lhs->st_value == rhs->st_value; }),
+              ret.end());
+    return ret;
+}
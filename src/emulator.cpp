@@ -0,0 +1,170 @@
+#include <cstring>
+#include <libsdb/process.hpp>
+#include <libsdb/disassembler.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/bits.hpp>
+
+/*
+* Instruction emulation
+*
+* Breakpoints mostly sit on function entries, where the first instruction is an endbr64, push rbp,
+* mov rbp, rsp, sub rsp, imm or a call. Rather than single-stepping those, resume applies their effect
+* to the cached registers and to memory itself and continues straight from the next instruction.
+*
+* Anything that touches memory a watchpoint covers is left for the processor, so the watchpoint fires.
+* Memory is written with process_vm_writev, which fails where the instruction would fault.
+*/
+
+namespace {
+    using operation = sdb::emulated_instruction::operation;
+    using kind = sdb::emulated_instruction::operand::kind;
+
+    constexpr std::uint64_t carry_flag = 1 << 0;
+    constexpr std::uint64_t parity_flag = 1 << 2;
+    constexpr std::uint64_t adjust_flag = 1 << 4;
+    constexpr std::uint64_t zero_flag = 1 << 6;
+    constexpr std::uint64_t sign_flag = 1 << 7;
+    constexpr std::uint64_t overflow_flag = 1 << 11;
+    constexpr std::uint64_t arithmetic_flags =
+        carry_flag | parity_flag | adjust_flag | zero_flag | sign_flag | overflow_flag;
+
+    /* add or sub of size bytes, updating the arithmetic flags the way the processor does */
+    std::uint64_t add_or_sub(bool subtract, std::uint64_t a, std::uint64_t b, std::size_t size, std::uint64_t& flags) {
+        auto mask = size == 8 ? ~std::uint64_t(0) : (std::uint64_t(1) << (size * 8)) - 1;
+        auto sign = std::uint64_t(1) << (size * 8 - 1);
+        a &= mask;
+        b &= mask;
+        auto result = (subtract ? a - b : a + b) & mask;
+
+        flags &= ~arithmetic_flags;
+        if (subtract ? a < b : result < a) flags |= carry_flag;
+        if (__builtin_parity(result & 0xff) == 0) flags |= parity_flag;
+        if ((a ^ b ^ result) & 0x10) flags |= adjust_flag;
+        if (result == 0) flags |= zero_flag;
+        if (result & sign) flags |= sign_flag;
+        //the operands had the same sign (add) or different signs (sub) and the result sign differs from a
+        if ((subtract ? (a ^ b) & (a ^ result) : ~(a ^ b) & (a ^ result)) & sign) flags |= overflow_flag;
+        return result;
+    }
+}
+
+bool sdb::Process::emulate_instruction(virt_addr address) {
+    auto it = emulated_instructions_.find(address.addr());
+    if (it == emulated_instructions_.end()) {
+        std::optional<emulated_instruction> decoded;
+        try {
+            decoded = disassembler(*this).decode_emulatable(address);
+        } catch (const error&) {}
+        it = emulated_instructions_.emplace(address.addr(), decoded).first;
+    }
+    if (!it->second) {
+        return false;
+    }
+    auto instr = *it->second;   //a write below may drop the cache entry
+
+    auto read_register = [&](register_id id) { return get_registers().read_by_id_as<std::uint64_t>(id); };
+    auto effective_address = [&](const emulated_instruction::operand& op) {
+        return virt_addr{ (op.base ? read_register(*op.base) : 0) + op.value };
+    };
+    auto mask = instr.size == 8 ? ~std::uint64_t(0) : 0xffffffffu;
+    auto rsp = read_register(register_id::rsp);
+
+    //where the instruction writes and reads memory, if it does
+    std::optional<virt_addr> store, load;
+    std::size_t access_size = instr.size;
+    if (instr.op == operation::push or instr.op == operation::call) {
+        store = virt_addr{ rsp - 8 };
+        access_size = 8;
+        //push [mem] reads its operand before rsp moves
+        if (instr.source.type == kind::mem) load = effective_address(instr.source);
+    } else if (instr.op != operation::nop and instr.op != operation::jmp and instr.op != operation::lea) {
+        if (instr.dest.type == kind::mem) {
+            store = effective_address(instr.dest);
+            if (instr.op != operation::mov) load = store;
+        }
+        if (instr.source.type == kind::mem) {
+            load = effective_address(instr.source);
+        }
+    }
+
+    //a watchpoint has to see the access happen
+    bool watched = false;
+    watchpoints_.for_each([&](auto& wp) {
+        for (auto access : { store, load }) {
+            if (wp.is_enabled() and access and *access < wp.address() + wp.size() and *access + access_size > wp.address()) {
+                watched = true;
+            }
+        }
+    });
+    if (watched) {
+        return false;
+    }
+
+    //everything that can fail happens before any register changes
+    std::uint64_t loaded = 0;
+    if (load) {
+        try {
+            auto data = read_memory(*load, access_size);
+            std::memcpy(&loaded, data.data(), access_size);
+        } catch (const error&) {
+            return false;
+        }
+    }
+
+    auto value_of = [&](const emulated_instruction::operand& op) -> std::uint64_t {
+        switch (op.type) {
+            case kind::reg: return read_register(op.reg);
+            case kind::imm: return static_cast<std::uint64_t>(op.value);
+            case kind::mem: return loaded;
+            default: return 0;
+        }
+    };
+
+    auto next = (address + instr.length).addr();
+    std::uint64_t result = 0;
+    std::optional<std::uint64_t> flags;
+    switch (instr.op) {
+        case operation::nop:
+        case operation::jmp:
+            break;
+        case operation::push:
+            result = value_of(instr.source);
+            break;
+        case operation::call:
+            result = next;
+            break;
+        case operation::mov:
+            result = value_of(instr.source) & mask;
+            break;
+        case operation::lea:
+            result = effective_address(instr.source).addr() & mask;
+            break;
+        case operation::add:
+        case operation::sub:
+            flags = read_register(register_id::eflags);
+            result = add_or_sub(instr.op == operation::sub, value_of(instr.dest), value_of(instr.source), instr.size, *flags);
+            break;
+    }
+
+    if (store) {
+        try {
+            write_memory(*store, { as_bytes(result), access_size }, memory_write_path::vm_writev);
+        } catch (const error&) {
+            return false;
+        }
+    }
+
+    //32-bit results zero the upper half of the register
+    if (instr.op == operation::push or instr.op == operation::call) {
+        get_registers().write_by_id(register_id::rsp, rsp - 8);
+    } else if (!store and instr.dest.type == kind::reg) {
+        get_registers().write_by_id(instr.dest.reg, result);
+    }
+    if (flags) {
+        get_registers().write_by_id(register_id::eflags, *flags);
+    }
+
+    auto jumps = instr.op == operation::call or instr.op == operation::jmp;
+    set_pc(virt_addr{ jumps ? static_cast<std::uint64_t>(instr.source.value) : next });
+    return true;
+}
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <libsdb/event_loop.hpp>
+#include <libsdb/error.hpp>
+
+namespace {
+    /* PIDFD_THREAD, a pidfd for one thread that is readable once that thread exits. Linux 6.9 */
+    constexpr unsigned pidfd_thread = O_EXCL;
+
+    int pidfd_open(pid_t pid, unsigned flags) {
+        return static_cast<int>(syscall(SYS_pidfd_open, pid, flags));
+    }
+
+    /* a process with a thread that can still report something */
+    bool can_stop(const sdb::Process& process) {
+        return process.get_state() == sdb::process_state::running or
+               (process.is_non_stop() and process.get_state() == sdb::process_state::stopped);
+    }
+
+    bool has_ended(const sdb::Process& process) {
+        return process.get_state() == sdb::process_state::exited or
+               process.get_state() == sdb::process_state::terminated;
+    }
+}
+
+sdb::event_loop::event_loop() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &old_mask_) < 0) {
+        error::send_errno("Could not block signals");
+    }
+
+    signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd_ < 0 or epoll_fd_ < 0) {
+        auto saved_errno = errno;
+        if (signal_fd_ >= 0) close(signal_fd_);
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+        sigprocmask(SIG_SETMASK, &old_mask_, nullptr);
+        errno = saved_errno;
+        error::send_errno("Could not create the event loop");
+    }
+
+    add_fd(signal_fd_, [this] { read_signals(); });
+}
+
+sdb::event_loop::~event_loop() {
+    for (auto& watched : watched_) {
+        close_pidfds(*watched);
+    }
+    close(epoll_fd_);
+
+    //a Ctrl-C still pending would kill us once unblocked
+    signalfd_siginfo info;
+    while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {}
+    close(signal_fd_);
+    sigprocmask(SIG_SETMASK, &old_mask_, nullptr);
+}
+
+void sdb::event_loop::add_fd(int fd, std::function<void()> on_ready) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        error::send_errno("Could not watch file descriptor");
+    }
+    fd_handlers_[fd] = std::move(on_ready);
+}
+
+void sdb::event_loop::remove_fd(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    fd_handlers_.erase(fd);
+}
+
+sdb::event_loop::watched_process* sdb::event_loop::find(Process& process) {
+    auto it = std::find_if(watched_.begin(), watched_.end(), [&](auto& watched) { return watched->process == &process; });
+    return it == watched_.end() ? nullptr : it->get();
+}
+
+void sdb::event_loop::watch(Process& process, stop_handler on_stop) {
+    if (auto watched = find(process)) {
+        watched->on_stop = std::move(on_stop);
+        return;
+    }
+    watched_.push_back(std::unique_ptr<watched_process>(new watched_process{ &process, std::move(on_stop), {} }));
+    sync_pidfds(*watched_.back());
+}
+
+void sdb::event_loop::unwatch(Process& process) {
+    auto it = std::find_if(watched_.begin(), watched_.end(), [&](auto& watched) { return watched->process == &process; });
+    if (it != watched_.end()) {
+        close_pidfds(**it);
+        watched_.erase(it);
+    }
+}
+
+void sdb::event_loop::interrupt(Process& process) {
+    auto watched = find(process);
+    if (!watched or !watched->pidfds.count(process.get_pid())) {
+        error::send("Process is not watched");
+    }
+    process.expect_interrupt();
+    if (syscall(SYS_pidfd_send_signal, watched->pidfds.at(process.get_pid()), SIGSTOP, nullptr, 0) < 0) {
+        error::send_errno("Could not interrupt the process");
+    }
+}
+
+void sdb::event_loop::poll(Process& process) {
+    if (auto watched = find(process)) {
+        poll(*watched);
+    }
+}
+
+void sdb::event_loop::poll(watched_process& watched, bool thread_gone) {
+    auto& process = *watched.process;
+    //a process killed while we think it is stopped still has its exit to reap, until then its pidfd
+    //stays readable and run_once never waits
+    while (can_stop(process) or (thread_gone and !has_ended(process))) {
+        auto reason = process.poll_stop();
+        if (!reason) {
+            break;
+        }
+        sync_pidfds(watched);
+
+        //the handler may resume the process, or stop watching it
+        auto on_stop = watched.on_stop;
+        on_stop(process, *reason);
+        if (!find(process)) {
+            return;
+        }
+    }
+    sync_pidfds(watched);
+}
+
+void sdb::event_loop::read_signals() {
+    bool child = false;
+    bool interrupted = false;
+    signalfd_siginfo info;
+    while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+        child |= info.ssi_signo == SIGCHLD;
+        interrupted |= info.ssi_signo == SIGINT;
+    }
+
+    if (interrupted and on_interrupt_) {
+        on_interrupt_();
+    }
+    //SIGCHLDs coalesce and don't say whose, every process that could have stopped is looked at
+    if (child) {
+        std::vector<Process*> processes;
+        for (auto& watched : watched_) {
+            processes.push_back(watched->process);
+        }
+        for (auto process : processes) {
+            poll(*process);
+        }
+    }
+}
+
+void sdb::event_loop::sync_pidfds(watched_process& watched) {
+    auto& process = *watched.process;
+    if (has_ended(process)) {
+        close_pidfds(watched);
+        return;
+    }
+
+    auto& threads = process.threads();
+    for (auto it = watched.pidfds.begin(); it != watched.pidfds.end(); ) {
+        if (threads.count(it->first)) {
+            ++it;
+            continue;
+        }
+        remove_fd(it->second);
+        close(it->second);
+        it = watched.pidfds.erase(it);
+    }
+
+    for (auto& [tid, thread] : threads) {
+        if (watched.pidfds.count(tid)) {
+            continue;
+        }
+        //the leader's pidfd is for the whole process, it only becomes readable once every thread is gone.
+        //Kernels without thread pidfds still wake us with SIGCHLD
+        auto fd = pidfd_open(tid, tid == process.get_pid() ? 0 : pidfd_thread);
+        if (fd < 0) {
+            continue;
+        }
+        auto target = &process;
+        add_fd(fd, [this, target] {
+            if (auto watched = find(*target)) {
+                poll(*watched, /*thread_gone=*/true);
+            }
+        });
+        watched.pidfds[tid] = fd;
+    }
+}
+
+void sdb::event_loop::close_pidfds(watched_process& watched) {
+    for (auto& [tid, fd] : watched.pidfds) {
+        remove_fd(fd);
+        close(fd);
+    }
+    watched.pidfds.clear();
+}
+
+bool sdb::event_loop::run_once(int timeout_ms) {
+    epoll_event events[16];
+    auto count = epoll_wait(epoll_fd_, events, 16, timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        error::send_errno("epoll_wait failed");
+    }
+
+    for (auto i = 0; i < count; ++i) {
+        //an earlier handler may have removed it
+        auto it = fd_handlers_.find(events[i].data.fd);
+        if (it != fd_handlers_.end()) {
+            auto handler = it->second;
+            handler();
+        }
+    }
+    return count > 0;
+}
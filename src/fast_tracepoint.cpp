@@ -0,0 +1,401 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#include <libsdb/process.hpp>
+#include <libsdb/disassembler.hpp>
+#include <libsdb/error.hpp>
+#include "relocation.hpp"
+
+/*
+* Fast tracepoints
+*
+* The tracee gets two mappings, both made by syscalls injected at its pc:
+*   - the scratch code pages, within jmp range of the first fast tracepoint, holding one trampoline per tracepoint
+*   - a memfd mapped shared, which we map as well, holding a header and a ring of fixed size records
+*
+* A trampoline steps over the red zone, saves the flags and its scratch registers, claims a slot with
+* lock cmpxchg (or counts a drop if the ring is full), fills in the record, publishes it by writing its
+* sequence number last, restores everything, runs the instructions the jmp replaced and jumps back
+*/
+
+namespace {
+    constexpr std::size_t jmp_size = 5;
+
+    using atomic_u64 = std::atomic<std::uint64_t>;
+    static_assert(atomic_u64::is_always_lock_free and sizeof(atomic_u64) == sizeof(std::uint64_t));
+
+    struct fast_trace_header {
+        atomic_u64 head;            /* records claimed by the tracee */
+        atomic_u64 tail;            /* records consumed by us */
+        std::uint64_t capacity;     /* in records, a power of two */
+        std::uint64_t mask;
+        atomic_u64 dropped;         /* hits that found the ring full */
+        std::uint64_t padding[3];
+    };
+    static_assert(sizeof(fast_trace_header) == 64);
+
+    struct fast_trace_record {
+        atomic_u64 sequence;        /* slot number plus one, written last */
+        std::uint64_t tsc;
+        std::uint64_t id;
+        std::uint64_t rflags;
+        std::uint64_t gprs[16];     /* in DWARF order, rax rdx rcx rbx rsi rdi rbp rsp r8-r15 */
+    };
+    static_assert(sizeof(fast_trace_record) == 160);
+
+    constexpr std::size_t record_capacity = 1 << 14;
+    constexpr std::size_t shared_size = sizeof(fast_trace_header) + record_capacity * sizeof(fast_trace_record);
+
+    /* what a fast tracepoint records, in the order the trace buffer holds it */
+    std::vector<sdb::register_id> fast_trace_registers() {
+        using sdb::register_id;
+        return { register_id::rax, register_id::rdx, register_id::rcx, register_id::rbx,
+                 register_id::rsi, register_id::rdi, register_id::rbp, register_id::rsp,
+                 register_id::r8, register_id::r9, register_id::r10, register_id::r11,
+                 register_id::r12, register_id::r13, register_id::r14, register_id::r15,
+                 register_id::eflags, register_id::rip };
+    }
+
+    std::uint64_t steady_clock_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /* machine code built up a piece at a time */
+    class code_buffer {
+        public:
+            void emit(std::initializer_list<std::uint8_t> bytes) {
+                for (auto byte : bytes) {
+                    code_.push_back(std::byte{ byte });
+                }
+            }
+
+            template <typename T>
+            void emit_value(T value) {
+                auto bytes = reinterpret_cast<const std::byte*>(&value);
+                code_.insert(code_.end(), bytes, bytes + sizeof(T));
+            }
+
+            /* short jump whose target is bound later */
+            std::size_t emit_jump8(std::uint8_t opcode) {
+                emit({ opcode, 0 });
+                return code_.size();
+            }
+
+            void bind_jump8(std::size_t jump_end) {
+                code_[jump_end - 1] = std::byte(code_.size() - jump_end);
+            }
+
+            /* short jump back to an earlier position */
+            void emit_jump8_to(std::uint8_t opcode, std::size_t target) {
+                emit({ opcode, static_cast<std::uint8_t>(target - (code_.size() + 2)) });
+            }
+
+            std::size_t size() const { return code_.size(); }
+            const std::vector<std::byte>& bytes() const { return code_; }
+
+        private:
+            std::vector<std::byte> code_;
+    };
+
+    /*
+    * Trampoline for one tracepoint. Stack on entry to the record code, after skipping the 128 byte red zone:
+    *   rsp+0 sequence, +8 rbx, +16 rdx, +24 rcx, +32 rax, +40 rflags, +176 the rsp of the traced code
+    */
+    code_buffer build_trampoline(std::uint64_t header_address, std::int32_t id) {
+        code_buffer code;
+        code.emit({ 0x48, 0x8d, 0x64, 0x24, 0x80 });    // lea rsp, [rsp-128]
+        code.emit({ 0x9c, 0x50, 0x51, 0x52, 0x53 });    // pushfq; push rax; push rcx; push rdx; push rbx
+        code.emit({ 0x48, 0xbb });                      // movabs rbx, header
+        code.emit_value(header_address);
+
+        //claim a slot, head - tail >= capacity means the ring is full
+        auto retry = code.size();
+        code.emit({ 0x48, 0x8b, 0x03 });                // mov rax, [rbx]
+        code.emit({ 0x48, 0x89, 0xc1 });                // mov rcx, rax
+        code.emit({ 0x48, 0x2b, 0x4b, 0x08 });          // sub rcx, [rbx+8]
+        code.emit({ 0x48, 0x3b, 0x4b, 0x10 });          // cmp rcx, [rbx+16]
+        auto full = code.emit_jump8(0x73);              // jae full
+        code.emit({ 0x48, 0x8d, 0x48, 0x01 });          // lea rcx, [rax+1]
+        code.emit({ 0xf0, 0x48, 0x0f, 0xb1, 0x0b });    // lock cmpxchg [rbx], rcx
+        code.emit_jump8_to(0x75, retry);                // jne retry
+
+        //rcx = header + 64 + (slot & mask) * 160
+        code.emit({ 0x48, 0x89, 0xc1 });                // mov rcx, rax
+        code.emit({ 0x48, 0x23, 0x4b, 0x18 });          // and rcx, [rbx+24]
+        code.emit({ 0x48, 0x69, 0xc9 });                // imul rcx, rcx, 160
+        code.emit_value<std::int32_t>(sizeof(fast_trace_record));
+        code.emit({ 0x48, 0x8d, 0x4c, 0x0b, 0x40 });    // lea rcx, [rbx+rcx+64]
+        code.emit({ 0x48, 0xff, 0xc0, 0x50 });          // inc rax; push rax
+
+        code.emit({ 0x0f, 0x31 });                      // rdtsc
+        code.emit({ 0x48, 0xc1, 0xe2, 0x20 });          // shl rdx, 32
+        code.emit({ 0x48, 0x09, 0xd0 });                // or rax, rdx
+        code.emit({ 0x48, 0x89, 0x41, 0x08 });          // mov [rcx+8], rax
+        code.emit({ 0x48, 0xc7, 0x41, 0x10 });          // mov qword [rcx+16], id
+        code.emit_value(id);
+
+        //saved registers go through rax: rflags, rax, rdx, rcx, rbx
+        static constexpr std::pair<std::uint8_t, std::uint8_t> saved[] = { { 40, 24 }, { 32, 32 }, { 16, 40 },
+                                                                          { 24, 48 }, { 8, 56 } };
+        for (auto [stack, record] : saved) {
+            code.emit({ 0x48, 0x8b, 0x44, 0x24, stack });   // mov rax, [rsp+stack]
+            code.emit({ 0x48, 0x89, 0x41, record });        // mov [rcx+record], rax
+        }
+        code.emit({ 0x48, 0x89, 0x71, 0x40 });          // mov [rcx+64], rsi
+        code.emit({ 0x48, 0x89, 0x79, 0x48 });          // mov [rcx+72], rdi
+        code.emit({ 0x48, 0x89, 0x69, 0x50 });          // mov [rcx+80], rbp
+        code.emit({ 0x48, 0x8d, 0x84, 0x24 });          // lea rax, [rsp+176]
+        code.emit_value<std::int32_t>(176);
+        code.emit({ 0x48, 0x89, 0x41, 0x58 });          // mov [rcx+88], rax
+        code.emit({ 0x4c, 0x89, 0x41, 0x60 });          // mov [rcx+96], r8
+        code.emit({ 0x4c, 0x89, 0x49, 0x68 });          // mov [rcx+104], r9
+        code.emit({ 0x4c, 0x89, 0x51, 0x70 });          // mov [rcx+112], r10
+        code.emit({ 0x4c, 0x89, 0x59, 0x78 });          // mov [rcx+120], r11
+        std::uint8_t modrm = 0xa1;                      // mov [rcx+disp32], r12-r15
+        for (std::int32_t offset = 128; offset < 160; offset += 8, modrm += 8) {
+            code.emit({ 0x4c, 0x89, modrm });
+            code.emit_value(offset);
+        }
+
+        //x86 doesn't reorder stores, the sequence number lands after the rest of the record
+        code.emit({ 0x58 });                            // pop rax
+        code.emit({ 0x48, 0x89, 0x01 });                // mov [rcx], rax
+        auto done = code.emit_jump8(0xeb);              // jmp done
+
+        code.bind_jump8(full);
+        code.emit({ 0xf0, 0x48, 0xff, 0x43, 0x20 });    // lock inc qword [rbx+32]
+
+        code.bind_jump8(done);
+        code.emit({ 0x5b, 0x5a, 0x59, 0x58, 0x9d });    // pop rbx; pop rdx; pop rcx; pop rax; popfq
+        code.emit({ 0x48, 0x8d, 0xa4, 0x24 });          // lea rsp, [rsp+128]
+        code.emit_value<std::int32_t>(128);
+        return code;
+    }
+}
+
+void sdb::tracepoint::write_code(bool jump) {
+    //non-stop, threads left running could execute the bytes half written and can't be checked below
+    auto paused = process_->pause_running_threads();
+
+    if (!jump) {
+        process_->write_memory(address_, { original_code_.data(), original_code_.size() },
+                               memory_write_path::proc_mem);
+        return;
+    }
+
+    //resuming in the middle of the jmp would run garbage. A thread on a displaced copy comes back after the
+    //copied instruction, which may be in the middle as well
+    for (auto& [tid, thread] : process_->threads()) {
+        if (thread.state != process_state::stopped) {
+            continue;
+        }
+        auto pc = virt_addr{ thread.regs->read_by_id_as<std::uint64_t>(register_id::rip) };
+        if (auto copy = process_->displaced_copy_at(pc)) {
+            pc = copy->original + copy->length;
+        }
+        if (pc > address_ and pc < address_ + original_code_.size()) {
+            error::send("Thread " + std::to_string(tid) + " is stopped inside the code a fast tracepoint replaces");
+        }
+    }
+
+    //anything left over after the jmp traps if something jumps to it
+    std::vector<std::byte> patch(original_code_.size(), std::byte{ 0xcc });
+    patch[0] = std::byte{ 0xe9 };
+    std::int32_t offset = trampoline_.addr() - (address_.addr() + jmp_size);
+    std::memcpy(patch.data() + 1, &offset, sizeof(offset));
+    process_->write_memory(address_, { patch.data(), patch.size() }, memory_write_path::proc_mem);
+}
+
+void sdb::Process::setup_fast_trace() {
+    //memory we map into the tracee is unmapped again if anything goes wrong
+    std::int64_t fd = -1, shared = -1;
+    void* mapped = MAP_FAILED;
+    auto undo = [&] {
+        if (shared >= 0) inject_syscall(SYS_munmap, { std::uint64_t(shared), shared_size });
+        if (fd >= 0) inject_syscall(SYS_close, { std::uint64_t(fd) });
+    };
+
+    try {
+        //memfd_create wants its name in tracee memory
+        static constexpr char name[] = "sdb-fast-trace";
+        auto name_address = allocate_scratch_code({ reinterpret_cast<const std::byte*>(name), sizeof(name) });
+        fd = inject_syscall(SYS_memfd_create, { name_address.addr(), MFD_CLOEXEC });
+        if (fd < 0 or inject_syscall(SYS_ftruncate, { std::uint64_t(fd), shared_size }) < 0) {
+            error::send("Could not create fast tracepoint buffer in the process");
+        }
+        shared = inject_syscall(SYS_mmap, { 0, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                            std::uint64_t(fd), 0 });
+        if (shared < 0) {
+            shared = -1;
+            error::send("Could not map fast tracepoint buffer into the process");
+        }
+
+        //the same pages on our side, through the tracee's descriptor
+        auto path = "/proc/" + std::to_string(pid_) + "/fd/" + std::to_string(fd);
+        auto our_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (our_fd < 0) {
+            error::send_errno("Could not open " + path);
+        }
+
+        //the mappings keep the memfd alive, the program shouldn't see an extra descriptor
+        inject_syscall(SYS_close, { std::uint64_t(fd) });
+        fd = -1;
+
+        mapped = mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED, our_fd, 0);
+        close(our_fd);
+        if (mapped == MAP_FAILED) {
+            error::send_errno("Could not map fast tracepoint buffer");
+        }
+    } catch (...) {
+        try {
+            undo();
+        } catch (...) {}
+        throw;
+    }
+
+    fast_trace_shared_ = static_cast<std::byte*>(mapped);
+    fast_trace_shared_size_ = shared_size;
+    auto header = new (fast_trace_shared_) fast_trace_header{};
+    header->capacity = record_capacity;
+    header->mask = record_capacity - 1;
+
+    fast_trace_shared_address_ = virt_addr{ static_cast<std::uint64_t>(shared) };
+    fast_trace_base_tsc_ = __rdtsc();
+    fast_trace_base_ns_ = steady_clock_ns();
+}
+
+sdb::tracepoint& sdb::Process::create_fast_tracepoint(virt_addr address) {
+    if (state_ != process_state::stopped) {
+        error::send("Process must be stopped to create a fast tracepoint");
+    }
+
+    auto instructions = disassembler(*this).decode_covering(address, jmp_size);
+    auto patch_end = instructions.back().address + instructions.back().length;
+    auto patch_size = patch_end.addr() - address.addr();
+
+    //nothing else may patch the bytes the jmp covers
+    if (!breakpoint_sites_.get_in_region(address, patch_end).empty()) {
+        error::send("Fast tracepoint would overwrite a breakpoint");
+    }
+    for (auto tp : tracepoints_.get_in_region(address - 15, patch_end)) {
+        if (tp->address() + std::max<std::size_t>(tp->patch_size(), 1) > address) {
+            error::send("Fast tracepoint would overwrite another tracepoint");
+        }
+    }
+    for (auto& instruction : instructions) {
+        if (instruction.is_relative_branch) {
+            error::send("Cannot move the relative branch at " + std::to_string(instruction.address.addr())
+                        + " out of the way of a fast tracepoint");
+        }
+    }
+
+    if (scratch_code_.addr() == 0) {
+        setup_scratch_code(address);
+    }
+    if (!fast_trace_shared_) {
+        setup_fast_trace();
+    }
+
+    auto trampoline_address = scratch_code_ + scratch_code_used_;
+    if (!relocation::fits_in_int32(trampoline_address.addr() - (address.addr() + jmp_size))) {
+        error::send("Fast tracepoint is too far from the trampolines");
+    }
+
+    auto original = read_memory_without_traps(address, patch_size);
+    auto tp = std::unique_ptr<tracepoint>(
+        new tracepoint(*this, address, fast_trace_registers(), original, trampoline_address));
+
+    auto code = build_trampoline(fast_trace_shared_address_.addr(), tp->id());
+
+    //the displaced instructions run from the trampoline, rip-relative operands are adjusted to match
+    std::vector<std::byte> bytes = code.bytes();
+    for (auto& instruction : instructions) {
+        auto offset = instruction.address.addr() - address.addr();
+        if (!relocation::append_moved_instruction(bytes, original.data() + offset, instruction,
+                                                  trampoline_address + bytes.size())) {
+            error::send("Cannot move rip-relative instruction for a fast tracepoint");
+        }
+    }
+    relocation::append_absolute_jump(bytes, patch_end);
+
+    if (!trace_buffer_) {
+        trace_buffer_ = std::make_unique<trace_buffer>(trace_buffer_size);
+    }
+
+    //a thread in the way keeps it from being added at all
+    allocate_scratch_code({ bytes.data(), bytes.size() });
+    tp->enable();
+    return tracepoints_.push(std::move(tp));
+}
+
+std::size_t sdb::Process::collect_fast_trace() {
+    if (!fast_trace_shared_) {
+        return 0;
+    }
+
+    auto header = reinterpret_cast<fast_trace_header*>(fast_trace_shared_);
+    auto records = reinterpret_cast<fast_trace_record*>(fast_trace_shared_ + sizeof(fast_trace_header));
+
+    //map timestamp counter readings onto the steady clock between setup and now
+    auto now_tsc = __rdtsc();
+    auto now_ns = steady_clock_ns();
+    long double ns_per_tick = now_tsc > fast_trace_base_tsc_
+        ? static_cast<long double>(now_ns - fast_trace_base_ns_) / (now_tsc - fast_trace_base_tsc_) : 0;
+
+    std::size_t count = 0;
+    auto head = header->head.load(std::memory_order_acquire);
+    for (auto tail = header->tail.load(std::memory_order_relaxed); tail != head; ++tail) {
+        //a slot can be claimed before its record is written
+        auto& shared_record = records[tail & header->mask];
+        if (shared_record.sequence.load(std::memory_order_acquire) != tail + 1) {
+            break;
+        }
+
+        fast_trace_record record;
+        std::memcpy(static_cast<void*>(&record), &shared_record, sizeof(record));
+        header->tail.store(tail + 1, std::memory_order_release);
+
+        auto id = static_cast<tracepoint::id_type>(record.id);
+        if (!tracepoints_.contains_id(id)) {
+            continue;
+        }
+        auto& tp = tracepoints_.get_by_id(id);
+
+        std::uint64_t hit = ++tp.hits_;
+        std::uint64_t time = fast_trace_base_ns_ + static_cast<std::uint64_t>(
+            (record.tsc - fast_trace_base_tsc_) * ns_per_tick);
+        auto rip = tp.address().addr();
+
+        //same layout as a regular tracepoint recording fast_trace_registers()
+        trace_record_.resize(tp.record_size());
+        auto out = trace_record_.data();
+        auto append = [&](const void* data, std::size_t size) {
+            std::memcpy(out, data, size);
+            out += size;
+        };
+        append(&id, sizeof(id));
+        append(&hit, sizeof(hit));
+        append(&time, sizeof(time));
+        append(record.gprs, sizeof(record.gprs));
+        append(&record.rflags, sizeof(record.rflags));
+        append(&rip, sizeof(rip));
+
+        trace_buffer_->push({ trace_record_.data(), trace_record_.size() });
+        ++count;
+    }
+    return count;
+}
+
+std::uint64_t sdb::Process::fast_trace_dropped() const {
+    if (!fast_trace_shared_) {
+        return 0;
+    }
+    return reinterpret_cast<const fast_trace_header*>(fast_trace_shared_)->dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+#ifndef SDB_PARALLEL_HPP
+#define SDB_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sdb::parallel {
+    /*
+    * Call f(worker, begin, end) over [0, count) in chunks, from a pool of up to one thread per core
+    * Workers pull the next chunk when they finish one, so uneven chunks even out
+    * worker is in [0, worker_count(count, chunk_size)) and lets callers keep per-thread results without locking
+    * The first exception thrown by f is rethrown once every worker has stopped
+    */
+    inline std::size_t worker_count(std::size_t count, std::size_t chunk_size) {
+        auto chunks = (count + chunk_size - 1) / chunk_size;
+        std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+        return std::max<std::size_t>(1, std::min(cores, chunks));
+    }
+
+    template <typename F>
+    void for_each_chunk(std::size_t count, std::size_t chunk_size, F f) {
+        auto workers = worker_count(count, chunk_size);
+        std::atomic<std::size_t> next{ 0 };
+        std::exception_ptr failure;
+        std::mutex failure_mutex;
+
+        auto work = [&](std::size_t worker) {
+            try {
+                for (;;) {
+                    auto begin = next.fetch_add(chunk_size, std::memory_order_relaxed);
+                    if (begin >= count) {
+                        return;
+                    }
+                    f(worker, begin, std::min(count, begin + chunk_size));
+                }
+            } catch (...) {
+                std::lock_guard lock(failure_mutex);
+                if (!failure) failure = std::current_exception();
+                next = count;
+            }
+        };
+
+        //the calling thread is one of the workers
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < workers; ++i) {
+            threads.emplace_back(work, i);
+        }
+        work(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+}
+
+#endif
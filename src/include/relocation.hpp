@@ -0,0 +1,60 @@
+#ifndef SDB_RELOCATION_HPP
+#define SDB_RELOCATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <libsdb/disassembler.hpp>
+
+/***********************************
+* Helpers for running instructions somewhere other than where the program put them,
+* shared by fast tracepoint trampolines and displaced stepping
+************************************/
+
+namespace sdb::relocation {
+
+    inline bool fits_in_int32(std::int64_t value) {
+        return value >= std::numeric_limits<std::int32_t>::min() and value <= std::numeric_limits<std::int32_t>::max();
+    }
+
+    /*
+    * Append the bytes of an instruction that will run from new_address, adjusting a rip-relative
+    * displacement so it still reaches the same memory
+    * Returns false if the displacement no longer fits
+    */
+    inline bool append_moved_instruction(std::vector<std::byte>& code, const std::byte* bytes,
+                                         const disassembler::relocatable_instruction& instruction,
+                                         virt_addr new_address) {
+        auto start = code.size();
+        code.insert(code.end(), bytes, bytes + instruction.length);
+        if (!instruction.rip_displacement) {
+            return true;
+        }
+
+        auto displacement_at = code.data() + start + *instruction.rip_displacement;
+        std::int32_t displacement;
+        std::memcpy(&displacement, displacement_at, sizeof(displacement));
+        std::int64_t moved = displacement + std::int64_t(instruction.address.addr() - new_address.addr());
+        if (!fits_in_int32(moved)) {
+            return false;
+        }
+        displacement = moved;
+        std::memcpy(displacement_at, &displacement, sizeof(displacement));
+        return true;
+    }
+
+    /* jmp [rip+0] followed by the absolute target, reaches anywhere */
+    constexpr std::size_t absolute_jump_size = 14;
+
+    inline void append_absolute_jump(std::vector<std::byte>& code, virt_addr target) {
+        static constexpr std::uint8_t jmp[] = { 0xff, 0x25, 0x00, 0x00, 0x00, 0x00 };
+        auto address = target.addr();
+        auto address_bytes = reinterpret_cast<const std::byte*>(&address);
+        code.insert(code.end(), reinterpret_cast<const std::byte*>(jmp), reinterpret_cast<const std::byte*>(jmp) + sizeof(jmp));
+        code.insert(code.end(), address_bytes, address_bytes + sizeof(address));
+    }
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef SDB_SIMD_HPP
+#define SDB_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/***********************************
+* Vectorized byte kernels shared by memory search and snapshot diffing.
+* AVX2 versions are picked at runtime, SSE2 is always present on x86-64
+************************************/
+
+namespace sdb::simd {
+
+    inline bool has_avx2() {
+#if defined(__x86_64__)
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    /* name of the kernel set in use, for reporting */
+    inline const char* kernel_name() {
+#if defined(__x86_64__)
+        return has_avx2() ? "avx2" : "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    /* byte-at-a-time fallback, also finishes the tail the vector loops leave behind */
+    inline void find_all_scalar(const std::byte* haystack, std::size_t size,
+                                const std::byte* needle, std::size_t needle_size,
+                                std::size_t from, std::vector<std::size_t>& out) {
+        for (auto i = from; i + needle_size <= size; ++i) {
+            if (std::memcmp(haystack + i, needle, needle_size) == 0) {
+                out.push_back(i);
+            }
+        }
+    }
+
+#if defined(__x86_64__)
+    inline void find_all_sse2(const std::byte* haystack, std::size_t size,
+                              const std::byte* needle, std::size_t needle_size,
+                              std::vector<std::size_t>& out) {
+        auto first = _mm_set1_epi8(static_cast<char>(needle[0]));
+        auto last = _mm_set1_epi8(static_cast<char>(needle[needle_size - 1]));
+
+        std::size_t i = 0;
+        for (; i + needle_size - 1 + 16 <= size; i += 16) {
+            auto block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+            auto block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needle_size - 1));
+            auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))));
+
+            while (mask) {
+                auto bit = __builtin_ctz(mask);
+                if (std::memcmp(haystack + i + bit, needle, needle_size) == 0) {
+                    out.push_back(i + bit);
+                }
+                mask &= mask - 1;
+            }
+        }
+        find_all_scalar(haystack, size, needle, needle_size, i, out);
+    }
+
+    __attribute__((target("avx2")))
+    inline void find_all_avx2(const std::byte* haystack, std::size_t size,
+                              const std::byte* needle, std::size_t needle_size,
+                              std::vector<std::size_t>& out) {
+        auto first = _mm256_set1_epi8(static_cast<char>(needle[0]));
+        auto last = _mm256_set1_epi8(static_cast<char>(needle[needle_size - 1]));
+
+        std::size_t i = 0;
+        for (; i + needle_size - 1 + 32 <= size; i += 32) {
+            auto block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+            auto block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + needle_size - 1));
+            auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last))));
+
+            while (mask) {
+                auto bit = __builtin_ctz(mask);
+                if (std::memcmp(haystack + i + bit, needle, needle_size) == 0) {
+                    out.push_back(i + bit);
+                }
+                mask &= mask - 1;
+            }
+        }
+        find_all_scalar(haystack, size, needle, needle_size, i, out);
+    }
+#endif
+
+    /*
+    * Offsets of every occurrence of needle in haystack, appended to out
+    * Candidates are filtered by comparing the first and last needle bytes a whole vector at a time,
+    * only positions where both match get a full memcmp
+    */
+    inline void find_all(const std::byte* haystack, std::size_t size,
+                         const std::byte* needle, std::size_t needle_size,
+                         std::vector<std::size_t>& out) {
+        if (needle_size == 0 or needle_size > size) {
+            return;
+        }
+#if defined(__x86_64__)
+        if (has_avx2()) {
+            find_all_avx2(haystack, size, needle, needle_size, out);
+        } else {
+            find_all_sse2(haystack, size, needle, needle_size, out);
+        }
+#else
+        find_all_scalar(haystack, size, needle, needle_size, 0, out);
+#endif
+    }
+
+#if defined(__x86_64__)
+    inline std::size_t mismatch_sse2(const std::byte* lhs, const std::byte* rhs, std::size_t size) {
+        std::size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            auto equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i)),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i)));
+            auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(equal)) ^ 0xffffu;
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        for (; i < size and lhs[i] == rhs[i]; ++i);
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline std::size_t mismatch_avx2(const std::byte* lhs, const std::byte* rhs, std::size_t size) {
+        std::size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            auto equal = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i)),
+                                           _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i)));
+            auto mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(equal));
+            if (mask) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        for (; i < size and lhs[i] == rhs[i]; ++i);
+        return i;
+    }
+#endif
+
+    /* offset of the first byte where lhs and rhs differ, or size if they are equal */
+    inline std::size_t mismatch(const std::byte* lhs, const std::byte* rhs, std::size_t size) {
+#if defined(__x86_64__)
+        return has_avx2() ? mismatch_avx2(lhs, rhs, size) : mismatch_sse2(lhs, rhs, size);
+#else
+        std::size_t i = 0;
+        for (; i < size and lhs[i] == rhs[i]; ++i);
+        return i;
+#endif
+    }
+}
+
+#endif
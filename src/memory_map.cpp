@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <fstream>
+#include <libsdb/memory_map.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/parse.hpp>
+
+namespace {
+    /* splits off the next space-delimited field from line */
+    std::string_view next_field(std::string_view& line) {
+        auto start = line.find_first_not_of(' ');
+        if (start == std::string_view::npos) {
+            line = {};
+            return {};
+        }
+
+        line.remove_prefix(start);
+        auto end = std::min(line.find(' '), line.size());
+        auto field = line.substr(0, end);
+        line.remove_prefix(end);
+        return field;
+    }
+
+    /* parses a single line: low-high perms offset dev inode [path] */
+    sdb::memory_region parse_region(std::string_view line) {
+        auto invalid = [] { sdb::error::send("Invalid /proc/<pid>/maps line"); };
+
+        auto range = next_field(line);
+        auto perms = next_field(line);
+        auto offset = sdb::to_integral<std::uint64_t>(next_field(line), 16);
+        auto device = next_field(line);
+        auto inode = sdb::to_integral<std::uint64_t>(next_field(line));
+
+        auto dash = range.find('-');
+        if (dash == std::string_view::npos or perms.size() != 4 or !offset or !inode) {
+            invalid();
+        }
+
+        auto low = sdb::to_integral<std::uint64_t>(range.substr(0, dash), 16);
+        auto high = sdb::to_integral<std::uint64_t>(range.substr(dash + 1), 16);
+        if (!low or !high) {
+            invalid();
+        }
+
+        //the path is the rest of the line and may contain spaces
+        auto path_start = line.find_first_not_of(' ');
+        auto path = path_start == std::string_view::npos ? std::string_view{} : line.substr(path_start);
+
+        return { sdb::virt_addr{*low}, sdb::virt_addr{*high},
+                 perms[0] == 'r', perms[1] == 'w', perms[2] == 'x', perms[3] == 's',
+                 *offset, std::string(device), *inode, std::string(path) };
+    }
+}
+
+void sdb::memory_map::load(pid_t pid) {
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+    if (!maps) {
+        error::send("Could not read memory map of process " + std::to_string(pid));
+    }
+
+    regions_.clear();
+    std::string line;
+    while (std::getline(maps, line)) {
+        if (!line.empty()) {
+            regions_.push_back(parse_region(line));
+        }
+    }
+}
+
+const sdb::memory_region* sdb::memory_map::find(virt_addr address) const {
+    //first region starting after address, the one before it is the only candidate
+    auto it = std::upper_bound(regions_.begin(), regions_.end(), address,
+                               [](virt_addr addr, const memory_region& region) { return addr < region.low; });
+    if (it == regions_.begin()) {
+        return nullptr;
+    }
+
+    --it;
+    return it->contains(address) ? &*it : nullptr;
+}
+
+std::vector<const sdb::memory_region*> sdb::memory_map::get_in_region(virt_addr low, virt_addr high) const {
+    std::vector<const memory_region*> ret;
+
+    //first region that ends after low
+    auto it = std::upper_bound(regions_.begin(), regions_.end(), low,
+                               [](virt_addr addr, const memory_region& region) { return addr < region.high; });
+    for (; it != regions_.end() and it->low < high; ++it) {
+        ret.push_back(&*it);
+    }
+    return ret;
+}
+
+bool sdb::memory_map::is_readable(virt_addr address) const {
+    auto region = find(address);
+    return region and region->readable;
+}
+
+bool sdb::memory_map::is_writable(virt_addr address) const {
+    auto region = find(address);
+    return region and region->writable;
+}
+
+bool sdb::memory_map::is_executable(virt_addr address) const {
+    auto region = find(address);
+    return region and region->executable;
+}
+
+std::size_t sdb::memory_map::readable_extent(virt_addr address, std::size_t amount) const {
+    auto end = address + amount;
+    auto current = address;
+
+    //walk adjacent readable regions until we cover the request or hit a gap
+    while (current < end) {
+        auto region = find(current);
+        if (!region or !region->readable) {
+            break;
+        }
+        current = std::min(end, region->high);
+    }
+    return current.addr() - address.addr();
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <chrono>
+#include <sys/uio.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+#include "simd.hpp"
+
+namespace {
+    /* searches one buffer and records matches, returns false once the match limit is reached */
+    bool search_buffer(const std::byte* data, std::size_t size, sdb::virt_addr base,
+                       sdb::span<const std::byte> pattern, const sdb::memory_search_options& options,
+                       std::vector<std::size_t>& offsets, sdb::memory_search_result& result) {
+        offsets.clear();
+        sdb::simd::find_all(data, size, pattern.begin(), pattern.size(), offsets);
+
+        for (auto offset : offsets) {
+            result.matches.push_back(base + offset);
+            if (options.max_matches != 0 and result.matches.size() >= options.max_matches) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+sdb::memory_search_result sdb::Process::search_memory(span<const std::byte> pattern,
+                                                      const memory_search_options& options) const {
+    if (pattern.size() == 0) {
+        error::send("Search pattern is empty");
+    }
+
+    memory_search_result result;
+    result.kernel = simd::kernel_name();
+
+    //consecutive chunks overlap by pattern size - 1 so matches across chunk boundaries are found once
+    auto overlap = pattern.size() - 1;
+    auto buffer_size = std::max({ options.buffer_size, pattern.size() * 2, page_cache::page_size });
+    std::vector<std::byte> buffer(buffer_size);
+    std::vector<std::size_t> offsets;
+
+    auto start_time = std::chrono::steady_clock::now();
+    bool keep_going = true;
+
+    for (auto mapped : get_memory_map().get_in_region(options.low, options.high)) {
+        //pages software watchpoints protected are searched as the program sees them
+        auto region = unwatched_region(*mapped);
+        if (!region.readable or (options.writable and !region.writable)
+            or (options.executable and !region.executable)) {
+            continue;
+        }
+        ++result.regions_scanned;
+
+        auto low = std::max(region.low, options.low);
+        auto high = std::min(region.high, options.high);
+
+        for (auto pos = low; keep_going and pos < high; ) {
+            auto size = std::min<std::uint64_t>(buffer_size, high.addr() - pos.addr());
+            if (size < pattern.size()) {
+                break;
+            }
+
+            //read the chunk straight into the reusable buffer, bypassing the page cache
+            iovec local_desc{ buffer.data(), size };
+            iovec remote_desc{ reinterpret_cast<void*>(pos.addr()), size };
+            auto read = process_vm_readv(pid_, &local_desc, 1, &remote_desc, 1, /* flags=*/0);
+
+            if (read == static_cast<ssize_t>(size)) {
+                //our int3s and jmps aren't what the tracee holds
+                remove_traps(pos, { buffer.data(), size });
+                keep_going = search_buffer(buffer.data(), size, pos, pattern, options, offsets, result);
+            } else {
+                //some pages are unreadable (guard pages, device mappings), search each readable run on its own
+                std::vector<memory_read_request> pages;
+                for (std::uint64_t off = 0; off < size; off += page_cache::page_size) {
+                    auto page_size = std::min<std::uint64_t>(page_cache::page_size, size - off);
+                    pages.push_back({ pos + off, { buffer.data() + off, page_size } });
+                }
+                read_memory_batch({ pages.data(), pages.size() });
+                remove_traps(pos, { buffer.data(), size });
+
+                std::size_t run_start = 0;
+                for (std::size_t i = 0; i <= pages.size() and keep_going; ++i) {
+                    if (i < pages.size() and pages[i].success) {
+                        continue;
+                    }
+
+                    auto run_end = i < pages.size() ? i * page_cache::page_size : size;
+                    if (run_end > run_start) {
+                        keep_going = search_buffer(buffer.data() + run_start, run_end - run_start, pos + run_start,
+                                                   pattern, options, offsets, result);
+                    }
+                    run_start = (i + 1) * page_cache::page_size;
+                }
+            }
+
+            //the last chunk of a region needs no overlap
+            auto advance = pos + size < high ? size - overlap : size;
+            result.bytes_scanned += advance;
+            pos += advance;
+        }
+
+        if (!keep_going) {
+            break;
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    result.seconds = elapsed.count();
+    return result;
+}
@@ -0,0 +1,36 @@
+#include <algorithm>
+#include <libsdb/page_cache.hpp>
+
+const std::byte* sdb::page_cache::lookup(std::uint64_t page_addr) const {
+    auto it = pages_.find(page_addr);
+    if (it == pages_.end()) {
+        ++misses_;
+        return nullptr;
+    }
+
+    ++hits_;
+    return it->second.data();
+}
+
+std::byte* sdb::page_cache::insert(std::uint64_t page_addr) {
+    return pages_[page_addr].data();
+}
+
+void sdb::page_cache::patch(virt_addr address, span<const std::byte> data) {
+    auto start = address.addr();
+    auto end = start + data.size();
+
+    //walk every page the write touches, only pages we already hold need updating
+    for (auto page_addr = page_of(address); page_addr < end; page_addr += page_size) {
+        auto it = pages_.find(page_addr);
+        if (it == pages_.end()) {
+            continue;
+        }
+
+        //overlap between the written range and this page
+        auto low = std::max(start, page_addr);
+        auto high = std::min(end, page_addr + page_size);
+        std::copy(data.begin() + (low - start), data.begin() + (high - start),
+                  it->second.begin() + (low - page_addr));
+    }
+}
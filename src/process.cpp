@@ -13,11 +13,19 @@
 #include <libsdb/error.hpp>
 #include <libsdb/pipe.hpp>
 #include <libsdb/bits.hpp>
+#include <libsdb/syscalls.hpp>
 #include <cstring>
 #include <sys/personality.h>
+#include <signal.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <elf.h>
 #include <fstream>
+#include <fcntl.h>
+#include <climits>
+#include <algorithm>
+#include <utility>
+#include <chrono>
 
 
 namespace {
@@ -31,8 +39,8 @@ namespace {
     }
 
     //distinguish normal traps from those of a system call
-    void set_ptrace_options(pid_t pid) {
-        if (ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD) < 0) {
+    void set_ptrace_options(pid_t pid, long options) {
+        if (ptrace(PTRACE_SETOPTIONS, pid, NULL, options) < 0) {
             sdb::error::send_errno("ptrace set options with TRACESYSGOOD failed");
         }
     }
@@ -92,44 +100,230 @@ sdb::stop_reason::stop_reason(int wait_status)
     }
 }
 
+long sdb::Process::ptrace_options(bool follow_forks) {
+    //without TRACESECCOMP syscalls our seccomp filters stop on fail with ENOSYS, TRACECLONE attaches us to new threads
+    long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACESECCOMP | PTRACE_O_TRACECLONE;
+    return follow_forks ? options | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK : options;
+}
+
 /* checks if the tracee process has changed state */
 sdb::stop_reason sdb::Process::wait_on_signal()
 {
-    int wait_status;
-    auto options = 0;
+    return *next_reported_stop(true);
+}
 
-    if (waitpid(pid_, &wait_status, options) < 0)
-    {
-        error::send_errno("waitpid failed");
+std::optional<sdb::stop_reason> sdb::Process::poll_stop()
+{
+    return next_reported_stop(false);
+}
+
+std::optional<sdb::stop_reason> sdb::Process::next_reported_stop(bool block)
+{
+    //tracepoint hits, faults software watchpoints pass over and false conditions are handled here
+    //without returning to the caller
+    for (;;) {
+        //a single step only waits for the thread being stepped
+        auto reason = wait_for_stop(single_stepping_ ? std::optional<pid_t>(current_thread_) : std::nullopt, block);
+        if (!reason or reason->reason != process_state::stopped) {
+            return reason;
+        }
+        if (!should_report(*reason)) {
+            resume(reason->tid);
+            continue;
+        }
+
+        //the program's own signals reach it when it goes on. A SIGSTOP isn't handed on, the stop was
+        //already reported and delivering it would only stop the program again
+        auto& thread = get_thread(reason->tid);
+        if (reason->info == SIGSTOP and interrupt_pending_) {
+            interrupt_pending_ = false;
+            reason->interrupted = true;
+            thread.reason = reason;
+        } else if (reason->info != SIGTRAP and reason->info != SIGSTOP) {
+            thread.pending_signal = reason->info;
+        }
+
+        //all-stop, nothing runs while the caller looks at the stop
+        if (!non_stop_) {
+            stop_running_threads();
+        }
+        return reason;
+    }
+}
+
+bool sdb::Process::should_report(stop_reason& reason) {
+    if (record_tracepoint_hit(reason)) {
+        return false;
+    }
+    if (handle_software_watch_fault(reason) and !single_stepping_) {
+        return false;
+    }
+    //a hit another thread had on the way to an all-stop, its stoppoint was deleted before its turn came
+    if (!stoppoint_still_exists(reason)) {
+        return false;
+    }
+    if (!single_stepping_ and !passes_condition(reason)) {
+        return false;
+    }
+    if (!single_stepping_ and reason.trap_reason == trap_type::syscall and !is_syscall_caught(reason)) {
+        return false;
+    }
+    return true;
+}
+
+bool sdb::Process::stoppoint_still_exists(const stop_reason& reason) const {
+    if (reason.reason != process_state::stopped or reason.info != SIGTRAP) {
+        return true;
+    }
+    if (reason.trap_reason == trap_type::software_watch) {
+        return watchpoints_.contains_id(*reason.software_watchpoint);
+    }
+    if (reason.trap_reason != trap_type::hardware_break) {
+        return true;
+    }
+
+    //the same lookup as get_current_hardware_stoppoint, which expects the stoppoint to be there
+    auto& regs = get_registers();
+    auto index = __builtin_ctzll(regs.read_by_id_as<std::uint64_t>(register_id::dr6));
+    auto id = static_cast<register_id>(static_cast<int>(register_id::dr0) + index);
+    auto addr = virt_addr(regs.read_by_id_as<std::uint64_t>(id));
+    return breakpoint_sites_.contains_address(addr) or watchpoints_.contains_address(addr);
+}
+
+bool sdb::Process::passes_condition(const stop_reason& reason) {
+    if (reason.reason != process_state::stopped or reason.info != SIGTRAP) {
+        return true;
+    }
+
+    //registers are fetched lazily, though looking up a software breakpoint reads the pc and with it every gpr
+    condition_context context{ &get_registers() };
+    const std::optional<condition>* cond = nullptr;
+    auto breakpoint_hit = [&](breakpoint_site& site) {
+        context.hits = ++site.hit_count_;
+        cond = &site.condition_;
+    };
+    auto watchpoint_hit = [&](watchpoint_site& site) {
+        context.hits = ++site.hit_count_;
+        context.value = site.data();
+        context.old = site.previous_data();
+        cond = &site.condition_;
+    };
+
+    if (reason.trap_reason == trap_type::software_break and breakpoint_sites_.enabled_stoppoint_at_address(get_pc())) {
+        breakpoint_hit(breakpoint_sites_.get_by_address(get_pc()));
+    } else if (reason.trap_reason == trap_type::hardware_break) {
+        auto id = get_current_hardware_stoppoint();
+        if (id.index() == 0) {
+            breakpoint_hit(breakpoint_sites_.get_by_id(std::get<0>(id)));
+        } else {
+            watchpoint_hit(watchpoints_.get_by_id(std::get<1>(id)));
+        }
+    } else if (reason.trap_reason == trap_type::software_watch) {
+        watchpoint_hit(watchpoints_.get_by_id(*reason.software_watchpoint));
+    }
+
+    return !cond or !*cond or (*cond)->evaluate(context);
+}
+
+std::optional<sdb::stop_reason> sdb::Process::wait_for_stop(std::optional<pid_t> tid, bool block)
+{
+    for (;;) {
+        //a stop that came in while the other threads were being stopped goes first, nothing to wait for
+        if (!tid) {
+            auto pending = std::find_if(threads_.begin(), threads_.end(),
+                                        [](auto& entry) { return entry.second.pending_report; });
+            if (pending != threads_.end()) {
+                pending->second.pending_report = false;
+                current_thread_ = pending->first;
+                state_ = pending->second.state;
+                return *pending->second.reason;
+            }
+        }
+
+        //the thread we were waiting for is gone, whatever happens next is for the whole process
+        if (tid and !threads_.count(*tid)) {
+            tid.reset();
+        }
+        //non-stop can leave every thread stopped, nothing would ever come
+        if (non_stop_ and !tid and std::none_of(threads_.begin(), threads_.end(), [](auto& entry) {
+                return entry.second.state == process_state::running;
+            })) {
+            if (!block) {
+                return std::nullopt;
+            }
+            error::send("No thread is running");
+        }
+
+        auto [event_tid, wait_status] = wait_for_thread(tid, block);
+        if (event_tid == 0) {
+            return std::nullopt;
+        }
+        auto reason = take_thread_event(event_tid, wait_status);
+        if (reason) {
+            current_thread_ = event_tid;
+            state_ = reason->reason;
+            return *reason;
+        }
+
+        //bookkeeping stops of a running process, or of the thread we are waiting for, carry on as they were.
+        //In non-stop mode every thread that isn't stopped for the user runs
+        auto it = threads_.find(event_tid);
+        if (it == threads_.end() or it->second.state != process_state::stopped or
+            (!non_stop_ and state_ != process_state::running and event_tid != tid)) {
+            continue;
+        }
+        if (it->second.stepping) {
+            if (ptrace(PTRACE_SINGLESTEP, event_tid, nullptr, nullptr) < 0) {
+                error::send_errno("Could not single step");
+            }
+            it->second.state = process_state::running;
+        } else {
+            continue_thread(it->second);
+        }
     }
+}
+
+std::optional<sdb::stop_reason> sdb::Process::decode_stop(thread_state& thread, int wait_status)
+{
     stop_reason reason(wait_status);
-    state_ = reason.reason;
-
-    /* we have attached to the process and stop it, read all the GPR and FPR into the registers_ variable */
-    //if (is_attached_ and state_ == process_state::stopped) {
-    if (state_ == process_state::stopped) {
-        read_all_registers();
-        augment_stop_reason(reason);
-
-        /* back up one instruction */
-        auto instr_begin = get_pc() - 1;
-
-        if (reason.info == SIGTRAP) {
-            if (reason.trap_reason == sdb::trap_type::software_break and 
-                breakpoint_sites_.contains_address(instr_begin) and 
-                breakpoint_sites_.get_by_address(instr_begin).is_enabled()) {
-                    set_pc(instr_begin);
-            } else if (reason.trap_reason == sdb::trap_type::hardware_break) {
-                //check which hardware stoppoint that caused the process to stop
-                auto id = get_current_hardware_stoppoint();
-                //if it's a watchpoint
-                if (id.index() == 1) {
-                    //get the id  - std::variant value stored at index 1 and update data
-                    watchpoints_.get_by_id(std::get<1>(id)).update_data();
-                }
-            //trap occurs from syscall
-            } else if (reason.trap_reason == sdb::trap_type::syscall) {
-                reason = maybe_resume_from_syscall(reason);
+
+    //a seccomp filter stop is a syscall entry, resuming it with PTRACE_SYSCALL brings the exit
+    if (wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8))) {
+        //catching everything, PTRACE_SYSCALL already stopped at this entry
+        if (thread.current_syscall) {
+            if (ptrace(PTRACE_SYSCALL, thread.tid, nullptr, nullptr) < 0) {
+                error::send_errno("Could not resume");
+            }
+            thread.state = process_state::running;
+            return std::nullopt;
+        }
+        reason.info = SIGTRAP | 0x80;
+    }
+
+    //syscall stops come decoded from the kernel in one call, registers stay unread until something asks
+    if (reason.info == (SIGTRAP | 0x80) and !displaced_step_ and read_syscall_stop(reason)) {
+        return reason;
+    }
+
+    //the pc may be in a displaced copy, everything below should see the original code
+    finish_displaced_step();
+    augment_stop_reason(reason);
+
+    /* back up one instruction */
+    auto instr_begin = get_pc() - 1;
+
+    if (reason.info == SIGTRAP) {
+        if (reason.trap_reason == sdb::trap_type::software_break and 
+            breakpoint_sites_.contains_address(instr_begin) and 
+            breakpoint_sites_.get_by_address(instr_begin).is_enabled()) {
+                set_pc(instr_begin);
+        } else if (reason.trap_reason == sdb::trap_type::hardware_break) {
+            //check which hardware stoppoint that caused the process to stop
+            auto id = get_current_hardware_stoppoint();
+            //if it's a watchpoint
+            if (id.index() == 1) {
+                //get the id  - std::variant value stored at index 1 and update data
+                watchpoints_.get_by_id(std::get<1>(id)).update_data();
             }
         }
     }
@@ -138,21 +332,52 @@ sdb::stop_reason sdb::Process::wait_on_signal()
 
 /* execute one instruciton forward */
 sdb::stop_reason sdb::Process::step_instruction() {
+    std::optional<paused_threads> paused;
     std::optional<sdb::breakpoint_site*> to_reenable;
+    auto& thread = current_thread_state();
+    if (thread.state != process_state::stopped) {
+        error::send("Thread " + std::to_string(thread.tid) + " is not stopped");
+    }
     auto pc = get_pc();
+
+    //register changes made during the stop go out in one batch
+    thread.regs->flush();
+
+    //the tracee is about to run, anything we cached may change
+    memory_cache_.invalidate();
+    memory_map_stale_ = true;
     if (breakpoint_sites_.enabled_stoppoint_at_address(pc)) {
         auto& bp = breakpoint_sites_.get_by_address(pc);
-        bp.disable();
-        to_reenable = &bp;
+        auto copy = bp.is_hardware() ? nullptr : get_displaced_copy(bp);
+
+        //run the copy instead, wait_for_stop moves the pc back into the original code
+        if (copy) {
+            set_pc(copy->slot);
+            thread.regs->flush();
+            displaced_step_ = *copy;
+        } else {
+            //none of the other threads may run past the missing int3
+            paused.emplace(pause_running_threads());
+            bp.disable();
+            to_reenable = &bp;
+        }
     }
-    
-    //execute exactly one instruction
-    if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) < 0) {
+
+    //execute exactly one instruction, or enter the handler of a signal the thread stopped with
+    long signal = std::exchange(thread.pending_signal, 0);
+    if (ptrace(PTRACE_SINGLESTEP, thread.tid, nullptr, signal) < 0) {
         error::send_errno("Could not single step");
     }
+    thread.state = process_state::running;
+    thread.stepping = true;
 
     //wait until the single step has happened.
+    auto stepping = std::exchange(single_stepping_, true);
     auto reason = wait_on_signal();
+    single_stepping_ = stepping;
+    if (auto it = threads_.find(reason.tid); it != threads_.end()) {
+        it->second.stepping = false;
+    }
 
     if (to_reenable) {
         to_reenable.value()->enable();
@@ -192,6 +417,11 @@ sdb::Process::launch(std::filesystem::path path,
             exit_with_perror(channel, "Could not set pgid");
         }
 
+        //an event loop of ours blocks the signals it reads from a signalfd, the mask is inherited
+        sigset_t no_signals;
+        sigemptyset(&no_signals);
+        sigprocmask(SIG_SETMASK, &no_signals, nullptr);
+
         /* disables address space randomization for current process - disables ASLR */
         personality(ADDR_NO_RANDOMIZE);
 
@@ -249,7 +479,7 @@ sdb::Process::launch(std::filesystem::path path,
         proc->wait_on_signal();
 
         //enable this option to enable the tracee to distinguish between different types of SYSTRAP
-        set_ptrace_options(proc->get_pid());
+        set_ptrace_options(proc->get_pid(), ptrace_options(false));
     }
 
     return proc;
@@ -277,125 +507,234 @@ sdb::Process::attach(pid_t pid)
     // std::unique_ptr<Process> proc = std::make_unique<Process>(pid, /*terminate_on_end=*/false);
     std::unique_ptr<Process> proc (new Process(pid, /*terminate_on_end=*/false, /*attached=*/true));
     proc->wait_on_signal();
-    set_ptrace_options(proc->get_pid());
+    set_ptrace_options(proc->get_pid(), ptrace_options(false));
+    proc->attach_threads();
 
     return proc;
 }
 
-void sdb::Process::resume() 
-{
-    /* process stopped at breakpoint, step over it */
-    auto pc = get_pc();
+void sdb::Process::attach_threads() {
+    //threads can start while we attach, go over the task list until it has nothing new
+    auto task_dir = "/proc/" + std::to_string(pid_) + "/task";
+    for (bool found = true; found; ) {
+        found = false;
+        std::error_code ec;
+        for (auto& entry : std::filesystem::directory_iterator(task_dir, ec)) {
+            auto tid = static_cast<pid_t>(std::stol(entry.path().filename().string()));
+            //a thread that exits in the meantime can't be attached to
+            if (threads_.count(tid) or ptrace(PTRACE_ATTACH, tid, nullptr, nullptr) < 0) {
+                continue;
+            }
+            add_thread(tid).pending_sigstop = true;
+            found = true;
+        }
+        stop_running_threads();
+    }
 
-    /* step over a breakpoint if we are to remove it afterwards */
-    if (breakpoint_sites_.enabled_stoppoint_at_address(pc)) {
-        auto& bp = breakpoint_sites_.get_by_address(pc);
-        //disable and restore the old instruction
-        bp.disable();
+    //options are per thread, threads cloned from here on inherit them
+    for (auto& [tid, thread] : threads_) {
+        if (tid != pid_ and thread.state == process_state::stopped) {
+            set_ptrace_options(tid, ptrace_options(false));
+        }
+    }
+}
 
-        //single step over the replace instruction
-        if (ptrace(PTRACE_SINGLESTEP, pid_, nullptr, nullptr) < 0) {
-            error::send_errno("Failed to single step");
+void sdb::Process::resume(std::optional<pid_t> tid)
+{
+    if (state_ == process_state::exited or state_ == process_state::terminated) {
+        error::send("Process has ended and cannot be resumed");
+    }
+    if (tid and get_thread(*tid).state != process_state::stopped) {
+        error::send("Thread " + std::to_string(*tid) + " is not stopped");
+    }
+    auto resumes = [&](const thread_state& thread) {
+        return thread.state == process_state::stopped and !thread.pending_report and (!tid or thread.tid == *tid);
+    };
+
+    /* register changes made during the stop go out in one batch before anything runs */
+    for (auto& [_, thread] : threads_) {
+        if (resumes(thread)) {
+            thread.regs->flush();
         }
+    }
 
-        int wait_status;
-        if (waitpid(pid_, &wait_status, 0) < 0) {
-            error::send_errno("waitpid failed");
+    /* caught syscalls stop through a seccomp filter, falling back to PTRACE_SYSCALL if it can't be installed.
+       The filter goes into every thread, it is installed from one that is stopped outside a syscall.
+       It can't be removed and fails its syscalls with ENOSYS once nothing traces the process, so only
+       processes that die with us get one */
+    auto catch_mode = syscall_catch_policy_.get_mode();
+    auto& installer = get_thread(tid.value_or(current_thread_));
+    if (catch_mode == syscall_catch_policy::mode::some and terminate_on_end_ and !syscall_filter_ready_ and
+        !syscall_filter_failed_ and installer.state == process_state::stopped and !installer.current_syscall) {
+        try {
+            on_thread(installer.tid, [&] { install_syscall_filter(); });
+            syscall_filter_ready_ = true;
+        } catch (const error&) {
+            syscall_filter_failed_ = true;
         }
+    }
 
-        bp.enable();
+    /* every thread is moved past its breakpoint before any of them runs, so an int3 taken out for a step
+       is back before another thread can get to it. Threads with a stop still to report stay where they are */
+    for (auto& [id, thread] : threads_) {
+        if (resumes(thread) and !thread.skip_step_over) {
+            step_over_breakpoint(id);
+        }
     }
-    /* restart stopped TRACEE process after we have singled stepped over replaced instruction */
 
-    /* change request depending on policy */
-    auto request = 
-        syscall_catch_policy_.get_mode() == syscall_catch_policy::mode::none ? PTRACE_CONT : PTRACE_SYSCALL; 
+    /* tracee memory and mappings may change once it runs, drop what we know */
+    memory_cache_.invalidate();
+    memory_map_stale_ = true;
 
-    if (ptrace(request, this->pid_, nullptr, nullptr))
-    {
-        error::send_errno("Could not resume");
+    for (auto& [_, thread] : threads_) {
+        if (resumes(thread)) {
+            continue_thread(thread);
+        }
+    }
+
+    /* non-stop, the process stays stopped while any thread is, and commands act on one of those */
+    auto stopped = std::find_if(threads_.begin(), threads_.end(),
+                                [](auto& entry) { return entry.second.state == process_state::stopped; });
+    if (!non_stop_ or stopped == threads_.end()) {
+        state_ = process_state::running;
+    } else if (get_thread(current_thread_).state != process_state::stopped) {
+        current_thread_ = stopped->first;
     }
-    state_ = process_state::running;
+}
+
+void sdb::Process::step_over_breakpoint(pid_t tid)
+{
+    on_thread(tid, [&] {
+        /* process stopped at breakpoint, step over it */
+        auto pc = get_pc();
+        if (!breakpoint_sites_.enabled_stoppoint_at_address(pc)) {
+            return;
+        }
+        auto& bp = breakpoint_sites_.get_by_address(pc);
+        auto& regs = get_registers();
+
+        //cheapest of all is not running the instruction
+        if (emulate_instruction(pc)) {
+            ++step_over_stats_.emulated;
+            regs.flush();
+        } else if (auto copy = bp.is_hardware() ? nullptr : get_displaced_copy(bp);
+                   copy and !copy->is_relative_branch and !copy->is_call) {
+            //the copy jumps back by itself, the int3 stays where it is
+            ++step_over_stats_.displaced;
+            set_pc(copy->slot);
+            regs.flush();
+            get_thread(tid).on_displaced_copy = true;
+        } else if (copy) {
+            //branches and calls see the pc, step them from the copy and put things right afterwards
+            ++step_over_stats_.displaced;
+            set_pc(copy->slot);
+            regs.flush();
+            displaced_step_ = *copy;
+
+            single_step_thread(tid);
+            finish_displaced_step();
+            regs.flush();
+        } else {
+            //disable and restore the old instruction, nothing else may run while it's gone
+            ++step_over_stats_.stepped;
+            auto paused = pause_running_threads();
+            bp.disable();
+
+            //single step over the replace instruction
+            single_step_thread(tid);
+
+            bp.enable();
+        }
+    });
 }
 
 /* destroy the process object and kill them */
 sdb::Process::~Process() 
 {
+    if (fast_trace_shared_) {
+        munmap(fast_trace_shared_, fast_trace_shared_size_);
+    }
+
+    /* checkpoints are only ever useful to this session */
+    for (auto& cp : checkpoints_) {
+        kill(cp.pid, SIGKILL);
+        waitpid(cp.pid, nullptr, __WALL);
+    }
+
     if (pid_ != 0) 
     {
-        int status;
         /* the process is running with valid PID */
         if (is_attached_) {
-            if (state_ == process_state::running) 
-            {
-            /* send it a SIGSTOP and wait for it to stop */
-                kill(pid_, SIGSTOP);
-                waitpid(pid_, &status, 0);
-            }
-            /* detach the destructor (the current process or program) from the process */
-            ptrace(PTRACE_DETACH, pid_, nullptr, nullptr);
-            kill(pid_, SIGCONT);
+            /* stop every thread and detach the destructor (the current process or program) from them */
+            try {
+                detach_threads();
+            } catch (...) {}
         }
 
         /* send it a SIGKILL if target process should be destroyed when the program terminates */     
         if (terminate_on_end_) 
         {
-            kill(pid_, SIGKILL);
-            waitpid(pid_, &status, 0);
+            kill_threads();
         }
     }
+
+    /* detaching still writes to the tracee */
+    if (mem_fd_ >= 0) {
+        close(mem_fd_);
+    }
+
+    live_processes_.erase(std::find(live_processes_.begin(), live_processes_.end(), this));
 }
 
-void sdb::Process::read_all_registers() {
-    /* read user_regs_struct into user struct data_ from the process */
-    if (ptrace(PTRACE_GETREGS, pid_, nullptr, &get_registers().data_.regs) < 0) {
+void sdb::Process::read_gprs(pid_t tid, user_regs_struct& gprs) const {
+    /* read user_regs_struct into user struct data_ from the thread */
+    if (ptrace(PTRACE_GETREGS, tid, nullptr, &gprs) < 0) {
         error::send("Error: cannot read general purpose registers");
     } 
-    /* read user_fpregs_struct into user struct data_ from the process */
-    if (ptrace(PTRACE_GETFPREGS, pid_, nullptr, &get_registers().data_.i387) < 0) {
+}
+
+void sdb::Process::read_fprs(pid_t tid, user_fpregs_struct& fprs) const {
+    /* read user_fpregs_struct into user struct data_ from the thread */
+    if (ptrace(PTRACE_GETFPREGS, tid, nullptr, &fprs) < 0) {
         error::send("Error: cannot read floating point general purpose registers");
     }
+}
 
-    for (int i = 0; i < 8; ++i) {
-        //read debug registers
-        auto id = static_cast<int>(register_id::dr0) + i; //retrieve ith register from the 0th debug register
-
-        /* calling register_info_by_id using our cast */
-        auto info = sdb::get_register_info_by_id(static_cast<register_id> (id));
-
-        errno = 0;
-        /* sets errno to signal errors rather than using return value */
-        std::int64_t data = ptrace(PTRACE_PEEKUSER, pid_, info.offset, nullptr);
-        if (errno != 0) {
-            error::send_errno("Error: cannot read debug registers");
-        }
+std::uint64_t sdb::Process::read_debug_register(pid_t tid, int index) const {
+    //retrieve ith register from the 0th debug register
+    auto id = static_cast<int>(register_id::dr0) + index;
+    auto info = sdb::get_register_info_by_id(static_cast<register_id> (id));
 
-        /* write the retrieved data into the corret place in registers_ member */
-        get_registers().data_.u_debugreg[i] = data;
+    errno = 0;
+    /* sets errno to signal errors rather than using return value */
+    std::int64_t data = ptrace(PTRACE_PEEKUSER, tid, info.offset, nullptr);
+    if (errno != 0) {
+        error::send_errno("Error: cannot read debug registers");
     }
+    return data;
 }
 
 
 /*
 * HANDLES WRITING REGISTERS
 */
-void sdb::Process::write_user_area(std::size_t offset, std::uint64_t data) {
-    /* write the given data to the user area at the given offset */
-    if (ptrace(PTRACE_POKEUSER, pid_, offset, data) < 0) {
+void sdb::Process::write_user_area(std::size_t offset, std::uint64_t data, std::optional<pid_t> tid) {
+    /* write the given data to the user area of the thread at the given offset */
+    if (ptrace(PTRACE_POKEUSER, tid.value_or(current_thread_), offset, data) < 0) {
         error::send("Error: cannot write to user area");
     }
 }
 
 /* write to all fpregs */
-void sdb::Process::write_fprs(const user_fpregs_struct& fprs) {
-    if (ptrace(PTRACE_SETFPREGS, pid_, nullptr, &fprs) < 0) {
+void sdb::Process::write_fprs(const user_fpregs_struct& fprs, std::optional<pid_t> tid) {
+    if (ptrace(PTRACE_SETFPREGS, tid.value_or(current_thread_), nullptr, &fprs) < 0) {
         error::send_errno("Could not write floating point registers");
     }
 }
 
 /* write to all gpregs */
-void sdb::Process::write_gprs(const user_regs_struct& gprs) {
-    if (ptrace(PTRACE_SETREGS, pid_, nullptr, &gprs) < 0) {
+void sdb::Process::write_gprs(const user_regs_struct& gprs, std::optional<pid_t> tid) {
+    if (ptrace(PTRACE_SETREGS, tid.value_or(current_thread_), nullptr, &gprs) < 0) {
         error::send_errno("Could not write general purpose registers");
     }
 }
@@ -410,12 +749,146 @@ sdb::Process::create_breakpoint_site(sdb::virt_addr address, bool hardware, bool
         error::send("Breakpoint site already created at address " + std::to_string(address.addr()));
     }
 
+    //an int3 inside the jmp of a fast tracepoint would corrupt it
+    for (auto tp : tracepoints_.get_in_region(address - 15, address + 1)) {
+        if (tp->is_fast() and tp->address() + tp->patch_size() > address) {
+            error::send("Address is inside the jump of a fast tracepoint");
+        }
+    }
+
     return breakpoint_sites_.push(
         std::unique_ptr<breakpoint_site>(new breakpoint_site(*this, address, internal, hardware)));
 }
 
+std::vector<sdb::breakpoint_site*> sdb::Process::create_breakpoint_sites(std::vector<virt_addr> addresses) {
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+    //fast tracepoints are few, check each address against all of their jmps
+    std::vector<std::pair<virt_addr, virt_addr>> jumps;
+    tracepoints_.for_each([&](auto& tp) {
+        if (tp.is_fast()) {
+            jumps.push_back({ tp.address(), tp.address() + tp.patch_size() });
+        }
+    });
+
+    //every address is checked before any site is made, an error leaves nothing half created
+    for (auto address : addresses) {
+        for (auto [low, high] : jumps) {
+            if (address >= low and address < high and !breakpoint_sites_.contains_address(address)) {
+                error::send("Address is inside the jump of a fast tracepoint");
+            }
+        }
+    }
+
+    std::vector<breakpoint_site*> ret;
+    breakpoint_sites_.reserve(addresses.size());
+    for (auto address : addresses) {
+        if (breakpoint_sites_.contains_address(address)) {
+            continue;
+        }
+        ret.push_back(&breakpoint_sites_.push(
+            std::unique_ptr<breakpoint_site>(new breakpoint_site(*this, address, false, false))));
+    }
+    return ret;
+}
+
+void sdb::Process::enable_breakpoint_sites(const std::vector<breakpoint_site*>& sites) {
+    set_breakpoint_sites_enabled(sites, true);
+}
+
+void sdb::Process::disable_breakpoint_sites(const std::vector<breakpoint_site*>& sites) {
+    set_breakpoint_sites_enabled(sites, false);
+}
+
+void sdb::Process::set_breakpoint_sites_enabled(const std::vector<breakpoint_site*>& sites, bool enable) {
+    //hardware sites each own a debug register, there's nothing to batch
+    std::vector<breakpoint_site*> software;
+    for (auto site : sites) {
+        if (site->is_enabled() == enable) {
+            continue;
+        }
+        if (site->is_hardware()) {
+            enable ? site->enable() : site->disable();
+        } else {
+            software.push_back(site);
+        }
+    }
+    if (software.empty()) {
+        return;
+    }
+
+    //a site listed twice would save the 0xcc it wrote the first time
+    std::sort(software.begin(), software.end(), [](auto lhs, auto rhs) { return lhs->address() < rhs->address(); });
+    software.erase(std::unique(software.begin(), software.end()), software.end());
+
+    //one buffer holding every page that has a site, read with a single batch
+    std::vector<std::uint64_t> pages;
+    for (auto site : software) {
+        auto page = page_cache::page_of(site->address());
+        if (pages.empty() or pages.back() != page) {
+            pages.push_back(page);
+        }
+    }
+
+    std::vector<std::byte> buffer(pages.size() * page_cache::page_size);
+    std::vector<memory_read_request> requests;
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        requests.push_back({ virt_addr{ pages[i] }, { buffer.data() + i * page_cache::page_size, page_cache::page_size } });
+    }
+    read_memory_batch({ requests.data(), requests.size() });
+
+    //patch every site locally, sites on pages we couldn't read go the slow way and report their own errors
+    std::vector<std::pair<std::size_t, std::size_t>> dirty(pages.size(), { page_cache::page_size, 0 });
+    std::size_t page_index = 0;
+    for (auto site : software) {
+        while (pages[page_index] != page_cache::page_of(site->address())) {
+            ++page_index;
+        }
+        if (!requests[page_index].success) {
+            enable ? site->enable() : site->disable();
+            continue;
+        }
+
+        auto offset = site->address().addr() - pages[page_index];
+        auto& byte = buffer[page_index * page_cache::page_size + offset];
+        if (enable) {
+            site->saved_data_ = std::exchange(byte, std::byte{ 0xcc });
+        } else {
+            byte = site->saved_data_;
+        }
+        site->is_enabled_ = enable;
+
+        auto& [first, last] = dirty[page_index];
+        first = std::min(first, offset);
+        last = std::max(last, offset + 1);
+    }
+
+    //write back from the first to the last patched byte of each run of adjacent pages
+    for (std::size_t i = 0; i < pages.size(); ) {
+        if (dirty[i].first >= dirty[i].second) {
+            ++i;
+            continue;
+        }
+
+        auto run_end = i + 1;
+        while (run_end < pages.size() and pages[run_end] == pages[run_end - 1] + page_cache::page_size
+               and dirty[run_end].first < dirty[run_end].second) {
+            ++run_end;
+        }
+
+        auto begin = i * page_cache::page_size + dirty[i].first;
+        auto end = (run_end - 1) * page_cache::page_size + dirty[run_end - 1].second;
+
+        //text is read-only, go straight to /proc/<pid>/mem rather than fail process_vm_writev first
+        write_memory(virt_addr{ pages[i] + dirty[i].first }, { buffer.data() + begin, end - begin },
+                     memory_write_path::proc_mem);
+        i = run_end;
+    }
+}
+
 sdb::watchpoint_site&
-sdb::Process::create_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size)
+sdb::Process::create_watchpoint(virt_addr address, stoppoint_mode mode, std::size_t size, bool software)
 {
 
     //disallow two breakpoints pointing to the same site
@@ -423,88 +896,403 @@ sdb::Process::create_watchpoint(virt_addr address, stoppoint_mode mode, std::siz
         error::send("Watchpoint already created at address " + std::to_string(address.addr()));
     }
 
+    //we run syscalls from the code at the pc, so the pages it is on have to stay executable
+    if (software) {
+        if (mode == stoppoint_mode::execution) {
+            error::send("Software watchpoints cannot watch execution, use a breakpoint");
+        }
+        if (size == 0) {
+            error::send("Software watchpoint must cover at least one byte");
+        }
+        for (auto region : get_memory_map().get_in_region(address, address + size)) {
+            if (region->executable) {
+                error::send("Software watchpoints cannot cover executable memory");
+            }
+        }
+    }
+
     return watchpoints_.push(
-        std::unique_ptr<watchpoint_site>(new watchpoint_site(*this, address, mode, size)));
+        std::unique_ptr<watchpoint_site>(new watchpoint_site(*this, address, mode, size, software)));
 }
 
 
 
 std::vector<std::byte> sdb::Process::read_memory(sdb::virt_addr address, size_t amount) const {
     std::vector<std::byte> ret(amount);
+    if (amount == 0) {
+        return ret;
+    }
 
-    //data read from target process is stored in here
-    //filled with struct and size
-    iovec local_desc{ ret.data(), ret.size()};
+    //a running thread may write any page at any time, nothing cached is current
+    if (has_running_thread()) {
+        memory_cache_.invalidate();
+    }
+
+    auto first_page = page_cache::page_of(address);
+    auto last_page = page_cache::page_of(address + (amount - 1));
+
+    //pages we hold from earlier reads during this stop, indexed from first_page
+    std::vector<const std::byte*> pages;
 
-    //from which the memory should be copied - the remote process
-    //stores page memories
+    //one local and one remote iovec per missing page, read whole pages into the cache
+    std::vector<iovec> local_descs;
     std::vector<iovec> remote_descs;
+    std::vector<std::uint64_t> missing;
+
+    for (auto page = first_page; page <= last_page; page += page_cache::page_size) {
+        auto cached = memory_cache_.lookup(page);
+        pages.push_back(cached);
+
+        //pages an rw software watchpoint made unreadable are still there through /proc/<pid>/mem
+        auto watched = watched_pages_.find(page);
+        if (!cached and watched != watched_pages_.end() and !(watched->second.protection & PROT_READ)) {
+            auto buffer = memory_cache_.insert(page);
+            if (pread(get_mem_fd(), buffer, page_cache::page_size, page) == static_cast<ssize_t>(page_cache::page_size)) {
+                pages.back() = cached = buffer;
+            } else {
+                memory_cache_.erase(page);
+            }
+        }
 
-    //populate remote_desc vector with multiple `iovec` entries.
-    //until all requested bytes have been accounted for
-    while (amount > 0) {
-        //how far the offset address goes into page - the second part
-        //number bytes left in the current page starting from current offset and in the current page
-        auto up_to_next_page = 0x1000 - (address.addr() & 0xfff);
+        if (!cached) {
+            missing.push_back(page);
+            local_descs.push_back({ memory_cache_.insert(page), page_cache::page_size });
+            remote_descs.push_back({ reinterpret_cast<void*>(page), page_cache::page_size });
+        }
+    }
 
-        //read no more than what's left on the page
-        auto chunk_size = std::min(amount, up_to_next_page);
+    if (!missing.empty()) {
+        auto read = process_vm_readv(pid_, local_descs.data(), /* liovcnt=*/local_descs.size(),
+                                     remote_descs.data(), /* riovcnt=*/remote_descs.size(), /* flags= */ 0);
 
-        //chunk of memory to 
-        remote_descs.push_back({ reinterpret_cast<void*> (address.addr()), chunk_size});
+        //partial transfers stop at a page boundary, keep only the pages that were read
+        std::size_t pages_read = read < 0 ? 0 : read / page_cache::page_size;
+        for (std::size_t i = pages_read; i < missing.size(); ++i) {
+            memory_cache_.erase(missing[i]);
+        }
 
-        //how much we have already read
-        amount -= chunk_size;
-        
-        //add how much we have read into
-        address += chunk_size;
+        if (read < 0 and missing.front() == first_page) {
+            error::send_errno("Error: could not read process memory with process_vm_readv");
+        }
+
+        //point the freshly read pages back into the page list
+        for (std::size_t i = 0; i < pages_read; ++i) {
+            pages[(missing[i] - first_page) / page_cache::page_size] =
+                reinterpret_cast<const std::byte*>(local_descs[i].iov_base);
+        }
     }
 
-    if (process_vm_readv(pid_, &local_desc, /* liovcnt=*/1 ,
-                         remote_descs.data(), /* riovcnt=*/remote_descs.size(), /* flags= */ 0) < 0) {
-        error::send_errno("Error: could not read process memory with process_vm_readv");
+    //copy from each page, bytes from pages we couldn't read stay zeroed
+    std::size_t copied = 0;
+    while (copied < amount) {
+        auto current = address + copied;
+        auto page_offset = current.addr() & (page_cache::page_size - 1);
+        auto chunk_size = std::min(amount - copied, page_cache::page_size - page_offset);
+
+        auto page = pages[(page_cache::page_of(current) - first_page) / page_cache::page_size];
+        if (page) {
+            std::copy(page + page_offset, page + page_offset + chunk_size, ret.begin() + copied);
+        }
+
+        copied += chunk_size;
     }
     return ret;
 }
 
-void sdb::Process::write_memory(virt_addr address, span<const std::byte> data){
+void sdb::Process::write_memory(virt_addr address, span<const std::byte> data, memory_write_path path) {
+    using mode = memory_write_path;
+    std::size_t written = 0;
+
+    //each engine picks up where the previous one stopped
+    auto rest = [&] { return span<const std::byte>(data.begin() + written, data.end()); };
+
+    if (path == mode::automatic or path == mode::vm_writev) {
+        written += write_memory_vm(address, data);
+    }
+
+    if (written < data.size() and (path == mode::automatic or path == mode::proc_mem)) {
+        written += write_memory_proc_mem(address + written, rest());
+    }
+
+    if (written < data.size() and (path == mode::automatic or path == mode::poke_data)) {
+        write_memory_poke(address + written, rest());
+        written = data.size();
+    }
+
+    if (written < data.size()) {
+        error::send_errno("Failed to write virtual memory");
+    }
+
+    memory_cache_.patch(address, data);
+
+    //copies and decodings of the old instructions would run stale code
+    if (!displaced_copies_.empty()) {
+        drop_displaced_copies(address, address + data.size());
+    }
+    for (auto it = emulated_instructions_.begin(); it != emulated_instructions_.end(); ) {
+        auto start = virt_addr{ it->first };
+        it = start < address + data.size() and start + 15 > address ? emulated_instructions_.erase(it) : std::next(it);
+    }
+}
+
+int sdb::Process::get_mem_fd() const {
+    if (mem_fd_ < 0) {
+        auto path = "/proc/" + std::to_string(pid_) + "/mem";
+        if ((mem_fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC)) < 0) {
+            error::send_errno("Could not open " + path);
+        }
+    }
+    return mem_fd_;
+}
+
+std::int64_t sdb::Process::inject_syscall(long number, std::initializer_list<std::uint64_t> args) {
+    if (state_ != process_state::stopped) {
+        error::send("Process must be stopped to run a syscall");
+    }
+    auto& thread = current_thread_state();
+    if (thread.state != process_state::stopped) {
+        error::send("Thread " + std::to_string(thread.tid) + " is not stopped");
+    }
+    if (thread.current_syscall) {
+        error::send("Cannot run a syscall inside a syscall");
+    }
+
+    //the code at the pc is replaced, no other thread may get to run it
+    auto paused = pause_running_threads();
+
+    thread.regs->flush();
+    user_regs_struct saved;
+    read_gprs(thread.tid, saved);
+
+    //whatever is at the pc, int3 or not, goes back exactly as it was
+    static constexpr std::byte syscall_instruction[] = { std::byte{ 0x0f }, std::byte{ 0x05 } };
+    auto code = read_memory(virt_addr{ saved.rip }, sizeof(syscall_instruction));
+    write_memory(virt_addr{ saved.rip }, { syscall_instruction, sizeof(syscall_instruction) },
+                 memory_write_path::proc_mem);
+
+    //orig_rax of -1 keeps the kernel from treating this stop as an interrupted syscall to restart
+    auto regs = saved;
+    regs.rax = number;
+    regs.orig_rax = -1;
+    decltype(regs.rdi)* arg_registers[] = { &regs.rdi, &regs.rsi, &regs.rdx, &regs.r10, &regs.r8, &regs.r9 };
+    std::size_t i = 0;
+    for (auto arg : args) {
+        *arg_registers[i++] = arg;
+    }
+
+    //a seccomp filter catching the syscall stops it before it runs, step on from there
+    int wait_status = 0;
+    bool stepped = ptrace(PTRACE_SETREGS, thread.tid, nullptr, &regs) == 0;
+    if (stepped) {
+        wait_status = single_step_thread(thread.tid);
+    }
+    if (stepped and wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8))) {
+        wait_status = single_step_thread(thread.tid);
+    }
+    stepped = stepped and WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) == SIGTRAP;
+    if (stepped) {
+        read_gprs(thread.tid, regs);
+    }
+
+    write_memory(virt_addr{ saved.rip }, { code.data(), code.size() }, memory_write_path::proc_mem);
+    write_gprs(saved, thread.tid);
+    //stepping changed DR6
+    thread.regs->invalidate();
+
+    //mmap, munmap, mprotect and the like change the mappings, others may write memory we have cached
+    memory_cache_.invalidate();
+    memory_map_stale_ = true;
+
+    if (!stepped) {
+        error::send("Could not run syscall in the process");
+    }
+    return static_cast<std::int64_t>(regs.rax);
+}
+
+std::size_t sdb::Process::write_memory_vm(virt_addr address, span<const std::byte> data) {
+    if (data.size() == 0) {
+        return 0;
+    }
+
+    //the kernel only stops partial transfers between iovecs, so split remote memory at pages
+    iovec local_desc{ const_cast<std::byte*>(data.begin()), data.size() };
+    std::vector<iovec> remote_descs;
+
+    for (std::size_t queued = 0; queued < data.size(); ) {
+        auto current = address + queued;
+        auto up_to_next_page = 0x1000 - (current.addr() & 0xfff);
+        auto chunk_size = std::min(data.size() - queued, up_to_next_page);
+
+        remote_descs.push_back({ reinterpret_cast<void*>(current.addr()), chunk_size });
+        queued += chunk_size;
+    }
+
+    //fails on read-only pages such as text, the caller falls back to /proc/<pid>/mem
+    auto written = process_vm_writev(pid_, &local_desc, /* liovcnt=*/1,
+                                     remote_descs.data(), /* riovcnt=*/remote_descs.size(), /* flags=*/0);
+    return written < 0 ? 0 : written;
+}
+
+std::size_t sdb::Process::write_memory_proc_mem(virt_addr address, span<const std::byte> data) {
+    std::size_t written = 0;
+    auto fd = get_mem_fd();
+
+    //writes through /proc/<pid>/mem ignore page protections, like ptrace does
+    while (written < data.size()) {
+        auto ret = pwrite(fd, data.begin() + written, data.size() - written, address.addr() + written);
+        if (ret <= 0) {
+            break;
+        }
+        written += ret;
+    }
+    return written;
+}
+
+void sdb::Process::write_memory_poke(virt_addr address, span<const std::byte> data) {
     std::size_t written = 0;
 
     //loop until we use up all data caller gave us
     while (written < data.size()) {
         auto remaining = data.size() - written;
         std::uint64_t word;
+        auto target = address + written;
 
         /* full write with 8 bytes */
         if (remaining >= 8) {
             //write the next 8 bytes from the start of the next memory buffer
             word = from_bytes<std::uint64_t>(data.begin() + written);
+            written += 8;
 
-        /* partial write for writes fewer than 8 bytes */
+        /* partial tail - move the word back so it ends exactly at the end of data. A buffer shorter than a word
+           at the start of a mapping would reach before it, there the word starts with the buffer and stays on its page */
         } else {
-            auto read = read_memory(address + written, 8); //read 8 bytes from that memory address
-            auto word_data = reinterpret_cast<char*>(&word); //to use memcpy on this
+            auto back = 8 - remaining;
+            target = address + written - back;
+            if (written < back and !is_mapped(target)) {
+                back = 0;
+                target = address + written;
+            }
 
-            //write the first fewer than 8 bytes into the word
-            std::memcpy(word_data, data.begin() + written, remaining);
+            errno = 0;
+            word = ptrace(PTRACE_PEEKDATA, current_thread_, target.addr(), nullptr);
+            if (errno != 0) {
+                error::send_errno("Failed to write virtual memory");
+            }
 
-            //the remaining data we write in from what we read
-            std::memcpy(word_data + remaining, read.data() + remaining, 8 - remaining);
+            //the other bytes are already in the tracee, either from us or from around the buffer
+            std::memcpy(reinterpret_cast<char*>(&word) + back, data.begin() + written, remaining);
+            written += remaining;
         }
 
-        if (ptrace(PTRACE_POKEDATA, pid_, address + written, word) < 0) {
+        //the address space is shared, but only a stopped thread can be poked
+        if (ptrace(PTRACE_POKEDATA, current_thread_, target.addr(), word) < 0) {
             error::send_errno("Failed to write virtual memory");
         }
+    }
+}
 
-        //each iteration here writes 8 bytes to the inferior process
-        written += 8;
+std::vector<std::byte> sdb::Process::read_memory_partial(sdb::virt_addr address, size_t amount) const {
+    //clip to what is mapped so we never issue a read that is bound to fail
+    auto readable = get_memory_map().readable_extent(address, amount);
+    if (readable == 0) {
+        return {};
     }
+    return read_memory(address, readable);
+}
+
+const sdb::memory_map& sdb::Process::get_memory_map() const {
+    if (memory_map_stale_ or has_running_thread()) {
+        memory_map_.load(pid_);
+        memory_map_stale_ = false;
+    }
+    return memory_map_;
+}
+
+std::size_t sdb::Process::read_memory_batch(span<memory_read_request> requests) const {
+    //every request is split at page boundaries, the local and remote sides are split the same way
+    //so a partial transfer always ends on a whole piece
+    std::vector<iovec> local_descs;
+    std::vector<iovec> remote_descs;
+    std::vector<std::size_t> owners;
+
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+        auto& request = requests[i];
+        request.success = true;
+
+        for (std::size_t queued = 0; queued < request.data.size(); ) {
+            auto current = request.address + queued;
+            auto up_to_next_page = page_cache::page_size - (current.addr() & (page_cache::page_size - 1));
+            auto chunk_size = std::min(request.data.size() - queued, up_to_next_page);
+
+            local_descs.push_back({ request.data.begin() + queued, chunk_size });
+            remote_descs.push_back({ reinterpret_cast<void*>(current.addr()), chunk_size });
+            owners.push_back(i);
+            queued += chunk_size;
+        }
+    }
+
+    std::size_t pos = 0;
+    while (pos < local_descs.size()) {
+        auto count = std::min<std::size_t>(IOV_MAX, local_descs.size() - pos);
+        auto read = process_vm_readv(pid_, &local_descs[pos], count, &remote_descs[pos], count, /* flags=*/0);
+
+        //only an unreadable page is reported per request, anything else fails the whole batch
+        if (read < 0 and errno != EFAULT) {
+            error::send_errno("Error: could not read process memory with process_vm_readv");
+        }
+
+        //count the pieces that were transferred completely
+        std::size_t done = 0;
+        for (std::size_t bytes = 0; done < count; ++done) {
+            bytes += remote_descs[pos + done].iov_len;
+            if (read < 0 or bytes > static_cast<std::size_t>(read)) {
+                break;
+            }
+        }
+        pos += done;
+
+        if (done < count) {
+            //the piece at pos is unreadable, skip it and any following pieces on the same page
+            auto failed_page = page_cache::page_of(virt_addr{ reinterpret_cast<std::uint64_t>(remote_descs[pos].iov_base) });
+            do {
+                requests[owners[pos]].success = false;
+                ++pos;
+            } while (pos < remote_descs.size() and
+                     page_cache::page_of(virt_addr{ reinterpret_cast<std::uint64_t>(remote_descs[pos].iov_base) }) == failed_page);
+        }
+    }
+
+    //pages an rw software watchpoint made unreadable are still there through /proc/<pid>/mem
+    auto is_watched = [&](const memory_read_request& request) {
+        auto last = page_cache::page_of(request.address + (request.data.size() - 1));
+        for (auto page = page_cache::page_of(request.address); page <= last; page += page_cache::page_size) {
+            auto watched = watched_pages_.find(page);
+            if (watched != watched_pages_.end() and !(watched->second.protection & PROT_READ)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (auto& request : requests) {
+        if (!request.success and request.data.size() > 0 and is_watched(request)) {
+            request.success = pread(get_mem_fd(), request.data.begin(), request.data.size(), request.address.addr())
+                              == static_cast<ssize_t>(request.data.size());
+        }
+    }
+
+    return std::count_if(requests.begin(), requests.end(), [](auto& request) { return !request.success; });
 }
 
 std::vector<std::byte> sdb::Process::read_memory_without_traps(sdb::virt_addr address, size_t amount) const {
 
     //get the region of memory in that area
     auto memory = read_memory(address, amount); //std::vector
+    remove_traps(address, { memory.data(), memory.size() });
+    return memory;
+}
+
+void sdb::Process::remove_traps(virt_addr address, span<std::byte> memory) const {
+    auto amount = memory.size();
 
     //get the breakpoint sites in that region
     auto sites = breakpoint_sites_.get_in_region(address, address + amount);
@@ -512,7 +1300,8 @@ std::vector<std::byte> sdb::Process::read_memory_without_traps(sdb::virt_addr ad
     //replace `int3` instruction with actual instructions
     for (auto & site : sites) {
 
-        if (!site->is_enabled() or !site->is_hardware()) {
+        //hardware breakpoints never touch memory
+        if (!site->is_enabled() or site->is_hardware()) {
             continue;
         } 
         
@@ -522,7 +1311,19 @@ std::vector<std::byte> sdb::Process::read_memory_without_traps(sdb::virt_addr ad
         //replace with saved_data
         memory[offset.addr()] = site->saved_data_;
     }
-    return memory;
+
+    //the jmps of fast tracepoints, which may start before the region
+    tracepoints_.for_each([&](auto& tp) {
+        if (!tp.is_fast() or !tp.is_enabled()) {
+            return;
+        }
+        for (std::size_t i = 0; i < tp.patch_size(); ++i) {
+            auto byte = tp.address() + i;
+            if (byte >= address and byte < address + amount) {
+                memory[byte.addr() - address.addr()] = tp.original_code_[i];
+            }
+        }
+    });
 }
 
 int sdb::Process::set_hardware_breakpoint(watchpoint_site::id_type id, virt_addr address) {
@@ -538,17 +1339,19 @@ int sdb::Process::set_watchpoint(sdb::watchpoint_site::id_type id, virt_addr add
 
 int sdb::Process::set_hardware_stoppoint(virt_addr address, sdb::stoppoint_mode mode, std::size_t size) {
 
-    //read control register dr7
-    auto &regs = get_registers();
-    auto control = regs.read_by_id_as<std::uint64_t>(sdb::register_id::dr7);
+    //read control register dr7, every thread holds the same one
+    auto control = debug_registers_[7];
+
+    //threads that keep running in non-stop mode get the registers while briefly paused
+    auto paused = pause_running_threads();
 
     int free_space = find_free_stoppoint_register(control);
 
     //dr0, dr1, dr2, dr3 all follow in enum values so we convert it
     auto id = static_cast<int>(sdb::register_id::dr0) + free_space;
 
-    //write the address to that location
-    regs.write_by_id(static_cast<sdb::register_id>(id), address.addr());
+    //write the address to that location, in every thread
+    write_debug_register(static_cast<sdb::register_id>(id), address.addr());
 
     //encode bits for mode and size - set two bits at a time
     auto mode_flag = encode_hardware_stoppoint_mode(mode);
@@ -568,7 +1371,7 @@ int sdb::Process::set_hardware_stoppoint(virt_addr address, sdb::stoppoint_mode
     //get new control reg value
     masked |= enable_bit | mode_bits | size_bits;
 
-    regs.write_by_id(sdb::register_id::dr7, masked);
+    write_debug_register(sdb::register_id::dr7, masked);
 
     return free_space;
 }   
@@ -579,45 +1382,108 @@ void sdb::Process::clear_hardware_stoppoint(int index) {
     //id to reset debug register
     auto id = static_cast<int>(sdb::register_id::dr0) + index; 
 
-    //read control register dr7
-    auto &regs = get_registers();
-    auto control = regs.read_by_id_as<std::uint64_t>(sdb::register_id::dr7);
-
+    //read control register dr7, every thread holds the same one
+    auto control = debug_registers_[7];
+    auto paused = pause_running_threads();
 
     //reset the hardware breakpoint to point to address 0
-    regs.write_by_id(static_cast<sdb::register_id>(id), 0);
+    write_debug_register(static_cast<sdb::register_id>(id), 0);
 
     //mask and clear the relevant bits at register dr7
     auto clear_mask =  (0b11 << (id * 2)) | (0b1111 << (id * 4 + 16)); 
     auto masked = control & ~clear_mask;
-    regs.write_by_id(sdb::register_id::dr7, masked);
+    write_debug_register(sdb::register_id::dr7, masked);
 }
 
 /* this handles trap reason stop */
-void sdb::Process::augment_stop_reason(sdb::stop_reason& reason) {
-    siginfo_t info;
-    if (ptrace(PTRACE_GETSIGINFO, pid_, nullptr, &info) < 0) {
-        error::send_errno("Failed to get signal info");
+bool sdb::Process::read_syscall_stop(sdb::stop_reason& reason) {
+    __ptrace_syscall_info info;
+    if (ptrace(PTRACE_GET_SYSCALL_INFO, current_thread_, sizeof(info), &info) < 0) {
+        //kernels before 5.3, augment_stop_reason reads the registers instead
+        return false;
+    }
+
+    //a syscall made from scratch code, wait_for_stop has to move the pc back into the original code
+    auto pc = info.instruction_pointer;
+    if (scratch_code_.addr() != 0 and pc >= scratch_code_.addr() and
+        pc < scratch_code_.addr() + scratch_code_shadow_.size()) {
+        return false;
+    }
+
+    auto& sys_info = reason.syscall_info.emplace();
+    switch (info.op) {
+        case PTRACE_SYSCALL_INFO_ENTRY:
+            sys_info.entry = true;
+            sys_info.id = info.entry.nr;
+            std::copy(std::begin(info.entry.args), std::end(info.entry.args), sys_info.args.begin());
+            break;
+        case PTRACE_SYSCALL_INFO_SECCOMP:
+            sys_info.entry = true;
+            sys_info.id = info.seccomp.nr;
+            std::copy(std::begin(info.seccomp.args), std::end(info.seccomp.args), sys_info.args.begin());
+            break;
+        case PTRACE_SYSCALL_INFO_EXIT:
+            //the exit doesn't say which syscall it was, we remember from the entry unless we attached inside it
+            sys_info.entry = false;
+            sys_info.ret = info.exit.rval;
+            sys_info.id = current_thread_state().current_syscall ? *current_thread_state().current_syscall :
+                          get_registers().read_by_id_as<std::uint64_t>(register_id::orig_rax);
+            break;
+        default:
+            reason.syscall_info.reset();
+            return false;
+    }
+
+    finish_syscall_stop(reason);
+    return true;
+}
+
+void sdb::Process::finish_syscall_stop(sdb::stop_reason& reason) {
+    auto& thread = current_thread_state();
+    thread.skip_step_over = true;
+    auto& sys_info = *reason.syscall_info;
+    if (sys_info.entry) {
+        thread.current_syscall = sys_info.id;
+    } else {
+        thread.current_syscall.reset();
+    }
+
+    if (tracing_syscalls_) {
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (sys_info.entry) {
+            syscall_log_.record_entry(thread.tid, sys_info.id, sys_info.args, now);
+        } else if (syscall_log_.record_exit(thread.tid, sys_info.ret, now)) {
+            //buffers the syscall filled are only certain to hold what it returned right now
+            auto row = syscall_log_.size() - 1;
+            std::array<std::int64_t, 6> args;
+            for (std::size_t i = 0; i < args.size(); ++i) {
+                args[i] = syscall_log_.arg(row, i);
+            }
+            syscall_log_.set_text(row, decode_syscall(*this, syscall_log_.id(row), args, syscall_log_.ret(row)));
+        }
     }
 
-    // a SIGTRAP from a syscall => fill up syscall_info here
+    reason.info = SIGTRAP;
+    reason.trap_reason = sdb::trap_type::syscall;
+}
+
+void sdb::Process::augment_stop_reason(sdb::stop_reason& reason) {
+    // a SIGTRAP from a syscall that read_syscall_stop couldn't decode => fill up syscall_info from the registers
     if (reason.info == (SIGTRAP | 0x80)) {
         auto& sys_info = reason.syscall_info.emplace();
         auto &regs = get_registers();
+        sys_info.id = regs.read_by_id_as<std::uint64_t>(sdb::register_id::orig_rax);
 
         //expecting a syscall exit
-        if (expecting_syscall_exit_) {
+        if (current_thread_state().current_syscall) {
             sys_info.entry = false;
 
             //return value of a syscall gets stored in rax
             sys_info.ret = regs.read_by_id_as<std::uint64_t>(sdb::register_id::rax);
-            sys_info.id = regs.read_by_id_as<std::uint64_t>(sdb::register_id::orig_rax);
-
-            expecting_syscall_exit_ = false;
         } else {
             //in a syscall entry
             sys_info.entry = true;
-            sys_info.id = regs.read_by_id_as<std::uint64_t>(sdb::register_id::orig_rax);
 
             std::array<sdb::register_id, 6> args_reg =  {
                 sdb::register_id::rdi, sdb::register_id::rsi, sdb::register_id::rdx,
@@ -627,20 +1493,22 @@ void sdb::Process::augment_stop_reason(sdb::stop_reason& reason) {
             for (auto i = 0; i < 6; ++i) {
                 sys_info.args[i] = regs.read_by_id_as<std::uint64_t>(args_reg[i]);
             }
-
-            expecting_syscall_exit_ = true;
         }
 
-
-        reason.info = SIGTRAP; 
-        reason.trap_reason = sdb::trap_type::syscall;
+        finish_syscall_stop(reason);
         return;
     }
 
-    expecting_syscall_exit_ = false; //didn't stop from a syscall
+    current_thread_state().current_syscall.reset(); //didn't stop from a syscall
 
+    //group-stops have no siginfo, only traps need it
     reason.trap_reason = sdb::trap_type::unknown;
     if (reason.info == SIGTRAP) {
+        siginfo_t info;
+        if (ptrace(PTRACE_GETSIGINFO, current_thread_, nullptr, &info) < 0) {
+            error::send_errno("Failed to get signal info");
+        }
+
         switch (info.si_code) {
             case TRAP_TRACE:
                 reason.trap_reason = sdb::trap_type::single_step;
@@ -652,7 +1520,6 @@ void sdb::Process::augment_stop_reason(sdb::stop_reason& reason) {
                 reason.trap_reason = sdb::trap_type::hardware_break;
                 break;
         }
-
     }
 }
 
@@ -685,27 +1552,25 @@ sdb::Process::get_current_hardware_stoppoint() const {
     }
 }
 
-sdb::stop_reason sdb::Process::maybe_resume_from_syscall(const stop_reason& reason) {
-    
-
-    if (syscall_catch_policy_.get_mode() == sdb::syscall_catch_policy::mode::some) {
-        auto to_catch = syscall_catch_policy_.get_to_catch();
-
-        auto found = std::find(begin(to_catch), end(to_catch), reason.syscall_info->id);
+bool sdb::Process::is_syscall_caught(const stop_reason& reason) {
+    auto mode = syscall_catch_policy_.get_mode();
+    auto& to_catch = syscall_catch_policy_.get_to_catch();
 
-        /* current signal is not in the list so go through the next set of syscalls and determine them */
-        if (found == end(to_catch)) {
-            resume();
-            return wait_on_signal();
-        }
+    if (mode == sdb::syscall_catch_policy::mode::all or (mode == sdb::syscall_catch_policy::mode::some and
+        std::find(begin(to_catch), end(to_catch), reason.syscall_info->id) != end(to_catch))) {
+        return true;
     }
 
-    /* syscall_catch_policy is none so we are not tracing any syscalls*/
-    return reason;
+    /* filters from an earlier policy still stop on syscalls that are no longer caught, such a stop
+       has no exit to wait for unless every syscall is being traced */
+    if (!tracing_syscalls_ and (mode == sdb::syscall_catch_policy::mode::none or syscall_filter_ready_)) {
+        current_thread_state().current_syscall.reset();
+    }
+    return false;
 }
 
 std::unordered_map<int, std::uint64_t> sdb::Process::get_aux_vect() const {
-    std::ifstream auxv("/" + std::to_string(pid_) + "/auxv");
+    std::ifstream auxv("/proc/" + std::to_string(pid_) + "/auxv");
 
     std::unordered_map<int, std::uint64_t> ret;
     std::uint64_t id, value;
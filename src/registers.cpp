@@ -41,7 +41,68 @@ namespace {
 
 }
 
+namespace {
+    /* DR0-DR7 index of a debug register */
+    int debug_register_index(const sdb::register_info& info) {
+        return (info.offset - offsetof(user, u_debugreg)) / sizeof(user::u_debugreg[0]);
+    }
+}
+
+void sdb::registers::load_gprs() const {
+    if (!gprs_loaded_) {
+        proc_->read_gprs(tid_, data_.regs);
+        gprs_loaded_ = true;
+    }
+}
+
+void sdb::registers::load_fprs() const {
+    if (!fprs_loaded_) {
+        proc_->read_fprs(tid_, data_.i387);
+        fprs_loaded_ = true;
+    }
+}
+
+void sdb::registers::load_debug_register(int index) const {
+    if (!(debug_registers_loaded_ & (1 << index))) {
+        data_.u_debugreg[index] = proc_->read_debug_register(tid_, index);
+        debug_registers_loaded_ |= 1 << index;
+    }
+}
+
+void sdb::registers::load(const register_info& info) const {
+    switch (info.type) {
+        case register_type::gpr:
+        case register_type::sub_gpr: load_gprs(); break;
+        case register_type::fpr: load_fprs(); break;
+        case register_type::dr: load_debug_register(debug_register_index(info)); break;
+    }
+}
+
+void sdb::registers::flush() {
+    if (gprs_dirty_) {
+        proc_->write_gprs(data_.regs, tid_);
+        gprs_dirty_ = false;
+    }
+    if (fprs_dirty_) {
+        proc_->write_fprs(data_.i387, tid_);
+        fprs_dirty_ = false;
+    }
+}
+
+void sdb::registers::invalidate() {
+    gprs_loaded_ = fprs_loaded_ = false;
+    gprs_dirty_ = fprs_dirty_ = false;
+    debug_registers_loaded_ &= ~(1 << 6);
+}
+
+void sdb::registers::invalidate_all() {
+    invalidate();
+    debug_registers_loaded_ = 0;
+}
+
 sdb::registers::value sdb::registers::read(const register_info& info) const {
+    load(info);
+
     /* retrieve registers' raw bytes and reinterpret them as std::bytes */
     auto bytes = sdb::as_bytes(data_); 
     //auto offset = info.offset;
@@ -73,6 +134,9 @@ sdb::registers::value sdb::registers::read(const register_info& info) const {
 * @param val  value to write into register_info struct
 */
 void sdb::registers::write(const register_info& info, value val) {
+    /* sub-registers and partial FPR writes modify what the tracee already holds */
+    load(info);
+
     /* retrieve registers' raw bytes and reinterpret them as std::bytes */
     auto bytes = sdb::as_bytes(data_); 
 
@@ -92,16 +156,18 @@ void sdb::registers::write(const register_info& info, value val) {
         }
     }, val);
 
-    /* write to all fprs */
+    /* GPRs and FPRs go out in one batch before the tracee runs */
     if (info.type == register_type::fpr) {
-        proc_->write_fprs(data_.i387);
+        fprs_dirty_ = true;
     }
-    else {
-        /* write to a single GPR or debug register value */
-        /* align to 8-byte boundary */
+    else if (info.type == register_type::dr) {
+        /* the kernel validates debug registers as they are written, so errors surface here */
         auto aligned_offset = info.offset & ~0b111;
         proc_->write_user_area(aligned_offset,
-                            from_bytes<std::uint64_t>(bytes + aligned_offset));
+                            from_bytes<std::uint64_t>(bytes + aligned_offset), tid_);
+    }
+    else {
+        gprs_dirty_ = true;
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+#include "relocation.hpp"
+
+namespace {
+    constexpr std::size_t page_size = sdb::page_cache::page_size;
+
+    /* a page of displaced instruction slots, then room for a few hundred trampolines */
+    constexpr std::size_t scratch_code_size = 16 * page_size;
+
+    /* closest address to near where size bytes are free, between existing mappings */
+    sdb::virt_addr find_free_space_near(const sdb::memory_map& map, sdb::virt_addr near, std::size_t size) {
+        std::uint64_t best = 0;
+        std::uint64_t best_distance = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t gap_low = 0x10000;    //below vm.mmap_min_addr mmap always fails
+
+        auto consider = [&](std::uint64_t low, std::uint64_t high) {
+            if (high <= low or high - low < size) {
+                return;
+            }
+            auto candidate = near.addr() < low ? low : high - size;
+            auto distance = candidate > near.addr() ? candidate - near.addr() : near.addr() - candidate;
+            if (candidate >= low and distance < best_distance) {
+                best = candidate;
+                best_distance = distance;
+            }
+        };
+
+        for (auto& region : map) {
+            consider(gap_low, region.low.addr());
+            gap_low = std::max(gap_low, region.high.addr());
+        }
+
+        if (best == 0 or !sdb::relocation::fits_in_int32(best_distance + size)) {
+            sdb::error::send("No free memory within jump range for scratch code");
+        }
+        return sdb::virt_addr{ best };
+    }
+}
+
+void sdb::Process::setup_scratch_code(virt_addr near) {
+    auto address = find_free_space_near(get_memory_map(), near, scratch_code_size);
+
+    //we write code through /proc/<pid>/mem, the tracee only needs to run it
+    auto code = inject_syscall(SYS_mmap, { address.addr(), scratch_code_size, PROT_READ | PROT_EXEC,
+                                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                                           std::uint64_t(-1), 0 });
+    if (code < 0) {
+        error::send("Could not map scratch code into the process");
+    }
+    //kernels before 4.17 take MAP_FIXED_NOREPLACE as a hint
+    if (static_cast<std::uint64_t>(code) != address.addr()) {
+        inject_syscall(SYS_munmap, { std::uint64_t(code), scratch_code_size });
+        error::send("Could not map scratch code into the process");
+    }
+
+    scratch_code_ = address;
+    scratch_code_used_ = page_size;
+    scratch_code_shadow_.assign(scratch_code_size, std::byte{ 0 });
+}
+
+void sdb::Process::write_scratch_code(virt_addr address, span<const std::byte> code) {
+    write_memory(address, code, memory_write_path::proc_mem);
+    std::copy(code.begin(), code.end(), scratch_code_shadow_.begin() + (address.addr() - scratch_code_.addr()));
+}
+
+sdb::virt_addr sdb::Process::allocate_scratch_code(span<const std::byte> code) {
+    auto address = scratch_code_ + scratch_code_used_;
+    if (scratch_code_used_ + code.size() > scratch_code_size) {
+        error::send("Out of scratch code space");
+    }
+    write_scratch_code(address, code);
+
+    //keep trampolines on cache line boundaries
+    scratch_code_used_ += (code.size() + 63) & ~std::size_t(63);
+    return address;
+}
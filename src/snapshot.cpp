@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <libsdb/snapshot.hpp>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+#include "simd.hpp"
+
+namespace {
+    /* flags in each 64-bit /proc/<pid>/pagemap entry, see Documentation/admin-guide/mm/pagemap.rst */
+    constexpr std::uint64_t pagemap_soft_dirty = 1ull << 55;
+
+    constexpr std::size_t page_size = sdb::page_cache::page_size;
+
+    std::size_t pages_in(std::uint64_t size) {
+        return (size + page_size - 1) / page_size;
+    }
+
+    /* unlinked file in the temp directory so large snapshots can be paged out to disk */
+    int create_backing_file() {
+        auto dir = std::filesystem::temp_directory_path();
+        auto fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (fd >= 0) {
+            return fd;
+        }
+
+        //filesystems without O_TMPFILE, create and unlink straight away
+        auto path = (dir / "sdb-snapshot-XXXXXX").string();
+        fd = mkostemp(path.data(), O_CLOEXEC);
+        if (fd < 0) {
+            sdb::error::send_errno("Could not create snapshot file");
+        }
+        unlink(path.c_str());
+        return fd;
+    }
+
+    /* pagemap entries for the pages of [low, low + pages * page_size) */
+    std::vector<std::uint64_t> read_pagemap(int fd, sdb::virt_addr low, std::size_t pages) {
+        std::vector<std::uint64_t> entries(pages);
+        auto size = pages * sizeof(std::uint64_t);
+        auto offset = low.addr() / page_size * sizeof(std::uint64_t);
+
+        if (pread(fd, entries.data(), size, offset) != static_cast<ssize_t>(size)) {
+            sdb::error::send_errno("Could not read pagemap");
+        }
+        return entries;
+    }
+
+    /* start a new soft-dirty interval - every page is considered clean from here on */
+    bool clear_soft_dirty(pid_t pid) {
+        auto path = "/proc/" + std::to_string(pid) + "/clear_refs";
+        auto fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        auto ok = write(fd, "4", 1) == 1;
+        close(fd);
+        return ok;
+    }
+}
+
+sdb::snapshot::snapshot(id_type id, std::vector<region> regions)
+    : id_(id), regions_(std::move(regions)) {
+    //lay the regions out back to back in the file
+    for (auto& r : regions_) {
+        r.file_offset = size_;
+        r.fetched.assign(pages_in(r.size()), true);
+        size_ += r.size();
+    }
+
+    fd_ = create_backing_file();
+    if (ftruncate(fd_, size_) < 0) {
+        close(fd_);
+        error::send_errno("Could not size snapshot file");
+    }
+
+    if (size_ > 0) {
+        auto ret = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (ret == MAP_FAILED) {
+            close(fd_);
+            error::send_errno("Could not map snapshot file");
+        }
+        data_ = reinterpret_cast<std::byte*>(ret);
+    }
+}
+
+sdb::snapshot::~snapshot() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+    close(fd_);
+}
+
+sdb::snapshot& sdb::Process::take_snapshot() {
+    //every writable mapping, read-only ones can't change under us. Pages software watchpoints protected count as they were
+    std::vector<snapshot::region> regions;
+    for (auto& mapped : get_memory_map()) {
+        auto r = unwatched_region(mapped);
+        if (r.readable and r.writable) {
+            regions.push_back({ r.low, r.high, r.path, 0, {} });
+        }
+    }
+
+    auto id = snapshots_.empty() ? 1 : snapshots_.back()->id() + 1;
+    std::unique_ptr<snapshot> snap(new snapshot(id, std::move(regions)));
+
+    auto pagemap_path = "/proc/" + std::to_string(pid_) + "/pagemap";
+    auto pagemap = open(pagemap_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (pagemap < 0) {
+        error::send_errno("Could not open " + pagemap_path);
+    }
+
+    //clean pages are copied from the previous snapshot when the kernel tracks soft-dirty bits for us
+    const snapshot* base = soft_dirty_tracking_ and !snapshots_.empty() ? snapshots_.back().get() : nullptr;
+    bool saw_soft_dirty = false;
+
+    std::vector<memory_read_request> requests;
+    try {
+        for (auto& r : snap->regions_) {
+            auto entries = read_pagemap(pagemap, r.low, r.fetched.size());
+            saw_soft_dirty |= std::any_of(entries.begin(), entries.end(),
+                                          [](auto entry) { return entry & pagemap_soft_dirty; });
+
+            auto old = base ? std::find_if(base->regions().begin(), base->regions().end(),
+                                           [&](auto& o) { return o.low == r.low and o.high == r.high; })
+                            : std::vector<snapshot::region>::const_iterator{};
+            bool has_old = base and old != base->regions().end();
+
+            for (std::size_t page = 0; page < r.fetched.size(); ++page) {
+                auto offset = page * page_size;
+                auto size = std::min<std::uint64_t>(page_size, r.size() - offset);
+
+                if (has_old and !(entries[page] & pagemap_soft_dirty)) {
+                    r.fetched[page] = false;
+                    std::copy(base->data(*old) + offset, base->data(*old) + offset + size,
+                              snap->data(r) + offset);
+                    continue;
+                }
+
+                //extend the previous request when pages are contiguous
+                auto address = r.low + offset;
+                if (!requests.empty() and requests.back().address + requests.back().data.size() == address) {
+                    auto& last = requests.back();
+                    last.data = { last.data.begin(), last.data.size() + size };
+                } else {
+                    requests.push_back({ address, { snap->data(r) + offset, size } });
+                }
+                ++snap->pages_fetched_;
+            }
+        }
+    } catch (...) {
+        close(pagemap);
+        throw;
+    }
+    close(pagemap);
+
+    //unreadable pages are left zeroed
+    read_memory_batch({ requests.data(), requests.size() });
+    snap->base_id_ = base ? base->id() : 0;
+
+    //a kernel without CONFIG_MEM_SOFT_DIRTY never reports the bit, keep taking full snapshots there
+    if (!base) {
+        soft_dirty_tracking_ = saw_soft_dirty;
+    }
+    if (soft_dirty_tracking_) {
+        soft_dirty_tracking_ = clear_soft_dirty(pid_);
+    }
+
+    snapshots_.push_back(std::move(snap));
+    return *snapshots_.back();
+}
+
+const sdb::snapshot& sdb::Process::get_snapshot(snapshot::id_type id) const {
+    auto it = std::find_if(snapshots_.begin(), snapshots_.end(), [=](auto& snap) { return snap->id() == id; });
+    if (it == snapshots_.end()) {
+        error::send("Invalid snapshot id");
+    }
+    return **it;
+}
+
+sdb::snapshot_diff sdb::diff_snapshots(const snapshot& before, const snapshot& after) {
+    snapshot_diff diff;
+    auto incremental = after.base_id() == before.id();
+
+    auto add_range = [&](virt_addr address, std::size_t size) {
+        //runs that continue across a page boundary become one range
+        if (!diff.ranges.empty()) {
+            auto& last = diff.ranges.back();
+            if (last.address + last.size == address) {
+                last.size += size;
+                return;
+            }
+        }
+        diff.ranges.push_back({ address, size });
+    };
+
+    for (auto& a : after.regions()) {
+        for (auto& b : before.regions()) {
+            auto low = std::max(a.low, b.low);
+            auto high = std::min(a.high, b.high);
+            if (low >= high) {
+                continue;
+            }
+
+            auto lhs = before.data(b) + (low.addr() - b.low.addr());
+            auto rhs = after.data(a) + (low.addr() - a.low.addr());
+            auto first_page = (low.addr() - a.low.addr()) / page_size;
+
+            for (std::uint64_t offset = 0; offset < high.addr() - low.addr(); offset += page_size) {
+                //pages copied from before can't differ from it
+                if (incremental and !a.fetched[first_page + offset / page_size]) {
+                    continue;
+                }
+
+                auto size = std::min<std::uint64_t>(page_size, high.addr() - low.addr() - offset);
+                ++diff.pages_compared;
+
+                bool changed = false;
+                for (std::size_t pos = simd::mismatch(lhs + offset, rhs + offset, size); pos < size;
+                     pos += simd::mismatch(lhs + offset + pos, rhs + offset + pos, size - pos)) {
+                    auto end = pos;
+                    while (end < size and lhs[offset + end] != rhs[offset + end]) {
+                        ++end;
+                    }
+
+                    add_range(low + offset + pos, end - pos);
+                    changed = true;
+                    pos = end;
+                }
+
+                if (changed) {
+                    ++diff.pages_changed;
+                }
+            }
+        }
+    }
+
+    return diff;
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+
+/*
+* Software watchpoints
+*
+* Debug registers watch at most four aligned 1 to 8 byte locations. Software watchpoints take away write
+* access, or all access for rw, from every page a range covers, so the tracee faults on the first touch.
+* wait_on_signal catches the SIGSEGV, gives the page its protection back for one single step and takes it
+* away again. Accesses to the rest of the page are false positives and are stepped past without stopping.
+*/
+
+namespace {
+    constexpr std::size_t page_size = sdb::page_cache::page_size;
+
+    int protection_of(const sdb::memory_region& region) {
+        return (region.readable ? PROT_READ : 0) | (region.writable ? PROT_WRITE : 0) |
+               (region.executable ? PROT_EXEC : 0);
+    }
+
+    /* where a watchpoint and a page overlap */
+    struct watched_range {
+        sdb::watchpoint_site* site;
+        sdb::virt_addr low;
+        std::size_t size;
+        std::vector<std::byte> before;
+    };
+}
+
+void sdb::Process::protect_watched_pages(virt_addr low, virt_addr high) {
+    //a process that's gone took its pages with it
+    if (state_ == process_state::exited or state_ == process_state::terminated) {
+        watched_pages_.clear();
+        return;
+    }
+
+    auto wanted = [&](std::uint64_t page, int original) {
+        auto protection = original;
+        watchpoints_.for_each([&](auto& site) {
+            if (site.is_software() and site.is_enabled() and
+                site.address().addr() < page + page_size and site.address().addr() + site.size() > page) {
+                protection &= site.mode() == stoppoint_mode::write ? ~PROT_WRITE : PROT_NONE;
+            }
+        });
+        return protection;
+    };
+
+    //consecutive pages changing to the same protection go out as one mprotect
+    std::uint64_t run_low = 0;
+    std::uint64_t run_high = 0;
+    int run_protection = -1;
+    auto flush = [&] {
+        if (run_low == run_high) {
+            return;
+        }
+        if (inject_syscall(SYS_mprotect, { run_low, run_high - run_low, std::uint64_t(run_protection) }) < 0) {
+            error::send("Could not change the protection of watched memory");
+        }
+        memory_map_stale_ = true;
+        run_low = run_high = 0;
+    };
+
+    auto first = page_cache::page_of(low);
+    auto last = page_cache::page_of(high - 1);
+    for (auto page = first; page <= last; page += page_size) {
+        auto it = watched_pages_.find(page);
+        int original;
+        if (it != watched_pages_.end()) {
+            original = it->second.original_protection;
+        } else {
+            //pages we never touched still have the protection the maps file shows
+            auto region = get_memory_map().find(virt_addr{ page });
+            if (!region) {
+                error::send("Software watchpoint covers unmapped memory");
+            }
+            original = protection_of(*region);
+        }
+
+        auto current = it != watched_pages_.end() ? it->second.protection : original;
+        auto protection = wanted(page, original);
+        if (protection == original) {
+            watched_pages_.erase(page);
+        } else {
+            watched_pages_[page] = { original, protection };
+        }
+
+        if (protection == current) {
+            continue;
+        }
+        if (protection != run_protection or page != run_high) {
+            flush();
+            run_low = page;
+            run_protection = protection;
+        }
+        run_high = page + page_size;
+    }
+    flush();
+}
+
+void sdb::Process::restore_watched_pages() {
+    //any stopped thread outside a syscall can make the calls, the pages belong to the whole process
+    auto thread = std::find_if(threads_.begin(), threads_.end(), [](auto& entry) {
+        return entry.second.state == process_state::stopped and !entry.second.current_syscall;
+    });
+    if (thread != threads_.end()) {
+        on_thread(thread->first, [&] {
+            for (auto& [page, watched] : watched_pages_) {
+                inject_syscall(SYS_mprotect, { page, page_size, std::uint64_t(watched.original_protection) });
+            }
+        });
+    }
+    watched_pages_.clear();
+    memory_map_stale_ = true;
+}
+
+sdb::memory_region sdb::Process::unwatched_region(const memory_region& region) const {
+    //mprotect splits mappings, a region holding a watched page is made of pages watched alike
+    auto result = region;
+    auto it = watched_pages_.lower_bound(region.low.addr());
+    if (it != watched_pages_.end() and it->first < region.high.addr()) {
+        auto original = it->second.original_protection;
+        result.readable = original & PROT_READ;
+        result.writable = original & PROT_WRITE;
+        result.executable = original & PROT_EXEC;
+    }
+    return result;
+}
+
+bool sdb::Process::handle_software_watch_fault(stop_reason& reason) {
+    if (reason.reason != process_state::stopped or reason.info != SIGSEGV or watched_pages_.empty()) {
+        return false;
+    }
+
+    siginfo_t info;
+    if (ptrace(PTRACE_GETSIGINFO, current_thread_, nullptr, &info) < 0) {
+        error::send_errno("Failed to get signal info");
+    }
+    auto fault = virt_addr{ reinterpret_cast<std::uint64_t>(info.si_addr) };
+    auto page = page_cache::page_of(fault);
+    auto it = watched_pages_.find(page);
+    if (info.si_code != SEGV_ACCERR or it == watched_pages_.end()) {
+        return false;
+    }
+    ++software_watch_stats_.faults;
+
+    //on a write-protected page only writes fault
+    bool was_write = (it->second.protection & PROT_READ) != 0;
+
+    //the instruction runs with the page as it was, the fault is taken again if it touches another watched page.
+    //Other threads would get past the watch unseen meanwhile, they wait until the page is protected again
+    auto paused = pause_running_threads();
+    if (inject_syscall(SYS_mprotect, { page, page_size, std::uint64_t(it->second.original_protection) }) < 0) {
+        error::send("Could not change the protection of watched memory");
+    }
+
+    std::vector<watched_range> ranges;
+    watchpoints_.for_each([&](auto& site) {
+        auto low = std::max(site.address().addr(), page);
+        auto high = std::min(site.address().addr() + site.size(), page + page_size);
+        if (site.is_software() and site.is_enabled() and low < high) {
+            ranges.push_back({ &site, virt_addr{ low }, high - low, read_memory(virt_addr{ low }, high - low) });
+        }
+    });
+
+    auto stepped = step_instruction();
+    if (state_ != process_state::stopped) {
+        reason = stepped;
+        return false;
+    }
+    it = watched_pages_.find(page);
+    if (it != watched_pages_.end()) {
+        inject_syscall(SYS_mprotect, { page, page_size, std::uint64_t(it->second.protection) });
+    }
+    memory_map_stale_ = true;
+
+    //something else stopped the step, a hit on another page or a hardware stoppoint, report that instead
+    if (stepped.trap_reason != trap_type::single_step) {
+        reason = stepped;
+        return false;
+    }
+
+    for (auto& range : ranges) {
+        auto& site = *range.site;
+        bool in_range = fault >= site.address() and fault < site.address() + site.size();
+        bool changed = read_memory(range.low, range.size) != range.before;
+        bool hit = site.mode() == stoppoint_mode::write ? changed or (in_range and was_write) : in_range;
+        if (hit) {
+            ++software_watch_stats_.hits;
+            site.update_data();
+            reason = stepped;
+            reason.trap_reason = trap_type::software_watch;
+            reason.software_watchpoint = site.id();
+            return false;
+        }
+    }
+
+    ++software_watch_stats_.false_positives;
+    reason = stepped;
+    return true;
+}
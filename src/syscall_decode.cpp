@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <libsdb/syscalls.hpp>
+#include <libsdb/process.hpp>
+#include <libsdb/page_cache.hpp>
+
+/*
+* Typed rendering of syscall arguments, driven by the compile-time signature table in syscalls.cpp
+*
+* Decoding runs at every syscall stop of a trace, so the tracee memory behind string and buffer arguments is
+* fetched with one read_memory_batch for all of them rather than a read per argument or per byte
+*/
+
+namespace {
+    /* strings and buffers are clipped to this many bytes, like strace */
+    constexpr std::size_t max_shown_bytes = 32;
+
+    struct flag_name {
+        std::uint64_t value;
+        std::string_view name;
+    };
+
+    constexpr flag_name open_flag_names[] = {
+        { O_CREAT, "O_CREAT" }, { O_EXCL, "O_EXCL" }, { O_NOCTTY, "O_NOCTTY" }, { O_TRUNC, "O_TRUNC" },
+        { O_APPEND, "O_APPEND" }, { O_NONBLOCK, "O_NONBLOCK" }, { O_DIRECTORY, "O_DIRECTORY" },
+        { O_NOFOLLOW, "O_NOFOLLOW" }, { O_CLOEXEC, "O_CLOEXEC" }, { O_DIRECT, "O_DIRECT" },
+        { O_NOATIME, "O_NOATIME" }, { O_PATH, "O_PATH" },
+    };
+
+    constexpr flag_name mmap_prot_names[] = {
+        { PROT_READ, "PROT_READ" }, { PROT_WRITE, "PROT_WRITE" }, { PROT_EXEC, "PROT_EXEC" },
+    };
+
+    constexpr flag_name mmap_flag_names[] = {
+        { MAP_SHARED, "MAP_SHARED" }, { MAP_PRIVATE, "MAP_PRIVATE" }, { MAP_FIXED, "MAP_FIXED" },
+        { MAP_ANONYMOUS, "MAP_ANONYMOUS" }, { MAP_GROWSDOWN, "MAP_GROWSDOWN" }, { MAP_DENYWRITE, "MAP_DENYWRITE" },
+        { MAP_NORESERVE, "MAP_NORESERVE" }, { MAP_POPULATE, "MAP_POPULATE" }, { MAP_STACK, "MAP_STACK" },
+        { MAP_FIXED_NOREPLACE, "MAP_FIXED_NOREPLACE" },
+    };
+
+    constexpr std::string_view signal_names[] = {
+        "0", "SIGHUP", "SIGINT", "SIGQUIT", "SIGILL", "SIGTRAP", "SIGABRT", "SIGBUS", "SIGFPE", "SIGKILL",
+        "SIGUSR1", "SIGSEGV", "SIGUSR2", "SIGPIPE", "SIGALRM", "SIGTERM", "SIGSTKFLT", "SIGCHLD", "SIGCONT",
+        "SIGSTOP", "SIGTSTP", "SIGTTIN", "SIGTTOU", "SIGURG", "SIGXCPU", "SIGXFSZ", "SIGVTALRM", "SIGPROF",
+        "SIGWINCH", "SIGIO", "SIGPWR", "SIGSYS",
+    };
+
+    /* "0x" prefixed for hex, "0" prefixed for octal */
+    std::string to_base(std::uint64_t value, int base) {
+        char digits[24];
+        auto end = std::to_chars(digits, digits + sizeof(digits), value, base).ptr;
+        return (base == 16 ? "0x" : value != 0 and base == 8 ? "0" : "") + std::string(digits, end);
+    }
+
+    /* "A|B|0x40", bits without a name are left over in hex */
+    template <std::size_t N>
+    std::string format_flags(std::uint64_t value, const flag_name (&names)[N], std::string prefix = "") {
+        std::string out = std::move(prefix);
+        for (auto& flag : names) {
+            if ((value & flag.value) == flag.value) {
+                out += out.empty() ? "" : "|";
+                out += flag.name;
+                value &= ~flag.value;
+            }
+        }
+        if (value != 0 or out.empty()) {
+            out += (out.empty() ? "" : "|") + to_base(value, 16);
+        }
+        return out;
+    }
+
+    std::string format_open_flags(std::uint64_t value) {
+        auto access = value & O_ACCMODE;
+        std::string mode = access == O_RDONLY ? "O_RDONLY" : access == O_WRONLY ? "O_WRONLY" :
+                           access == O_RDWR ? "O_RDWR" : to_base(access, 16);
+        return format_flags(value & ~std::uint64_t(O_ACCMODE), open_flag_names, std::move(mode));
+    }
+
+    /* C-escaped and quoted, with "..." after it when the data went on */
+    std::string quote(const std::byte* data, std::size_t size, bool clipped) {
+        std::string out = "\"";
+        for (std::size_t i = 0; i < size; ++i) {
+            auto c = static_cast<unsigned char>(data[i]);
+            switch (c) {
+                case '\n': out += "\\n"; break;
+                case '\t': out += "\\t"; break;
+                case '\r': out += "\\r"; break;
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                default:
+                    if (c >= 0x20 and c < 0x7f) {
+                        out += static_cast<char>(c);
+                    } else {
+                        constexpr char hex_digits[] = "0123456789abcdef";
+                        out += { '\\', 'x', hex_digits[c >> 4], hex_digits[c & 0xf] };
+                    }
+            }
+        }
+        out += clipped ? "\"..." : "\"";
+        return out;
+    }
+
+    /* tracee memory wanted for one argument */
+    struct pending_read {
+        std::size_t arg;
+        std::size_t size;       /* bytes the argument holds, or 0 for a string of unknown length */
+        std::size_t offset;     /* into the shared buffer */
+        std::size_t requested;
+    };
+}
+
+std::string sdb::decode_syscall(const Process& proc, int id, const std::array<std::int64_t, 6>& args,
+                                std::optional<std::int64_t> ret) {
+    auto signature = get_syscall_signature(id);
+    auto returned = ret and *ret >= 0 ? static_cast<std::uint64_t>(*ret) : 0;
+    std::array<syscall_arg_type, 6> types{};
+    if (signature) {
+        types = *signature;
+    } else {
+        types.fill({ syscall_arg_kind::hex });
+    }
+
+    //queue the reads of every string and buffer, strings stop at the page end so they never fault on
+    //a mapping boundary, the few that run over it get a second batch
+    std::array<std::byte, 6 * (max_shown_bytes + 1)> buffer;
+    std::vector<pending_read> reads;
+    std::vector<memory_read_request> requests;
+    for (std::size_t i = 0; i < types.size(); ++i) {
+        auto address = static_cast<std::uint64_t>(args[i]);
+        std::size_t size = 0;
+        switch (types[i].kind) {
+            case syscall_arg_kind::string:
+                size = max_shown_bytes + 1;
+                break;
+            case syscall_arg_kind::buffer:
+                size = static_cast<std::uint64_t>(args[types[i].length_arg]);
+                break;
+            case syscall_arg_kind::out_buffer:
+                size = std::min<std::uint64_t>(returned, args[types[i].length_arg]);
+                break;
+            default:
+                continue;
+        }
+        if (address == 0 or size == 0) {
+            continue;
+        }
+
+        auto offset = reads.size() * (max_shown_bytes + 1);
+        auto requested = std::min(size, max_shown_bytes + 1);
+        if (types[i].kind == syscall_arg_kind::string) {
+            auto up_to_next_page = page_cache::page_size - (address & (page_cache::page_size - 1));
+            requested = std::min(requested, up_to_next_page);
+            size = 0;
+        }
+        reads.push_back({ i, size, offset, requested });
+        requests.push_back({ virt_addr{ address }, { buffer.data() + offset, requested } });
+    }
+    proc.read_memory_batch({ requests.data(), requests.size() });
+
+    std::vector<memory_read_request> rest;
+    std::vector<std::size_t> rest_owners;
+    for (std::size_t r = 0; r < reads.size(); ++r) {
+        auto& read = reads[r];
+        auto begin = buffer.data() + read.offset;
+        if (read.size == 0 and requests[r].success and read.requested < max_shown_bytes + 1 and
+            std::find(begin, begin + read.requested, std::byte{ 0 }) == begin + read.requested) {
+            rest.push_back({ requests[r].address + read.requested,
+                             { begin + read.requested, max_shown_bytes + 1 - read.requested } });
+            rest_owners.push_back(r);
+        }
+    }
+    if (!rest.empty()) {
+        proc.read_memory_batch({ rest.data(), rest.size() });
+    }
+    for (std::size_t i = 0; i < rest.size(); ++i) {
+        if (rest[i].success) {
+            reads[rest_owners[i]].requested = max_shown_bytes + 1;
+        }
+    }
+
+    std::string out = syscall_display_name(id) + "(";
+    std::size_t next_read = 0;
+    for (std::size_t i = 0; i < types.size() and types[i].kind != syscall_arg_kind::none; ++i) {
+        auto value = args[i];
+        auto unsigned_value = static_cast<std::uint64_t>(value);
+        std::string text;
+        switch (types[i].kind) {
+            case syscall_arg_kind::signed_int: text = std::to_string(value); break;
+            case syscall_arg_kind::unsigned_int: text = std::to_string(unsigned_value); break;
+            case syscall_arg_kind::octal: text = to_base(unsigned_value, 8); break;
+            case syscall_arg_kind::fd:
+                text = static_cast<int>(value) == AT_FDCWD ? "AT_FDCWD" : std::to_string(static_cast<int>(value));
+                break;
+            case syscall_arg_kind::open_flags: text = format_open_flags(unsigned_value); break;
+            case syscall_arg_kind::mmap_prot:
+                text = unsigned_value == PROT_NONE ? "PROT_NONE" : format_flags(unsigned_value, mmap_prot_names);
+                break;
+            case syscall_arg_kind::mmap_flags: text = format_flags(unsigned_value, mmap_flag_names); break;
+            case syscall_arg_kind::signal:
+                text = unsigned_value < std::size(signal_names) ? std::string(signal_names[unsigned_value])
+                                                                : std::to_string(value);
+                break;
+            case syscall_arg_kind::pointer:
+                text = value == 0 ? "NULL" : to_base(unsigned_value, 16);
+                break;
+            case syscall_arg_kind::string:
+            case syscall_arg_kind::buffer:
+            case syscall_arg_kind::out_buffer: {
+                //out buffers hold nothing yet at the entry
+                if (value == 0) {
+                    text = "NULL";
+                    break;
+                }
+                if (next_read == reads.size() or reads[next_read].arg != i or !requests[next_read].success) {
+                    text = to_base(unsigned_value, 16);
+                    break;
+                }
+                auto& read = reads[next_read++];
+                auto begin = buffer.data() + read.offset;
+                if (read.size == 0) {
+                    auto end = std::find(begin, begin + read.requested, std::byte{ 0 });
+                    auto length = std::min<std::size_t>(end - begin, max_shown_bytes);
+                    text = quote(begin, length, end - begin > static_cast<std::ptrdiff_t>(max_shown_bytes) or
+                                                end == begin + read.requested);
+                } else {
+                    auto length = std::min(read.size, max_shown_bytes);
+                    text = quote(begin, length, read.size > max_shown_bytes);
+                }
+                break;
+            }
+            default: text = to_base(unsigned_value, 16); break;
+        }
+        out += i == 0 ? text : ", " + text;
+    }
+    out += ")";
+
+    if (ret) {
+        if (*ret < 0 and *ret >= -4095) {
+            out += " = -1 (" + std::string(std::strerror(static_cast<int>(-*ret))) + ")";
+        } else {
+            out += " = " + std::to_string(*ret);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstddef>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+
+/*
+* Syscall catchpoints through seccomp
+*
+* PTRACE_SYSCALL stops the tracee on entry to and exit from every syscall, only to have most of the stops
+* thrown away. A seccomp filter in the tracee returns SECCOMP_RET_TRACE for the caught syscalls alone, the
+* kernel stops the tracee with PTRACE_EVENT_SECCOMP on their entry and lets everything else run at full speed.
+* The exit of a caught syscall is picked up by resuming that one stop with PTRACE_SYSCALL.
+* Filters are inherited by forked children, which are followed from the first filter on.
+*/
+
+namespace {
+    /* BPF jump offsets are 8 bits, the arch check jumps over every comparison */
+    constexpr std::size_t max_filtered_syscalls = 254;
+
+    std::vector<sock_filter> make_filter(const std::vector<int>& syscalls) {
+        auto n = syscalls.size();
+        std::vector<sock_filter> program = {
+            //32-bit and x32 syscalls use other numbers, let them through
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 0, static_cast<std::uint8_t>(n + 1)),
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+        };
+        for (std::size_t i = 0; i < n; ++i) {
+            program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<std::uint32_t>(syscalls[i]),
+                                       static_cast<std::uint8_t>(n - i), 0));
+        }
+        program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+        program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+        return program;
+    }
+}
+
+void sdb::Process::install_syscall_filter() {
+    //filters can't be taken out again, only syscalls no earlier filter stops on need a new one
+    std::vector<int> missing;
+    for (auto id : syscall_catch_policy_.get_to_catch()) {
+        if (std::find(filtered_syscalls_.begin(), filtered_syscalls_.end(), id) == filtered_syscalls_.end() and
+            std::find(missing.begin(), missing.end(), id) == missing.end()) {
+            missing.push_back(id);
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+    if (missing.size() > max_filtered_syscalls) {
+        error::send("Too many syscalls for a seccomp filter");
+    }
+
+    //children forked from here on keep the filter, they have to be traced before it goes in
+    if (filtered_syscalls_.empty()) {
+        auto paused = pause_running_threads();
+        for (auto& [tid, thread] : threads_) {
+            if (thread.state == process_state::stopped and
+                ptrace(PTRACE_SETOPTIONS, tid, nullptr, ptrace_options(true)) < 0) {
+                error::send_errno("Could not follow forks");
+            }
+        }
+    }
+
+    //the program goes below the red zone of the stopped tracee, the kernel copies it in
+    auto program = make_filter(missing);
+    auto program_size = program.size() * sizeof(sock_filter);
+    auto rsp = get_registers().read_by_id_as<std::uint64_t>(register_id::rsp);
+    auto address = (rsp - 128 - sizeof(sock_fprog) - program_size) & ~std::uint64_t(0xf);
+
+    sock_fprog header{ static_cast<unsigned short>(program.size()),
+                       reinterpret_cast<sock_filter*>(address + sizeof(sock_fprog)) };
+    write_memory(virt_addr{ address }, { reinterpret_cast<const std::byte*>(&header), sizeof(header) });
+    write_memory(virt_addr{ address + sizeof(sock_fprog) },
+                 { reinterpret_cast<const std::byte*>(program.data()), program_size });
+
+    //unprivileged processes may only install filters once they can't gain privileges
+    //filters belong to a thread, TSYNC puts it on every other thread too and returns the tid of one it couldn't
+    if (inject_syscall(SYS_prctl, { PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0 }) < 0 or
+        inject_syscall(SYS_seccomp, { SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_TSYNC, address }) != 0) {
+        error::send("Could not install seccomp filter in the process");
+    }
+    filtered_syscalls_.insert(filtered_syscalls_.end(), missing.begin(), missing.end());
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <ostream>
+#include <libsdb/syscall_log.hpp>
+
+namespace {
+    constexpr char log_magic[] = { 'S', 'D', 'B', 'S', 'Y', 'S', 'L', 'G' };
+    constexpr std::uint32_t log_version = 1;
+
+    template <typename T>
+    void write_raw(std::ostream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void write_column(std::ostream& out, const std::vector<T>& column) {
+        out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+    }
+
+    /* nearest-rank percentile of sorted values */
+    std::uint64_t percentile(const std::vector<std::uint64_t>& sorted, std::size_t percent) {
+        auto rank = (sorted.size() * percent + 99) / 100;
+        return sorted[std::max<std::size_t>(rank, 1) - 1];
+    }
+}
+
+void sdb::syscall_log::record_entry(pid_t tid, std::uint16_t id, const std::array<std::int64_t, 6>& args,
+                                    std::uint64_t time_ns) {
+    pending_[tid] = pending_syscall{ id, args, time_ns };
+}
+
+bool sdb::syscall_log::record_exit(pid_t tid, std::int64_t ret, std::uint64_t time_ns) {
+    //tracing started between the entry and the exit
+    auto it = pending_.find(tid);
+    if (it == pending_.end()) {
+        return false;
+    }
+
+    auto& pending = it->second;
+    ids_.push_back(pending.id);
+    for (std::size_t i = 0; i < args_.size(); ++i) {
+        args_[i].push_back(pending.args[i]);
+    }
+    rets_.push_back(ret);
+    entry_ns_.push_back(pending.time_ns);
+    exit_ns_.push_back(time_ns);
+    texts_.emplace_back();
+    pending_.erase(it);
+    return true;
+}
+
+void sdb::syscall_log::clear() {
+    ids_.clear();
+    for (auto& column : args_) {
+        column.clear();
+    }
+    rets_.clear();
+    entry_ns_.clear();
+    exit_ns_.clear();
+    texts_.clear();
+    pending_.clear();
+}
+
+std::vector<sdb::syscall_summary> sdb::syscall_log::summarize() const {
+    //latencies grouped by syscall number, sorted once for the percentiles
+    std::vector<std::vector<std::uint64_t>> latencies;
+    std::vector<std::uint64_t> errors;
+    for (std::size_t row = 0; row < ids_.size(); ++row) {
+        if (ids_[row] >= latencies.size()) {
+            latencies.resize(ids_[row] + 1);
+            errors.resize(ids_[row] + 1);
+        }
+        latencies[ids_[row]].push_back(exit_ns_[row] - entry_ns_[row]);
+        if (rets_[row] < 0 and rets_[row] >= -4095) {
+            ++errors[ids_[row]];
+        }
+    }
+
+    std::vector<syscall_summary> ret;
+    for (std::size_t id = 0; id < latencies.size(); ++id) {
+        auto& times = latencies[id];
+        if (times.empty()) {
+            continue;
+        }
+        std::sort(times.begin(), times.end());
+        std::uint64_t total = 0;
+        for (auto time : times) {
+            total += time;
+        }
+        ret.push_back({ static_cast<std::uint16_t>(id), times.size(), errors[id], total,
+                        percentile(times, 50), percentile(times, 99) });
+    }
+
+    std::sort(ret.begin(), ret.end(), [](auto& a, auto& b) { return a.total_ns > b.total_ns; });
+    return ret;
+}
+
+void sdb::syscall_log::dump(std::ostream& out) const {
+    out.write(log_magic, sizeof(log_magic));
+    write_raw(out, log_version);
+    write_raw(out, static_cast<std::uint64_t>(ids_.size()));
+    write_column(out, ids_);
+    for (auto& column : args_) {
+        write_column(out, column);
+    }
+    write_column(out, rets_);
+    write_column(out, entry_ns_);
+    write_column(out, exit_ns_);
+}
@@ -1,33 +1,242 @@
+#include <cstddef>
+#include <iterator>
 #include <libsdb/syscalls.hpp>
 #include <libsdb/error.hpp>
-#include <unordered_map>
+
+/*
+* Syscall tables, all built at compile time from syscalls.inc and syscall_signatures.inc
+*
+* Names are found through a perfect hash (hash and displace): the FNV-1a hash of a name picks a bucket, the
+* bucket's seed rehashes the name into a slot no other name has. A lookup is one hash, two table reads and one
+* name compare, without the allocation and chaining of an unordered_map
+*/
 
 namespace {
+    struct syscall_entry {
+        std::string_view name;
+        int id;
+    };
 
-    /* storing conversion from names to syscall ids */
-    const std::unordered_map<std::string_view, int> g_syscall_name_map {
-        #define DEFINE_SYSCALL(name,id) {#name, id},
+    constexpr syscall_entry g_syscalls[] = {
+        #define DEFINE_SYSCALL(name,id) { #name, id },
         #include "include/syscalls.inc"
         #undef DEFINE_SYSCALL
     };
 
+    constexpr std::size_t syscall_count = std::size(g_syscalls);
+
+    constexpr int max_syscall_id() {
+        int max = 0;
+        for (auto& entry : g_syscalls) {
+            max = entry.id > max ? entry.id : max;
+        }
+        return max;
+    }
+
+    constexpr std::size_t id_count = max_syscall_id() + 1;
+
+    constexpr std::uint64_t hash_name(std::string_view name) {
+        std::uint64_t hash = 0xcbf29ce484222325;
+        for (auto c : name) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }
+
+    /* the per-bucket rehash, a murmur finalizer over the name hash and the seed */
+    constexpr std::uint64_t rehash(std::uint64_t hash, std::uint64_t seed) {
+        hash ^= seed * 0x9e3779b97f4a7c15;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccd;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    constexpr std::size_t bucket_count = 256;
+    constexpr std::size_t slot_count = 512;
+    static_assert(slot_count >= syscall_count, "the perfect hash needs a slot per syscall");
+
+    constexpr std::size_t bucket_of(std::uint64_t hash) {
+        return (hash >> 40) % bucket_count;
+    }
+
+    struct perfect_hash {
+        std::array<std::uint16_t, bucket_count> seeds{};
+        std::array<std::int16_t, slot_count> slots{};   /* index into g_syscalls, -1 if free */
+    };
+
+    constexpr perfect_hash build_perfect_hash() {
+        perfect_hash table{};
+        for (auto& slot : table.slots) {
+            slot = -1;
+        }
+
+        //group the names by bucket
+        std::array<std::uint64_t, syscall_count> hashes{};
+        std::array<std::size_t, bucket_count> sizes{};
+        std::size_t largest = 0;
+        for (std::size_t i = 0; i < syscall_count; ++i) {
+            hashes[i] = hash_name(g_syscalls[i].name);
+            auto size = ++sizes[bucket_of(hashes[i])];
+            largest = size > largest ? size : largest;
+        }
+        std::array<std::size_t, bucket_count + 1> starts{};
+        for (std::size_t bucket = 0; bucket < bucket_count; ++bucket) {
+            starts[bucket + 1] = starts[bucket] + sizes[bucket];
+        }
+        std::array<std::size_t, syscall_count> order{};
+        auto next = starts;
+        for (std::size_t i = 0; i < syscall_count; ++i) {
+            order[next[bucket_of(hashes[i])]++] = i;
+        }
+
+        //largest buckets first, while most slots are still free
+        for (auto size = largest; size > 0; --size) {
+            for (std::size_t bucket = 0; bucket < bucket_count; ++bucket) {
+                if (sizes[bucket] != size) {
+                    continue;
+                }
+                for (std::uint16_t seed = 1; ; ++seed) {
+                    if (seed == 0) {
+                        throw "no seed places the bucket, grow slot_count";
+                    }
+                    std::array<std::size_t, 16> placed{};
+                    std::size_t count = 0;
+                    for (; count < size; ++count) {
+                        auto slot = rehash(hashes[order[starts[bucket] + count]], seed) % slot_count;
+                        bool taken = table.slots[slot] != -1;
+                        for (std::size_t j = 0; j < count; ++j) {
+                            taken = taken or placed[j] == slot;
+                        }
+                        if (taken) {
+                            break;
+                        }
+                        placed[count] = slot;
+                    }
+                    if (count == size) {
+                        for (std::size_t j = 0; j < size; ++j) {
+                            table.slots[placed[j]] = static_cast<std::int16_t>(order[starts[bucket] + j]);
+                        }
+                        table.seeds[bucket] = seed;
+                        break;
+                    }
+                }
+            }
+        }
+        return table;
+    }
+
+    constexpr perfect_hash g_name_hash = build_perfect_hash();
+
+    /* -1 for unknown names */
+    constexpr int find_syscall_id(std::string_view name) {
+        auto hash = hash_name(name);
+        auto slot = g_name_hash.slots[rehash(hash, g_name_hash.seeds[bucket_of(hash)]) % slot_count];
+        if (slot < 0 or g_syscalls[slot].name != name) {
+            return -1;
+        }
+        return g_syscalls[slot].id;
+    }
+
+    constexpr bool every_name_hashes_to_its_id() {
+        for (auto& entry : g_syscalls) {
+            if (find_syscall_id(entry.name) != entry.id) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(every_name_hashes_to_its_id(), "syscall name hash is not perfect");
+
+    constexpr std::array<std::string_view, id_count> build_id_to_name() {
+        std::array<std::string_view, id_count> names{};
+        for (auto& entry : g_syscalls) {
+            names[entry.id] = entry.name;
+        }
+        return names;
+    }
+
+    constexpr auto g_syscall_names = build_id_to_name();
+
+    /* shorthands for syscall_signatures.inc */
+    namespace signature_types {
+        using sdb::syscall_arg_type;
+        using kind = sdb::syscall_arg_kind;
+        constexpr syscall_arg_type none{ kind::none };
+        constexpr syscall_arg_type integer{ kind::signed_int };
+        constexpr syscall_arg_type size{ kind::unsigned_int };
+        constexpr syscall_arg_type hex{ kind::hex };
+        constexpr syscall_arg_type octal{ kind::octal };
+        constexpr syscall_arg_type fd{ kind::fd };
+        constexpr syscall_arg_type string{ kind::string };
+        constexpr syscall_arg_type open_flags{ kind::open_flags };
+        constexpr syscall_arg_type mmap_prot{ kind::mmap_prot };
+        constexpr syscall_arg_type mmap_flags{ kind::mmap_flags };
+        constexpr syscall_arg_type signal{ kind::signal };
+        constexpr syscall_arg_type pointer{ kind::pointer };
+        constexpr syscall_arg_type buffer(std::uint8_t length_arg) { return { kind::buffer, length_arg }; }
+        constexpr syscall_arg_type out_buffer(std::uint8_t length_arg) { return { kind::out_buffer, length_arg }; }
+    }
+
+    struct signature_slot {
+        bool known = false;
+        sdb::syscall_signature args{};
+    };
+
+    constexpr std::array<signature_slot, id_count> build_signatures() {
+        using namespace signature_types;
+        struct named_signature {
+            std::string_view name;
+            sdb::syscall_signature args;
+        };
+        const named_signature signatures[] = {
+            #define DEFINE_SYSCALL_SIGNATURE(name, ...) { #name, { __VA_ARGS__ } },
+            #include "include/syscall_signatures.inc"
+            #undef DEFINE_SYSCALL_SIGNATURE
+        };
+
+        std::array<signature_slot, id_count> table{};
+        for (auto& signature : signatures) {
+            auto id = find_syscall_id(signature.name);
+            if (id < 0) {
+                throw "syscall_signatures.inc names a syscall missing from syscalls.inc";
+            }
+            table[id].known = true;
+            table[id].args = signature.args;
+        }
+        return table;
+    }
+
+    constexpr auto g_signatures = build_signatures();
 }
 
 int sdb::name_to_syscall_id(std::string_view name) {
-    /* could use .find() but do 1 for precision */
-    if (g_syscall_name_map.count(name) != 1) {
+    auto id = find_syscall_id(name);
+    if (id < 0) {
         sdb::error::send("No such syscall");
     }
-    return g_syscall_name_map.at(name);
+    return id;
 }
 
 /* converting syscall ids to names */
 std::string_view sdb::syscall_id_to_name(int id) {
-    switch(id) {
-        #define DEFINE_SYSCALL(name,id) case id: return #name;
-        #include "include/syscalls.inc"
-        #undef DEFINE_SYSCALL
-    default: sdb::error::send("No such syscall");
+    if (id < 0 or static_cast<std::size_t>(id) >= id_count or g_syscall_names[id].empty()) {
+        sdb::error::send("No such syscall");
+    }
+    return g_syscall_names[id];
+}
+
+std::string sdb::syscall_display_name(int id) {
+    if (id < 0 or static_cast<std::size_t>(id) >= id_count or g_syscall_names[id].empty()) {
+        return "syscall_" + std::to_string(id);
     }
+    return std::string(g_syscall_names[id]);
+}
 
-}
\ No newline at end of file
+const sdb::syscall_signature* sdb::get_syscall_signature(int id) {
+    if (id < 0 or static_cast<std::size_t>(id) >= id_count or !g_signatures[id].known) {
+        return nullptr;
+    }
+    return &g_signatures[id].args;
+}
@@ -0,0 +1,425 @@
+#include <algorithm>
+#include <csignal>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+
+/*
+* Threads of the tracee
+*
+* Every thread is traced on its own: it stops, is waited for and is resumed by its tid, and has its own
+* registers. PTRACE_O_TRACECLONE makes the kernel attach us to new threads, each starts with a SIGSTOP.
+* In all-stop mode once one thread reports a stop the others get a SIGSTOP each and are collected, stops they
+* had of their own on the way are kept and reported one at a time by later wait_on_signal calls.
+* In non-stop mode the others are left running, and are only paused for the few steps that take an int3 out
+* or patch the code at the pc
+*/
+
+namespace {
+    bool is_event(int wait_status, int event) {
+        return wait_status >> 8 == (SIGTRAP | (event << 8));
+    }
+}
+
+sdb::thread_state& sdb::Process::get_thread(pid_t tid) {
+    auto it = threads_.find(tid);
+    if (it == threads_.end()) {
+        error::send("No thread with id " + std::to_string(tid));
+    }
+    return it->second;
+}
+
+const sdb::thread_state& sdb::Process::get_thread(pid_t tid) const {
+    auto it = threads_.find(tid);
+    if (it == threads_.end()) {
+        error::send("No thread with id " + std::to_string(tid));
+    }
+    return it->second;
+}
+
+void sdb::Process::set_current_thread(pid_t tid) {
+    if (get_thread(tid).state != process_state::stopped) {
+        error::send("Thread " + std::to_string(tid) + " is not stopped");
+    }
+    current_thread_ = tid;
+}
+
+void sdb::Process::set_non_stop(bool enable) {
+    //back in all-stop, nothing may run while the caller looks at a stop
+    if (non_stop_ and !enable and state_ == process_state::stopped) {
+        stop_running_threads();
+    }
+    non_stop_ = enable;
+}
+
+sdb::thread_state& sdb::Process::add_thread(pid_t tid) {
+    auto& thread = threads_[tid];
+    thread.tid = tid;
+    thread.regs.reset(new registers(*this, tid));
+
+    //clone doesn't copy debug registers, a new thread gets ours at its first stop
+    thread.debug_registers_stale = debug_registers_[7] != 0;
+    return thread;
+}
+
+std::vector<sdb::Process*> sdb::Process::live_processes_;
+std::vector<std::pair<pid_t, int>> sdb::Process::unclaimed_events_;
+
+std::pair<pid_t, int> sdb::Process::wait_for_thread(std::optional<pid_t> tid, bool block) {
+    auto owns = [](const Process& proc, pid_t id) {
+        return proc.threads_.count(id) != 0 or proc.followed_.count(id) != 0;
+    };
+
+    /* One waitpid(-1) for everything, each status goes to whoever it belongs to: us, another tracee sharing
+       an event loop, or nobody yet, like a new thread whose first stop beats its parent's clone event.
+       Forked children we follow are taken care of on the way, even while one thread is waited for */
+    for (;;) {
+        for (auto it = unclaimed_events_.begin(); it != unclaimed_events_.end(); ) {
+            if (owns(*this, it->first)) {
+                early_stops_.push_back(*it);
+                it = unclaimed_events_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto followed = std::find_if(early_stops_.begin(), early_stops_.end(), [&](auto& stop) {
+            return followed_.count(stop.first) != 0;
+        });
+        if (followed != early_stops_.end()) {
+            auto [id, wait_status] = *followed;
+            early_stops_.erase(followed);
+            take_followed_event(id, wait_status);
+            continue;
+        }
+
+        auto early = std::find_if(early_stops_.begin(), early_stops_.end(), [&](auto& stop) {
+            return tid ? stop.first == *tid : threads_.count(stop.first) != 0;
+        });
+        if (early != early_stops_.end()) {
+            auto ret = *early;
+            early_stops_.erase(early);
+            return ret;
+        }
+
+        int wait_status;
+        auto event_tid = waitpid(-1, &wait_status, __WALL | (block ? 0 : WNOHANG));
+        if (event_tid < 0) {
+            error::send_errno("waitpid failed");
+        }
+        if (event_tid == 0) {
+            return { 0, 0 };
+        }
+
+        if (threads_.count(event_tid) and (!tid or *tid == event_tid)) {
+            return { event_tid, wait_status };
+        }
+        if (followed_.count(event_tid)) {
+            take_followed_event(event_tid, wait_status);
+            continue;
+        }
+
+        //another thread of ours while one is waited for is reported later, the same goes for other tracees
+        Process* owner = owns(*this, event_tid) ? this : nullptr;
+        for (auto it = live_processes_.begin(); !owner and it != live_processes_.end(); ++it) {
+            owner = owns(**it, event_tid) ? *it : nullptr;
+        }
+        (owner ? owner->early_stops_ : unclaimed_events_).push_back({ event_tid, wait_status });
+    }
+}
+
+std::optional<sdb::stop_reason> sdb::Process::take_thread_event(pid_t tid, int wait_status) {
+    auto& thread = get_thread(tid);
+
+    if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status)) {
+        //the leader is reported last, once every other thread is gone
+        if (tid != pid_) {
+            if (current_thread_ == tid) {
+                current_thread_ = pid_;
+            }
+            threads_.erase(tid);
+            return std::nullopt;
+        }
+
+        stop_reason reason(wait_status);
+        reason.tid = tid;
+        for (auto it = threads_.begin(); it != threads_.end(); ) {
+            it = it->first == pid_ ? std::next(it) : threads_.erase(it);
+        }
+        thread.state = reason.reason;
+        thread.reason = reason;
+        current_thread_ = pid_;
+        displaced_step_.reset();
+        return reason;
+    }
+
+    thread.state = process_state::stopped;
+    thread.skip_step_over = false;
+    thread.regs->invalidate();
+    if (thread.debug_registers_stale) {
+        write_debug_registers(thread);
+    }
+
+    if (is_event(wait_status, PTRACE_EVENT_CLONE)) {
+        unsigned long message;
+        if (ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message) < 0) {
+            error::send_errno("Could not read the id of a new thread");
+        }
+        add_thread(static_cast<pid_t>(message)).is_new = true;
+        thread.skip_step_over = true;
+        return std::nullopt;
+    }
+
+    if (is_event(wait_status, PTRACE_EVENT_FORK) or is_event(wait_status, PTRACE_EVENT_VFORK)) {
+        unsigned long message;
+        if (ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message) < 0) {
+            error::send_errno("Could not read the id of a forked process");
+        }
+        followed_.emplace(static_cast<pid_t>(message), true);
+        thread.skip_step_over = true;
+        return std::nullopt;
+    }
+
+    if (WSTOPSIG(wait_status) == SIGSTOP and (thread.pending_sigstop or thread.is_new)) {
+        thread.pending_sigstop = false;
+        thread.is_new = false;
+        thread.skip_step_over = true;
+        //decode_stop never sees this stop, the thread has to leave a displaced copy here
+        if (thread.on_displaced_copy) {
+            on_thread(tid, [&] { run_out_of_displaced_copy(thread); });
+        }
+        return std::nullopt;
+    }
+
+    auto reason = on_thread(tid, [&] { return decode_stop(thread, wait_status); });
+    if (reason) {
+        reason->tid = tid;
+        thread.reason = reason;
+    }
+    return reason;
+}
+
+void sdb::Process::take_followed_event(pid_t tid, int wait_status) {
+    if (WIFEXITED(wait_status) or WIFSIGNALED(wait_status)) {
+        followed_.erase(tid);
+        return;
+    }
+
+    //its own signals go through, the stops ptrace adds don't
+    long signal = WSTOPSIG(wait_status);
+    if (is_event(wait_status, PTRACE_EVENT_FORK) or is_event(wait_status, PTRACE_EVENT_VFORK) or
+        is_event(wait_status, PTRACE_EVENT_CLONE)) {
+        unsigned long message;
+        if (ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message) == 0) {
+            followed_.emplace(static_cast<pid_t>(message), true);
+        }
+        signal = 0;
+    } else if (wait_status >> 16 != 0 or signal == (SIGTRAP | 0x80)) {
+        signal = 0;
+    } else if (signal == SIGSTOP and followed_[tid]) {
+        //an exec would otherwise stop it with a SIGTRAP that can't be told from one of its own
+        followed_[tid] = false;
+        ptrace(PTRACE_SETOPTIONS, tid, nullptr, ptrace_options(true) | PTRACE_O_TRACEEXEC);
+        signal = 0;
+    }
+    ptrace(PTRACE_CONT, tid, nullptr, signal);
+}
+
+void sdb::Process::stop_running_threads() {
+    for (auto& [tid, thread] : threads_) {
+        if (thread.state == process_state::running and !thread.is_new and !thread.pending_sigstop) {
+            //a thread that is exiting can't be signalled, its exit comes in below
+            syscall(SYS_tgkill, pid_, tid, SIGSTOP);
+            thread.pending_sigstop = true;
+        }
+    }
+
+    auto is_running = [](auto& entry) { return entry.second.state == process_state::running; };
+    while (std::any_of(threads_.begin(), threads_.end(), is_running)) {
+        auto [tid, wait_status] = wait_for_thread(std::nullopt);
+        auto reason = take_thread_event(tid, wait_status);
+        if (!reason) {
+            continue;
+        }
+
+        get_thread(tid).pending_report = true;
+        if (reason->reason != process_state::stopped) {
+            state_ = reason->reason;
+            return;
+        }
+    }
+}
+
+sdb::Process::paused_threads sdb::Process::pause_running_threads() {
+    std::vector<pid_t> stopped;
+    for (auto& [tid, thread] : threads_) {
+        if (thread.state == process_state::stopped) {
+            stopped.push_back(tid);
+        }
+    }
+    stop_running_threads();
+
+    //new threads that turned up on the way are ours to start as well, threads with a stop to report are not
+    std::vector<pid_t> paused;
+    for (auto& [tid, thread] : threads_) {
+        if (thread.state == process_state::stopped and !thread.pending_report and
+            !std::binary_search(stopped.begin(), stopped.end(), tid)) {
+            paused.push_back(tid);
+        }
+    }
+    return { this, std::move(paused) };
+}
+
+sdb::Process::paused_threads::~paused_threads() {
+    for (auto tid : tids) {
+        auto it = proc->threads_.find(tid);
+        if (it == proc->threads_.end() or it->second.state != process_state::stopped or it->second.pending_report) {
+            continue;
+        }
+        try {
+            it->second.regs->flush();
+            proc->continue_thread(it->second);
+        } catch (...) {}
+    }
+}
+
+bool sdb::Process::has_pending_report() const {
+    return std::any_of(threads_.begin(), threads_.end(), [](auto& entry) { return entry.second.pending_report; });
+}
+
+bool sdb::Process::has_running_thread() const {
+    return std::any_of(threads_.begin(), threads_.end(),
+                       [](auto& entry) { return entry.second.state == process_state::running; });
+}
+
+int sdb::Process::single_step_thread(pid_t tid) {
+    auto& thread = get_thread(tid);
+    for (;;) {
+        if (ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) < 0) {
+            error::send_errno("Could not single step");
+        }
+        thread.state = process_state::running;
+
+        auto [_, wait_status] = wait_for_thread(tid);
+        thread.regs->invalidate();
+
+        //a SIGSTOP of ours or a clone event came before the step finished
+        if (WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) == SIGSTOP and thread.pending_sigstop) {
+            thread.pending_sigstop = false;
+            thread.state = process_state::stopped;
+            continue;
+        }
+        if (is_event(wait_status, PTRACE_EVENT_CLONE) or is_event(wait_status, PTRACE_EVENT_FORK) or
+            is_event(wait_status, PTRACE_EVENT_VFORK)) {
+            take_thread_event(tid, wait_status);
+            continue;
+        }
+
+        if (WIFSTOPPED(wait_status) and WSTOPSIG(wait_status) == SIGTRAP) {
+            thread.state = process_state::stopped;
+        } else {
+            //a signal or the end of the thread, it's reported from wait_on_signal as if the thread was running
+            early_stops_.push_back({ tid, wait_status });
+        }
+        return wait_status;
+    }
+}
+
+void sdb::Process::continue_thread(thread_state& thread) {
+    /* with a filter only the exit of a caught syscall needs PTRACE_SYSCALL */
+    auto catch_mode = syscall_catch_policy_.get_mode();
+    bool filtered = catch_mode == syscall_catch_policy::mode::some and syscall_filter_ready_;
+    auto request = !tracing_syscalls_ and
+                   (catch_mode == syscall_catch_policy::mode::none or (filtered and !thread.current_syscall))
+        ? PTRACE_CONT : PTRACE_SYSCALL;
+    if (request == PTRACE_CONT) {
+        thread.current_syscall.reset();
+    }
+
+    long signal = std::exchange(thread.pending_signal, 0);
+    if (ptrace(request, thread.tid, nullptr, signal) < 0) {
+        error::send_errno("Could not resume");
+    }
+    thread.state = process_state::running;
+    thread.stepping = false;
+}
+
+void sdb::Process::write_debug_register(register_id id, std::uint64_t value) {
+    debug_registers_[static_cast<int>(id) - static_cast<int>(register_id::dr0)] = value;
+    for (auto& [tid, thread] : threads_) {
+        if (thread.state == process_state::stopped) {
+            thread.regs->write_by_id(id, value);
+        } else {
+            thread.debug_registers_stale = true;
+        }
+    }
+}
+
+void sdb::Process::write_debug_registers(thread_state& thread) {
+    //addresses first, the kernel checks them against dr7 as it is written
+    for (auto i = 0; i < 4; ++i) {
+        thread.regs->write_by_id(static_cast<register_id>(static_cast<int>(register_id::dr0) + i), debug_registers_[i]);
+    }
+    thread.regs->write_by_id(register_id::dr7, debug_registers_[7]);
+    thread.debug_registers_stale = false;
+}
+
+void sdb::Process::detach_threads() {
+    if (state_ == process_state::exited or state_ == process_state::terminated) {
+        return;
+    }
+    stop_running_threads();
+    if (state_ == process_state::exited or state_ == process_state::terminated) {
+        return;
+    }
+
+    //a page left protected would kill it with a SIGSEGV nothing handles
+    state_ = process_state::stopped;
+    restore_watched_pages();
+
+    for (auto& [tid, thread] : threads_) {
+        if (thread.state != process_state::stopped) {
+            continue;
+        }
+        /* register changes made during the last stop shouldn't be lost on detach */
+        try {
+            thread.regs->flush();
+        } catch (...) {}
+
+        //hardware stoppoints left behind would kill it with a SIGTRAP
+        if (debug_registers_[7] != 0) {
+            ptrace(PTRACE_POKEUSER, tid, get_register_info_by_id(register_id::dr7).offset, 0);
+        }
+        ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+    }
+
+    //also drops the SIGSTOPs of ours still pending in threads that stopped for something else
+    kill(pid_, SIGCONT);
+}
+
+void sdb::Process::kill_threads() {
+    //forked children hold filters that fail syscalls once we are gone, they may outlive the tracee
+    for (auto& [tid, _] : followed_) {
+        kill(tid, SIGKILL);
+    }
+    for (auto& [tid, _] : followed_) {
+        waitpid(tid, nullptr, __WALL);
+    }
+    followed_.clear();
+
+    if (state_ == process_state::exited or state_ == process_state::terminated) {
+        return;
+    }
+    kill(pid_, SIGKILL);
+
+    //every thread reports its death, the leader last
+    for (auto& [tid, thread] : threads_) {
+        if (tid != pid_) {
+            waitpid(tid, nullptr, __WALL);
+        }
+    }
+    waitpid(pid_, nullptr, __WALL);
+}
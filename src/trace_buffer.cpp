@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <libsdb/trace_buffer.hpp>
+#include <libsdb/error.hpp>
+
+namespace {
+    std::size_t round_up_to_power_of_two(std::size_t value) {
+        std::size_t ret = 1;
+        while (ret < value) {
+            ret <<= 1;
+        }
+        return ret;
+    }
+}
+
+sdb::trace_buffer::trace_buffer(std::size_t capacity)
+    : data_(round_up_to_power_of_two(std::max<std::size_t>(capacity, 64))), mask_(data_.size() - 1) {
+}
+
+void sdb::trace_buffer::copy_in(std::uint64_t pos, const std::byte* data, std::size_t size) {
+    auto offset = pos & mask_;
+    auto first = std::min(size, data_.size() - offset);
+    std::copy(data, data + first, data_.begin() + offset);
+    std::copy(data + first, data + size, data_.begin());
+}
+
+void sdb::trace_buffer::copy_out(std::uint64_t pos, std::byte* data, std::size_t size) const {
+    auto offset = pos & mask_;
+    auto first = std::min(size, data_.size() - offset);
+    std::copy(data_.begin() + offset, data_.begin() + offset + first, data);
+    std::copy(data_.begin(), data_.begin() + (size - first), data + first);
+}
+
+bool sdb::trace_buffer::push(span<const std::byte> record) {
+    auto head = head_.load(std::memory_order_relaxed);
+    auto tail = tail_.load(std::memory_order_acquire);
+    auto needed = sizeof(length_type) + record.size();
+
+    if (needed > data_.size() - (head - tail)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    length_type length = record.size();
+    copy_in(head, reinterpret_cast<const std::byte*>(&length), sizeof(length));
+    copy_in(head + sizeof(length), record.begin(), record.size());
+
+    //publish the record only once its bytes are in place
+    head_.store(head + needed, std::memory_order_release);
+    pushed_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool sdb::trace_buffer::pop(std::vector<std::byte>& record) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto head = head_.load(std::memory_order_acquire);
+    if (tail == head) {
+        return false;
+    }
+
+    length_type length;
+    copy_out(tail, reinterpret_cast<std::byte*>(&length), sizeof(length));
+    record.resize(length);
+    copy_out(tail + sizeof(length), record.data(), length);
+
+    //hand the space back to the producer
+    tail_.store(tail + sizeof(length) + length, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,261 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <signal.h>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+
+namespace {
+    /* id, hit number and timestamp at the start of every record */
+    constexpr std::size_t record_header_size = sizeof(sdb::tracepoint::id_type) + 2 * sizeof(std::uint64_t);
+
+    constexpr char trace_magic[] = { 'S', 'D', 'B', 'T', 'R', 'A', 'C', 'E' };
+    constexpr std::uint32_t trace_version = 1;
+
+    template <typename T>
+    void write_raw(std::ostream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write_hex(std::ostream& out, const std::byte* data, std::size_t size) {
+        auto flags = out.flags();
+        out << std::hex << std::setfill('0');
+        for (std::size_t i = 0; i < size; ++i) {
+            out << std::setw(2) << static_cast<unsigned>(data[i]);
+        }
+        out.flags(flags);
+    }
+
+    /* registers are little endian, show them the way people read them */
+    void write_register_value(std::ostream& out, const std::byte* data, std::size_t size) {
+        auto flags = out.flags();
+        out << "0x" << std::hex << std::setfill('0');
+        for (std::size_t i = size; i > 0; --i) {
+            out << std::setw(2) << static_cast<unsigned>(data[i - 1]);
+        }
+        out.flags(flags);
+    }
+
+    auto get_next_id() {
+        static sdb::tracepoint::id_type id = 0;
+        return ++id;
+    }
+}
+
+sdb::tracepoint::tracepoint(Process& proc, breakpoint_site& site,
+                            std::vector<register_id> registers, std::vector<memory_range> memory)
+    : id_(get_next_id()), process_(&proc), site_(&site), address_(site.address()),
+      registers_(std::move(registers)), memory_(std::move(memory)) {
+}
+
+sdb::tracepoint::tracepoint(Process& proc, virt_addr address, std::vector<register_id> registers,
+                            std::vector<std::byte> original_code, virt_addr trampoline)
+    : id_(get_next_id()), process_(&proc), site_(nullptr), address_(address), registers_(std::move(registers)),
+      original_code_(std::move(original_code)), trampoline_(trampoline) {
+}
+
+void sdb::tracepoint::enable() {
+    is_fast() ? write_code(true) : site_->enable();
+    is_enabled_ = true;
+}
+
+void sdb::tracepoint::disable() {
+    is_fast() ? write_code(false) : site_->disable();
+    is_enabled_ = false;
+}
+
+std::size_t sdb::tracepoint::record_size() const {
+    auto size = record_header_size;
+    for (auto id : registers_) {
+        size += get_register_info_by_id(id).size;
+    }
+    for (auto& range : memory_) {
+        size += range.size;
+    }
+    return size;
+}
+
+sdb::tracepoint& sdb::Process::create_tracepoint(virt_addr address, std::vector<register_id> registers,
+                                                 std::vector<tracepoint::memory_range> memory) {
+    if (tracepoints_.contains_address(address)) {
+        error::send("Tracepoint already created at address " + std::to_string(address.addr()));
+    }
+    for (auto& range : memory) {
+        if (range.base and get_register_info_by_id(*range.base).type != register_type::gpr) {
+            error::send("Tracepoint memory must be relative to a general purpose register");
+        }
+    }
+
+    //a user breakpoint at the same address would swallow our hits, or we'd swallow its stops
+    breakpoint_site* site;
+    if (breakpoint_sites_.contains_address(address)) {
+        site = &breakpoint_sites_.get_by_address(address);
+        if (!site->is_internal() or site->is_enabled()) {
+            error::send("Breakpoint site already created at address " + std::to_string(address.addr()));
+        }
+    } else {
+        site = &create_breakpoint_site(address, false, true);
+    }
+
+    auto tp = std::unique_ptr<tracepoint>(new tracepoint(*this, *site, std::move(registers), std::move(memory)));
+    if (tp->record_size() > trace_buffer_size / 2) {
+        error::send("Tracepoint captures too much data");
+    }
+
+    if (!trace_buffer_) {
+        trace_buffer_ = std::make_unique<trace_buffer>(trace_buffer_size);
+    }
+
+    auto& ret = tracepoints_.push(std::move(tp));
+    ret.enable();
+    return ret;
+}
+
+void sdb::Process::delete_tracepoint(tracepoint::id_type id) {
+    auto site = tracepoints_.get_by_id(id).site_;
+    tracepoints_.remove_by_id(id);
+
+    //nothing else uses the site, left behind it would block a user breakpoint at the address
+    if (site) {
+        breakpoint_sites_.remove_by_id(site->id());
+    }
+}
+
+bool sdb::Process::record_tracepoint_hit(const stop_reason& reason) {
+    //wait_for_stop has already moved the pc back onto the int3
+    if (reason.reason != process_state::stopped or reason.info != SIGTRAP
+        or reason.trap_reason != trap_type::software_break
+        or !tracepoints_.enabled_stoppoint_at_address(get_pc())) {
+        return false;
+    }
+
+    auto& tp = tracepoints_.get_by_address(get_pc());
+    auto hit = ++tp.hits_;
+    trace_record_.resize(tp.record_size());
+    auto out = trace_record_.data();
+
+    auto append = [&](const void* data, std::size_t size) {
+        std::memcpy(out, data, size);
+        out += size;
+    };
+
+    std::uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto id = tp.id();
+    append(&id, sizeof(id));
+    append(&hit, sizeof(hit));
+    append(&time, sizeof(time));
+
+    auto raw_registers = reinterpret_cast<const std::byte*>(&get_registers().data_);
+    for (auto reg : tp.registers()) {
+        auto& info = get_register_info_by_id(reg);
+        get_registers().load(info);
+        append(raw_registers + info.offset, info.size);
+    }
+
+    //every range comes in with one read, whatever can't be read is recorded as zeros
+    trace_reads_.clear();
+    for (auto& range : tp.memory()) {
+        std::uint64_t base = range.base ? get_registers().read_by_id_as<std::uint64_t>(*range.base) : 0;
+        trace_reads_.push_back({ virt_addr{ base + range.offset }, { out, range.size } });
+        out += range.size;
+    }
+    if (!trace_reads_.empty()) {
+        read_memory_batch({ trace_reads_.data(), trace_reads_.size() });
+        for (auto& request : trace_reads_) {
+            if (!request.success) {
+                std::fill(request.data.begin(), request.data.end(), std::byte{ 0 });
+            }
+        }
+    }
+
+    trace_buffer_->push({ trace_record_.data(), trace_record_.size() });
+    return true;
+}
+
+std::size_t sdb::Process::dump_trace(std::ostream& out, trace_format format) {
+    collect_fast_trace();
+
+    if (format == trace_format::binary) {
+        out.write(trace_magic, sizeof(trace_magic));
+        write_raw(out, trace_version);
+        write_raw(out, static_cast<std::uint32_t>(tracepoints_.size()));
+        tracepoints_.for_each([&](auto& tp) {
+            write_raw(out, tp.id());
+            write_raw(out, tp.address().addr());
+            write_raw(out, static_cast<std::uint32_t>(tp.registers().size()));
+            write_raw(out, static_cast<std::uint32_t>(tp.memory().size()));
+            for (auto reg : tp.registers()) {
+                write_raw(out, static_cast<std::uint32_t>(reg));
+                write_raw(out, static_cast<std::uint32_t>(get_register_info_by_id(reg).size));
+            }
+            for (auto& range : tp.memory()) {
+                write_raw(out, static_cast<std::uint32_t>(range.size));
+            }
+        });
+    } else {
+        out << "tracepoint,hit,time_ns,field,value\n";
+    }
+
+    if (!trace_buffer_) {
+        return 0;
+    }
+
+    std::size_t count = 0;
+    std::vector<std::byte> record;
+    while (trace_buffer_->pop(record)) {
+        ++count;
+        if (format == trace_format::binary) {
+            write_raw(out, static_cast<std::uint32_t>(record.size()));
+            out.write(reinterpret_cast<const char*>(record.data()), record.size());
+            continue;
+        }
+
+        tracepoint::id_type id;
+        std::uint64_t hit, time;
+        auto in = record.data();
+        std::memcpy(&id, in, sizeof(id));
+        std::memcpy(&hit, in + sizeof(id), sizeof(hit));
+        std::memcpy(&time, in + sizeof(id) + sizeof(hit), sizeof(time));
+        in += record_header_size;
+
+        auto row = [&](auto&& field) -> std::ostream& {
+            return out << id << ',' << hit << ',' << time << ',' << field << ',';
+        };
+
+        //the tracepoint was deleted since, the layout is unknown
+        if (!tracepoints_.contains_id(id) or tracepoints_.get_by_id(id).record_size() != record.size()) {
+            write_hex(row("record"), in, record.data() + record.size() - in);
+            out << '\n';
+            continue;
+        }
+
+        auto& tp = tracepoints_.get_by_id(id);
+        for (auto reg : tp.registers()) {
+            auto& info = get_register_info_by_id(reg);
+            write_register_value(row(info.name), in, info.size);
+            out << '\n';
+            in += info.size;
+        }
+        for (auto& range : tp.memory()) {
+            std::string field = "mem";
+            if (range.base) {
+                field += ":" + std::string(get_register_info_by_id(*range.base).name);
+                if (range.offset) {
+                    field += (range.offset < 0 ? "-" : "+") + std::to_string(std::abs(range.offset));
+                }
+            } else {
+                std::ostringstream address;
+                address << ":0x" << std::hex << range.offset;
+                field += address.str();
+            }
+            write_hex(row(field), in, range.size);
+            out << '\n';
+            in += range.size;
+        }
+    }
+    return count;
+}
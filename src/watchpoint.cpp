@@ -1,6 +1,8 @@
 #include <libsdb/watchpoint.hpp>
 #include <libsdb/process.hpp>
 #include <libsdb/error.hpp>
+#include <algorithm>
+#include <cstring>
 #include <utility>
 
 namespace {
@@ -13,9 +15,10 @@ namespace {
 }
 
 sdb::watchpoint_site::watchpoint_site(Process & proc, virt_addr address,
-    sdb::stoppoint_mode mode, size_t size)
-    : process_{&proc}, address_{address}, mode_{mode}, size_{size}, is_enabled_{false} {
-        if ((address.addr() & (size - 1)) != 0) {
+    sdb::stoppoint_mode mode, size_t size, bool software)
+    : process_{&proc}, address_{address}, mode_{mode}, size_{size}, is_enabled_{false}, is_software_{software} {
+        //page protection has no alignment or size limits
+        if (!software and (address.addr() & (size - 1)) != 0) {
             sdb::error::send("Watchpoint is not aligned to size");
         }
 
@@ -28,6 +31,17 @@ void sdb::watchpoint_site::enable() {
         return;
     }
 
+    if (is_software_) {
+        is_enabled_ = true;
+        try {
+            process_->protect_watched_pages(address_, address_ + size_);
+        } catch (...) {
+            is_enabled_ = false;
+            throw;
+        }
+        return;
+    }
+
     hardware_register_index_ = process_->set_watchpoint(id_, address_, mode_, size_);
     is_enabled_ = true;
 }
@@ -37,14 +51,21 @@ void sdb::watchpoint_site::disable() {
         return;
     }
 
+    if (is_software_) {
+        is_enabled_ = false;
+        process_->protect_watched_pages(address_, address_ + size_);
+        return;
+    }
+
     process_->clear_hardware_stoppoint(hardware_register_index_);
     is_enabled_ = false;
 }
 
 void sdb::watchpoint_site::update_data() {
     std::uint64_t new_data = 0;
-    auto read = process_->read_memory(address_, size_);
-    memcpy(&new_data, read.data(), size_);
+    auto size = std::min(size_, sizeof(new_data));
+    auto read = process_->read_memory(address_, size);
+    memcpy(&new_data, read.data(), size);
 
     //assigns new_data to data, then returns data and assign to previous_data
     previous_data_ = std::exchange(data_, new_data);
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <libsdb/process.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/pipe.hpp>
+#include <libsdb/bits.hpp>
+
+/*
+* Micro benchmarks for libsdb hot paths. Run from the test build directory so that targets/ resolves
+*/
+using namespace sdb;
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    /* first region with the given permissions whose backing path contains name */
+    const memory_region& find_mapping(const memory_map& maps, bool writable, bool executable, std::string_view name) {
+        for (auto& region : maps) {
+            if (region.readable and region.writable == writable and region.executable == executable
+                and region.path.find(name) != std::string::npos) {
+                return region;
+            }
+        }
+        error::send("No mapping matching " + std::string(name));
+    }
+
+    /* MB/s for rewriting a region with its own contents through one write path, or -1 if the path can't reach it */
+    double write_throughput(Process& proc, virt_addr address, std::size_t size, memory_write_path path) {
+        auto data = proc.read_memory(address, size);
+        constexpr std::size_t total = 64 << 20;
+        auto iterations = std::max<std::size_t>(1, total / size);
+
+        auto start = clock_type::now();
+        try {
+            for (std::size_t i = 0; i < iterations; ++i) {
+                proc.write_memory(address, { data.data(), data.size() }, path);
+            }
+        } catch (const error&) {
+            return -1;
+        }
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+        return (iterations * size) / elapsed.count() / (1 << 20);
+    }
+
+    void bench_write_memory() {
+        auto proc = Process::launch("targets/run_endlessly");
+        auto& maps = proc->get_memory_map();
+
+        //a writable data page and a read-only text page of the target
+        auto& stack = find_mapping(maps, true, false, "[stack]");
+        auto& text = find_mapping(maps, false, true, "run_endlessly");
+
+        struct region { const char* name; virt_addr address; std::size_t size; };
+        std::size_t stack_size = std::min<std::uint64_t>(stack.size(), 64 << 10);
+        region regions[] = {
+            { "stack (rw-)", stack.high - stack_size, stack_size },
+            { "text (r-x)", text.low, text.size() },
+        };
+
+        struct named_path { const char* name; memory_write_path path; };
+        named_path paths[] = {
+            { "process_vm_writev", memory_write_path::vm_writev },
+            { "/proc/pid/mem", memory_write_path::proc_mem },
+            { "PTRACE_POKEDATA", memory_write_path::poke_data },
+        };
+
+        std::printf("write_memory throughput (MB/s)\n");
+        for (auto& region : regions) {
+            for (auto& path : paths) {
+                auto mbps = write_throughput(*proc, region.address, region.size, path.path);
+                if (mbps < 0) {
+                    std::printf("  %-12s %-18s %10s\n", region.name, path.name, "n/a");
+                } else {
+                    std::printf("  %-12s %-18s %10.1f\n", region.name, path.name, mbps);
+                }
+            }
+        }
+    }
+
+    /* sites per second, enabling then disabling one site at a time versus in one batch */
+    void bench_breakpoint_sites() {
+        auto proc = Process::launch("targets/run_endlessly");
+        //the dynamic loader is the only library mapped at the exec stop
+        auto& text = find_mapping(proc->get_memory_map(), false, true, "ld-linux");
+
+        //never executed, the target is never resumed
+        constexpr std::size_t stride = 2;
+        std::vector<breakpoint_site*> sites;
+        for (std::uint64_t offset = 0; offset < text.size() and sites.size() < 50000; offset += stride) {
+            sites.push_back(&proc->create_breakpoint_site(text.low + offset));
+        }
+
+        auto rate = [&](auto f) {
+            auto start = clock_type::now();
+            f();
+            std::chrono::duration<double> elapsed = clock_type::now() - start;
+            return sites.size() / elapsed.count();
+        };
+
+        auto one_enable = rate([&] { for (auto site : sites) site->enable(); });
+        auto one_disable = rate([&] { for (auto site : sites) site->disable(); });
+        auto bulk_enable = rate([&] { proc->enable_breakpoint_sites(sites); });
+        auto bulk_disable = rate([&] { proc->disable_breakpoint_sites(sites); });
+
+        std::printf("breakpoint sites per second (%zu sites)\n", sites.size());
+        std::printf("  %-12s %14s %14s\n", "", "enable", "disable");
+        std::printf("  %-12s %14.0f %14.0f\n", "one by one", one_enable, one_disable);
+        std::printf("  %-12s %14.0f %14.0f\n", "bulk", bulk_enable, bulk_disable);
+    }
+
+    /* cost per hit of a trapping tracepoint and a fast one, over a run of hot_loop without any */
+    void bench_tracepoints() {
+        enum class kind { none, trap, fast };
+
+        //seconds from the first raise(SIGTRAP) of hot_loop until it exits
+        auto run = [](kind tracing) {
+            sdb::pipe channel(/*close_on_exec=*/false);
+            auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+            channel.close_write();
+            proc->resume();
+            proc->wait_on_signal();
+
+            auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+            if (tracing == kind::trap) {
+                proc->create_tracepoint(func, { register_id::rdi });
+            } else if (tracing == kind::fast) {
+                proc->create_fast_tracepoint(func);
+            }
+
+            auto start = clock_type::now();
+            proc->resume();
+            proc->wait_on_signal();
+            std::chrono::duration<double> elapsed = clock_type::now() - start;
+            return elapsed.count();
+        };
+
+        //best of a few runs, process exit is noisy next to 1000 fast hits
+        auto best = [&](kind tracing) {
+            double ret = run(tracing);
+            for (int i = 0; i < 4; ++i) {
+                ret = std::min(ret, run(tracing));
+            }
+            return ret;
+        };
+
+        //hot_loop calls the function 1000 times
+        constexpr double hits = 1000;
+        auto baseline = best(kind::none);
+        auto trap = (best(kind::trap) - baseline) / hits;
+        auto fast = (best(kind::fast) - baseline) / hits;
+
+        std::printf("tracepoint cost per hit (ns)\n");
+        std::printf("  %-12s %14.0f\n", "int3", trap * 1e9);
+        std::printf("  %-12s %14.0f\n", "fast", fast * 1e9);
+    }
+
+    void bench_breakpoint_passes() {
+        sdb::pipe channel(/*close_on_exec=*/false);
+        auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+        channel.close_write();
+        proc->resume();
+        proc->wait_on_signal();
+
+        auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+        proc->create_breakpoint_site(func).enable();
+
+        //each pass runs the displaced copy of the first instruction, the int3 stays in place
+        constexpr int hits = 1000;
+        auto start = clock_type::now();
+        for (int i = 0; i < hits; ++i) {
+            proc->resume();
+            proc->wait_on_signal();
+        }
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+        std::printf("breakpoint stop and resume (ns)\n");
+        std::printf("  %-12s %14.0f\n", "per hit", elapsed.count() / hits * 1e9);
+    }
+
+    void bench_conditional_breakpoints() {
+        sdb::pipe channel(/*close_on_exec=*/false);
+        auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+        channel.close_write();
+        proc->resume();
+        proc->wait_on_signal();
+
+        auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+        auto& site = proc->create_breakpoint_site(func);
+        site.set_condition(sdb::condition::compile("edi == 100000"));
+        site.enable();
+
+        //the condition never holds, every call is checked and resumed inside wait_on_signal
+        auto start = clock_type::now();
+        proc->resume();
+        proc->wait_on_signal();
+        std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+        std::printf("false breakpoint condition (ns)\n");
+        std::printf("  %-12s %14.0f\n", "per hit", elapsed.count() / site.hit_count() * 1e9);
+    }
+
+    void bench_syscall_tracing() {
+        //every syscall of the run stops at its entry and exit and is resumed inside wait_on_signal
+        constexpr int runs = 20;
+        std::size_t syscalls = 0;
+        std::chrono::duration<double> elapsed{};
+        for (int run = 0; run < runs; ++run) {
+            auto null_fd = open("/dev/null", O_WRONLY);
+            auto proc = Process::launch("targets/hello_sdb", true, null_fd);
+            close(null_fd);
+            proc->set_syscall_tracing(true);
+            auto start = clock_type::now();
+            proc->resume();
+            proc->wait_on_signal();
+            elapsed += clock_type::now() - start;
+            syscalls += proc->get_syscall_log().size();
+        }
+
+        std::printf("traced syscall (ns)\n");
+        std::printf("  %-12s %14.0f\n", "per syscall", elapsed.count() / syscalls * 1e9);
+    }
+}
+
+int main() {
+    try {
+        bench_write_memory();
+        bench_breakpoint_sites();
+        bench_tracepoints();
+        bench_breakpoint_passes();
+        bench_conditional_breakpoints();
+        bench_syscall_tracing();
+    } catch (const error& err) {
+        std::fprintf(stderr, "%s\n", err.what());
+        return 1;
+    }
+}
@@ -0,0 +1,23 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <unistd.h>
+#include <signal.h>
+
+std::atomic<unsigned long> counter{ 0 };
+
+int main() {
+    //write the address of the counter out for the debugger
+    auto ptr = reinterpret_cast<void*>(&counter);
+    write(STDOUT_FILENO, &ptr, sizeof(void*));
+    fflush(stdout);
+
+    //a second thread keeps changing the counter while the main one is stopped
+    std::thread other([] {
+        while (true) ++counter;
+    });
+    while (counter == 0) {}
+
+    raise(SIGTRAP);
+    other.detach();
+}
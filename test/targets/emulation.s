@@ -0,0 +1,47 @@
+.global main
+
+.section .data
+value: .quad 0x1122334455667788
+
+.section .text
+
+# Trapping
+.macro trap
+    movq $62, %rax
+    movq %r12, %rdi
+    movq $5, %rsi
+    syscall
+.endm
+
+main:
+    push %rbp
+    movq %rsp, %rbp
+
+    # Get PID syscall
+    movq $39, %rax
+    syscall
+    movq %rax, %r12
+    trap
+
+    # the instructions breakpoints are passed over by emulation, 15 steps
+    movl $0x7fffffff, %eax
+    addl $1, %eax
+    movq value(%rip), %rbx
+    subq %rbx, %rax
+    leaq -24(%rsp), %rcx
+    movq %rbx, -8(%rsp)
+    addq $0x10, -8(%rsp)
+    subq %rcx, -8(%rsp)
+    pushq value(%rip)
+    pushq 8(%rsp)
+    call func
+    popq %rdx
+    popq %rdx
+
+    popq %rbp
+    movq $0, %rax
+    ret
+
+func:
+    subl $5, %eax
+    ret
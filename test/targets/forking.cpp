@@ -0,0 +1,28 @@
+#include <cstdlib>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    //a syscall left failing by the debugger fails the child
+    [[noreturn]] void child() {
+        _exit(syscall(SYS_getppid) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    bool child_succeeded(pid_t pid) {
+        int status;
+        return pid > 0 and waitpid(pid, &status, 0) == pid and WIFEXITED(status) and WEXITSTATUS(status) == 0;
+    }
+}
+
+int main() {
+    auto forked = fork();
+    if (forked == 0) {
+        child();
+    }
+    auto vforked = vfork();
+    if (vforked == 0) {
+        child();
+    }
+    return child_succeeded(forked) and child_succeeded(vforked) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,25 @@
+#include <cstdio>
+#include <unistd.h>
+#include <signal.h>
+
+//out of line so it has an entry to trace
+__attribute__((noinline)) int hot_function(int i) {
+    return i * 2 + 1;
+}
+
+int main() {
+    //write the address of the hot function out for the debugger
+    auto ptr = reinterpret_cast<void*>(&hot_function);
+    write(STDOUT_FILENO, &ptr, sizeof(void*));
+    fflush(stdout);
+
+    raise(SIGTRAP);
+
+    int sum = 0;
+    for (int i = 0; i < 1000; ++i) {
+        sum += hot_function(i);
+    }
+
+    //1000 * 1000
+    return sum == 1000000 ? 0 : 1;
+}
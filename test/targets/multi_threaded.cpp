@@ -0,0 +1,40 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <signal.h>
+
+std::atomic<int> total{ 0 };
+
+//out of line so every thread stops on the same entry
+__attribute__((noinline)) int thread_function(int i) {
+    return i * 2 + 1;
+}
+
+int main() {
+    //write the address of the thread function out for the debugger
+    auto ptr = reinterpret_cast<void*>(&thread_function);
+    write(STDOUT_FILENO, &ptr, sizeof(void*));
+    fflush(stdout);
+
+    raise(SIGTRAP);
+
+    //4 threads * 100 calls
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            int sum = 0;
+            for (int i = 0; i < 100; ++i) {
+                sum += thread_function(i);
+            }
+            total += sum;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    //4 * 100 * 100
+    return total == 40000 ? 0 : 1;
+}
@@ -1,5 +1,12 @@
+#include <thread>
+
 int main() {
     /* empty loops are undefined behavior in C++ 17, so use volatile to make it safe */
-    volatile int i;
-    while (true) i = 42;
-}
\ No newline at end of file
+    auto spin = [] {
+        volatile int i;
+        while (true) i = 42;
+    };
+    //a second thread, so the tracee is waited on as a multi-threaded process
+    std::thread other(spin);
+    spin();
+}
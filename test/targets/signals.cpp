@@ -0,0 +1,20 @@
+#include <csignal>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace {
+    volatile sig_atomic_t handled = 0;
+}
+
+int main() {
+    std::signal(SIGUSR1, [](int) { handled = 1; });
+
+    //both are the program's own, the debugger has to hand them on
+    raise(SIGUSR1);
+    raise(SIGSTOP);
+
+    if (!handled) {
+        return EXIT_FAILURE;
+    }
+    write(STDOUT_FILENO, "handled\n", 8);
+}
@@ -0,0 +1,13 @@
+#include <cstdlib>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int main() {
+    //a syscall left failing by the debugger ends the loop
+    for (;;) {
+        if (syscall(SYS_getpid) < 0) {
+            return EXIT_FAILURE;
+        }
+        usleep(1000);
+    }
+}
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <fcntl.h>
 #include <string>
 #include <sys/types.h>
@@ -7,14 +8,20 @@
 #include <libsdb/pipe.hpp>
 #include <libsdb/bits.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
 #include <libsdb/error.hpp>
 #include <libsdb/register_info.hpp>
 #include <libsdb/syscalls.hpp>
 #include <libsdb/target.hpp>
+#include <libsdb/event_loop.hpp>
 #include <fstream>
 #include <iostream>
 #include <elf.h>
 #include <regex>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <map>
 
 using namespace sdb;
 namespace {
@@ -248,6 +255,29 @@ TEST_CASE("Write registers", "[register]") {
     REQUIRE(to_string_view(output) == "42.24");
 }
 
+TEST_CASE("Register writes are held until the tracee runs", "[register]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/reg_write", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    //reads see pending writes, including through sub-registers
+    auto& regs = proc->get_registers();
+    regs.write_by_id(register_id::rsi, 0xcafecafe);
+    REQUIRE(regs.read_by_id_as<std::uint64_t>(register_id::rsi) == 0xcafecafe);
+    regs.write_by_id(register_id::si, std::uint16_t{ 0xf00d });
+    REQUIRE(regs.read_by_id_as<std::uint32_t>(register_id::esi) == 0xcafef00d);
+
+    //only the final value reaches the tracee
+    proc->resume();
+    proc->wait_on_signal();
+    REQUIRE(to_string_view(channel.read()) == "0xcafef00d");
+}
+
 TEST_CASE("Read registers", "[register]") {
     auto proc = Process::launch("targets/reg_read", true);
     auto& regs = proc->get_registers();
@@ -442,6 +472,81 @@ TEST_CASE("Remove breakpoint site works", "[breakpoint]") {
 
 }
 
+TEST_CASE("Breakpoint site indexes stay consistent", "[breakpoint]") {
+    auto proc = Process::launch("targets/run_endlessly");
+    auto& sites = proc->breakpoint_sites();
+
+    //added out of address order so the region index has to sort them
+    std::vector<breakpoint_site::id_type> ids;
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        ids.push_back(proc->create_breakpoint_site(virt_addr{ 0x10000 + (i * 7919) % 1000 * 16 }).id());
+    }
+
+    auto region = sites.get_in_region(virt_addr{ 0x10000 + 100 * 16 }, virt_addr{ 0x10000 + 200 * 16 });
+    REQUIRE(region.size() == 100);
+    REQUIRE(std::is_sorted(region.begin(), region.end(),
+                           [](auto lhs, auto rhs) { return lhs->address() < rhs->address(); }));
+
+    //removals are reflected in every index
+    sites.remove_by_address(virt_addr{ 0x10000 + 150 * 16 });
+    sites.remove_by_id(ids[0]);
+    REQUIRE(sites.size() == 998);
+    REQUIRE(!sites.contains_address(virt_addr{ 0x10000 + 150 * 16 }));
+    REQUIRE(!sites.contains_id(ids[0]));
+    REQUIRE(!sites.contains_address(virt_addr{ 0x10000 }));
+    REQUIRE(sites.get_in_region(virt_addr{ 0x10000 + 100 * 16 }, virt_addr{ 0x10000 + 200 * 16 }).size() == 99);
+
+    auto& site = sites.get_by_id(ids[1]);
+    REQUIRE(&sites.get_by_address(site.address()) == &site);
+    REQUIRE_THROWS_AS(sites.remove_by_id(ids[0]), error);
+}
+
+TEST_CASE("Bulk enabling breakpoint sites matches one at a time", "[breakpoint]") {
+    auto proc = Process::launch("targets/run_endlessly");
+    auto& text = *std::find_if(proc->get_memory_map().begin(), proc->get_memory_map().end(),
+                               [](auto& region) { return region.executable and region.path.find("ld-linux") != std::string::npos; });
+    auto original = proc->read_memory(text.low, 3 * 0x1000);
+
+    //a few sites per page across page boundaries, plus one enabled the slow way
+    std::vector<breakpoint_site*> sites;
+    for (std::uint64_t offset : { 0x10, 0x11, 0xfff, 0x1000, 0x1800, 0x2ffe }) {
+        sites.push_back(&proc->create_breakpoint_site(text.low + offset));
+    }
+    sites[2]->enable();
+
+    proc->enable_breakpoint_sites(sites);
+    auto patched = proc->read_memory(text.low, 3 * 0x1000);
+    for (auto site : sites) {
+        auto offset = site->address().addr() - text.low.addr();
+        REQUIRE(site->is_enabled());
+        REQUIRE(patched[offset] == std::byte{ 0xcc });
+        patched[offset] = original[offset];
+    }
+    REQUIRE(patched == original);
+
+    //disabling one at a time and in bulk both restore what was saved
+    sites[0]->disable();
+    proc->disable_breakpoint_sites(sites);
+    REQUIRE(proc->read_memory(text.low, 3 * 0x1000) == original);
+    REQUIRE(std::none_of(sites.begin(), sites.end(), [](auto site) { return site->is_enabled(); }));
+}
+
+TEST_CASE("Bulk enabling a breakpoint site listed twice keeps the original byte", "[breakpoint]") {
+    auto proc = Process::launch("targets/run_endlessly");
+    auto& text = *std::find_if(proc->get_memory_map().begin(), proc->get_memory_map().end(),
+                               [](auto& region) { return region.executable and region.path.find("ld-linux") != std::string::npos; });
+    auto original = proc->read_memory(text.low, 0x1000);
+
+    auto& site = proc->create_breakpoint_site(text.low + 0x10);
+    proc->enable_breakpoint_sites({ &site, &site });
+    REQUIRE(site.is_enabled());
+    REQUIRE(proc->read_memory(text.low + 0x10, 1)[0] == std::byte{ 0xcc });
+
+    proc->disable_breakpoint_sites({ &site, &site });
+    REQUIRE(!site.is_enabled());
+    REQUIRE(proc->read_memory(text.low, 0x1000) == original);
+}
+
 /*****************
 ***** MEMORY *****
 *****************/
@@ -468,47 +573,380 @@ TEST_CASE("Reading and writing memory works", "[memory]") {
     REQUIRE(data == 0xcafecafe);
 }
 
-TEST_CASE("Hardware breakpoint evades checkpoints", "[breakpoint]") {
+TEST_CASE("Memory cache serves repeated reads", "[memory]") {
     bool close_on_exec = false;
     sdb::pipe channel(close_on_exec);
 
-    auto proc = Process::launch("targets/anti_debugger", true, channel.get_write());
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
     channel.close_write();
 
     proc->resume();
     proc->wait_on_signal();
 
-    //read an_innocent_function address from the pipe
-    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
 
-    //software breakpoint with this address
-    auto &software_site = proc->create_breakpoint_site(func, false);
-    software_site.enable();
+    //first read fetches the page, the second is served from the cache
+    proc->read_memory(a_pointer, 8);
+    auto misses = proc->memory_cache().misses();
+    REQUIRE(proc->read_memory_as<std::uint64_t>(a_pointer) == 0xcafecafe);
+    REQUIRE(proc->memory_cache().misses() == misses);
+    REQUIRE(proc->memory_cache().hits() >= 1);
 
+    //writes keep the cached page coherent
+    std::uint64_t value = 0xba5eba11;
+    proc->write_memory(a_pointer, {as_bytes(value), sizeof(value)});
+    REQUIRE(proc->read_memory_as<std::uint64_t>(a_pointer) == 0xba5eba11);
+    REQUIRE(proc->memory_cache().misses() == misses);
+
+    //resuming drops the cache
     proc->resume();
     proc->wait_on_signal();
+    REQUIRE(proc->memory_cache().size() == 0);
+}
 
+TEST_CASE("Batched memory reads report failures per request", "[memory]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
 
-    //software breakpoint gets outmaneuvered
-    REQUIRE(to_string_view(channel.read()) == "Ultra bamboozled bratan!\n");
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
 
-    proc->breakpoint_sites().remove_by_id(software_site.id());
-    auto &hardware_site = proc->create_breakpoint_site(func, true, false);
-    hardware_site.enable();
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    std::uint64_t first = 0, second = 0;
+    std::byte unmapped[16];
+    memory_read_request requests[] = {
+        { a_pointer, { as_bytes(first), sizeof(first) } },
+        { virt_addr{ 0x8 }, { unmapped, sizeof(unmapped) } },
+        { a_pointer, { as_bytes(second), sizeof(second) } },
+    };
+
+    REQUIRE(proc->read_memory_batch({ requests, 3 }) == 1);
+    REQUIRE(requests[0].success);
+    REQUIRE(!requests[1].success);
+    REQUIRE(requests[2].success);
+    REQUIRE(first == 0xcafecafe);
+    REQUIRE(second == 0xcafecafe);
+}
+
+TEST_CASE("Memory map index answers address queries", "[memory]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
 
     proc->resume();
     proc->wait_on_signal();
 
-    //hardware stays right at func, nowhere else
-    REQUIRE(proc->get_pc() == func);
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    auto& maps = proc->get_memory_map();
+
+    //a lives on the stack, the pc in executable text
+    auto region = maps.find(a_pointer);
+    REQUIRE(region != nullptr);
+    REQUIRE(region->path == "[stack]");
+    REQUIRE(region->writable);
+    REQUIRE(proc->is_executable(proc->get_pc()));
+    REQUIRE(!proc->is_mapped(virt_addr{ 0x8 }));
+
+    //reads running off the end of the stack are clipped instead of failing
+    auto to_end = region->high.addr() - a_pointer.addr();
+    REQUIRE(proc->read_memory_partial(a_pointer, to_end + 0x1000).size() == to_end);
+    REQUIRE(proc->read_memory_partial(virt_addr{ 0x8 }, 8).empty());
+}
+
+TEST_CASE("Memory search finds values across the address space", "[memory]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
 
     proc->resume();
     proc->wait_on_signal();
 
-    REQUIRE(to_string_view(channel.read()) == "You just got bamboozled! You bimbo\n");
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    //plant a value nothing else in the process should hold
+    std::uint64_t magic = 0x1badb002deadbeef;
+    proc->write_memory(a_pointer, {as_bytes(magic), sizeof(magic)});
+
+    memory_search_options options;
+    options.writable = true;
+    auto result = proc->search_memory({as_bytes(magic), sizeof(magic)}, options);
+    REQUIRE(std::find(result.matches.begin(), result.matches.end(), a_pointer) != result.matches.end());
+    REQUIRE(result.bytes_scanned > 0);
+
+    //restricting the range and using the smallest buffer still finds it exactly once, also where it
+    //straddles the end of the first chunk. The stack is used from the top, its first page is free
+    auto& stack = *proc->get_memory_map().find(a_pointer);
+    auto straddling = stack.low + page_cache::page_size - 4;
+    proc->write_memory(straddling, {as_bytes(magic), sizeof(magic)});
+    options.low = stack.low;
+    options.high = stack.high;
+    options.buffer_size = 16;
+    result = proc->search_memory({as_bytes(magic), sizeof(magic)}, options);
+    REQUIRE(std::count(result.matches.begin(), result.matches.end(), a_pointer) == 1);
+    REQUIRE(std::count(result.matches.begin(), result.matches.end(), straddling) == 1);
+
+    //nothing executable holds it
+    options = {};
+    options.executable = true;
+    result = proc->search_memory({as_bytes(magic), sizeof(magic)}, options);
+    REQUIRE(std::find(result.matches.begin(), result.matches.end(), a_pointer) == result.matches.end());
+
+    //code under a breakpoint is found as it was, not with our int3 in it
+    auto pc = proc->get_pc();
+    auto code = proc->read_memory(pc, 8);
+    proc->create_breakpoint_site(pc + 3).enable();
+    options.low = pc;
+    options.high = pc + 8;
+    result = proc->search_memory({code.data(), code.size()}, options);
+    REQUIRE(result.matches.size() == 1);
+    REQUIRE(result.matches[0] == pc);
 }
 
-TEST_CASE("Watchpoint detects reads", "[watchpoint]") {
+TEST_CASE("Write paths never touch bytes past the buffer", "[memory]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    auto path = GENERATE(memory_write_path::automatic, memory_write_path::vm_writev,
+                         memory_write_path::proc_mem, memory_write_path::poke_data);
+
+    //overwrite the low three bytes of 0xcafecafe, the upper bytes must survive
+    std::byte patch[] = { std::byte{0x11}, std::byte{0x22}, std::byte{0x33} };
+    proc->write_memory(a_pointer, {patch, sizeof(patch)}, path);
+    REQUIRE(proc->read_memory_as<std::uint64_t>(a_pointer) == 0xca332211);
+
+    //read-only text is only reachable through /proc/<pid>/mem and ptrace
+    auto pc = proc->get_pc();
+    auto text = proc->read_memory(pc, 16);
+    if (path == memory_write_path::vm_writev) {
+        REQUIRE_THROWS_AS(proc->write_memory(pc, {text.data(), text.size()}, path), error);
+    } else {
+        proc->write_memory(pc, {text.data(), text.size()}, path);
+    }
+}
+
+TEST_CASE("Poking a few bytes at either end of a mapping stays inside it", "[memory]") {
+    auto proc = Process::launch("targets/run_endlessly");
+
+    //nothing is mapped before the first mapping or after the stack, which the kernel could grow down instead
+    auto& map = proc->get_memory_map();
+    auto stack = std::find_if(map.begin(), map.end(), [](auto& region) { return region.path == "[stack]"; });
+    REQUIRE(stack != map.end());
+    auto low = map.begin()->low;
+    auto high = stack->high;
+    REQUIRE(!proc->is_mapped(low - 1));
+    REQUIRE(!proc->is_mapped(high));
+
+    //the same bytes go back, only whether the write reaches outside the mapping matters
+    for (auto address : { low, high - 3 }) {
+        auto bytes = proc->read_memory(address, 3);
+        proc->write_memory(address, { bytes.data(), bytes.size() }, memory_write_path::poke_data);
+        REQUIRE(proc->read_memory(address, 3) == bytes);
+    }
+}
+
+TEST_CASE("Snapshot diff finds written bytes", "[memory]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    auto& first = proc->take_snapshot();
+    auto& second = proc->take_snapshot();
+    REQUIRE(diff_snapshots(first, second).ranges.empty());
+
+    //nothing ran in between, so an incremental snapshot has nothing to read
+    if (proc->soft_dirty_tracking()) {
+        REQUIRE(second.base_id() == first.id());
+        REQUIRE(second.pages_fetched() < first.pages_fetched());
+    }
+
+    std::uint64_t magic = 0x1badb002deadbeef;
+    auto old = proc->read_memory_as<std::uint64_t>(a_pointer);
+    proc->write_memory(a_pointer, {as_bytes(magic), sizeof(magic)});
+    auto& third = proc->take_snapshot();
+
+    auto diff = diff_snapshots(second, third);
+    REQUIRE(diff.pages_changed == 1);
+    REQUIRE(diff.ranges.size() == 1);
+    REQUIRE(diff.ranges[0].address >= a_pointer);
+    REQUIRE(diff.ranges[0].address + diff.ranges[0].size <= a_pointer + sizeof(magic));
+
+    //the change is found whichever way round the snapshots are compared
+    REQUIRE(diff_snapshots(third, first).ranges.size() == 1);
+    REQUIRE(old != magic);
+    REQUIRE(proc->get_snapshot(third.id()).id() == third.id());
+}
+
+TEST_CASE("Core file holds tracee memory", "[memory]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    std::uint64_t magic = 0x1badb002deadbeef;
+    proc->write_memory(a_pointer, {as_bytes(magic), sizeof(magic)});
+
+    auto path = std::filesystem::temp_directory_path() / ("sdb-test-core." + std::to_string(proc->get_pid()));
+    auto stats = proc->write_core(path);
+    REQUIRE(std::filesystem::file_size(path) == stats.file_size);
+    REQUIRE(stats.bytes_written < stats.file_size);
+
+    std::ifstream core(path, std::ios::binary);
+    Elf64_Ehdr header;
+    core.read(reinterpret_cast<char*>(&header), sizeof(header));
+    REQUIRE(std::memcmp(header.e_ident, ELFMAG, SELFMAG) == 0);
+    REQUIRE(header.e_type == ET_CORE);
+
+    std::vector<Elf64_Phdr> segments(header.e_phnum);
+    core.seekg(header.e_phoff);
+    core.read(reinterpret_cast<char*>(segments.data()), segments.size() * sizeof(Elf64_Phdr));
+    REQUIRE(segments[0].p_type == PT_NOTE);
+
+    auto segment = std::find_if(segments.begin(), segments.end(), [&](auto& s) {
+        return s.p_type == PT_LOAD and s.p_vaddr <= a_pointer.addr() and a_pointer.addr() < s.p_vaddr + s.p_memsz;
+    });
+    REQUIRE(segment != segments.end());
+    REQUIRE(segment->p_flags & PF_W);
+
+    std::uint64_t value = 0;
+    core.seekg(segment->p_offset + (a_pointer.addr() - segment->p_vaddr));
+    core.read(reinterpret_cast<char*>(&value), sizeof(value));
+    REQUIRE(value == magic);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Dumps searches and snapshots see through rw software watchpoints", "[memory]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    std::uint64_t magic = 0x1badb002deadbeef;
+    proc->write_memory(a_pointer, {as_bytes(magic), sizeof(magic)});
+    proc->create_watchpoint(a_pointer, sdb::stoppoint_mode::read_write, 8, true).enable();
+
+    memory_search_options options;
+    auto result = proc->search_memory({as_bytes(magic), sizeof(magic)}, options);
+    REQUIRE(std::find(result.matches.begin(), result.matches.end(), a_pointer) != result.matches.end());
+
+    const sdb::snapshot& snap = proc->take_snapshot();
+    auto region = std::find_if(snap.regions().begin(), snap.regions().end(), [&](auto& r) {
+        return r.low <= a_pointer and a_pointer < r.high;
+    });
+    REQUIRE(region != snap.regions().end());
+    REQUIRE(from_bytes<std::uint64_t>(snap.data(*region) + (a_pointer.addr() - region->low.addr())) == magic);
+
+    auto path = std::filesystem::temp_directory_path() / ("sdb-test-core." + std::to_string(proc->get_pid()));
+    proc->write_core(path);
+
+    std::ifstream core(path, std::ios::binary);
+    Elf64_Ehdr header;
+    core.read(reinterpret_cast<char*>(&header), sizeof(header));
+    std::vector<Elf64_Phdr> segments(header.e_phnum);
+    core.seekg(header.e_phoff);
+    core.read(reinterpret_cast<char*>(segments.data()), segments.size() * sizeof(Elf64_Phdr));
+
+    //the segment has the protection of the program, not ours
+    auto segment = std::find_if(segments.begin(), segments.end(), [&](auto& s) {
+        return s.p_type == PT_LOAD and s.p_vaddr <= a_pointer.addr() and a_pointer.addr() < s.p_vaddr + s.p_memsz;
+    });
+    REQUIRE(segment != segments.end());
+    REQUIRE(segment->p_flags == (PF_R | PF_W));
+
+    std::uint64_t value = 0;
+    core.seekg(segment->p_offset + (a_pointer.addr() - segment->p_vaddr));
+    core.read(reinterpret_cast<char*>(&value), sizeof(value));
+    REQUIRE(value == magic);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Restarting a checkpoint restores memory and breakpoints", "[checkpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto a_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    auto pc = proc->get_pc();
+    proc->create_breakpoint_site(pc).enable();
+
+    auto id = proc->create_checkpoint();
+    REQUIRE(proc->checkpoints().size() == 1);
+
+    //the frozen copy holds the original code, not our int3
+    auto cp_pid = proc->checkpoints()[0].pid;
+    std::ifstream cp_mem("/proc/" + std::to_string(cp_pid) + "/mem", std::ios::binary);
+    cp_mem.seekg(pc.addr());
+    REQUIRE(cp_mem.get() != 0xcc);
+
+    std::uint64_t magic = 0x1badb002deadbeef;
+    proc->write_memory(a_pointer, {as_bytes(magic), sizeof(magic)});
+
+    //each restart starts from the same state
+    auto original_pid = proc->get_pid();
+    for (int i = 0; i < 2; ++i) {
+        proc->restart_checkpoint(id);
+        REQUIRE(proc->get_pid() != original_pid);
+        REQUIRE(process_exists(cp_pid));
+        REQUIRE(proc->get_pc() == pc);
+        REQUIRE(proc->read_memory_as<std::uint64_t>(a_pointer) == 0xcafecafe);
+        REQUIRE(proc->read_memory_as<std::uint8_t>(pc) == 0xcc);
+
+        proc->write_memory(a_pointer, {as_bytes(magic), sizeof(magic)});
+    }
+
+    //runs on from the checkpoint to the next raise(SIGTRAP)
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.info == SIGTRAP);
+
+    proc->delete_checkpoint(id);
+    REQUIRE(proc->checkpoints().empty());
+
+    //the copy's real parent was the killed tracee, so whoever inherited it reaps it
+    REQUIRE((!process_exists(cp_pid) or get_process_status(cp_pid) == 'Z'));
+}
+
+TEST_CASE("Hardware breakpoint evades checkpoints", "[breakpoint]") {
     bool close_on_exec = false;
     sdb::pipe channel(close_on_exec);
 
@@ -521,20 +959,26 @@ TEST_CASE("Watchpoint detects reads", "[watchpoint]") {
     //read an_innocent_function address from the pipe
     auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
 
-    auto &watch = proc->create_watchpoint(func, sdb::stoppoint_mode::read_write , 1);
-    watch.enable();
+    //software breakpoint with this address
+    auto &software_site = proc->create_breakpoint_site(func, false);
+    software_site.enable();
 
     proc->resume();
     proc->wait_on_signal();
 
-    proc->step_instruction();
-    auto& soft = proc->create_breakpoint_site(func, false);
-    soft.enable();
+
+    //software breakpoint gets outmaneuvered
+    REQUIRE(to_string_view(channel.read()) == "Ultra bamboozled bratan!\n");
+
+    proc->breakpoint_sites().remove_by_id(software_site.id());
+    auto &hardware_site = proc->create_breakpoint_site(func, true, false);
+    hardware_site.enable();
 
     proc->resume();
-    auto reason = proc->wait_on_signal();
+    proc->wait_on_signal();
 
-    REQUIRE(reason.info == SIGTRAP);
+    //hardware stays right at func, nowhere else
+    REQUIRE(proc->get_pc() == func);
 
     proc->resume();
     proc->wait_on_signal();
@@ -542,67 +986,1013 @@ TEST_CASE("Watchpoint detects reads", "[watchpoint]") {
     REQUIRE(to_string_view(channel.read()) == "You just got bamboozled! You bimbo\n");
 }
 
-TEST_CASE("Syscall mapping works", "[syscall]") {
-    REQUIRE(sdb::syscall_id_to_name(0) == "read");
-    REQUIRE(sdb::name_to_syscall_id("read") == 0);
-    REQUIRE(sdb::syscall_id_to_name(62) == "kill");
-    REQUIRE(sdb::name_to_syscall_id("kill") == 62);
+TEST_CASE("Trace buffer wraps and drops records that don't fit", "[tracepoint]") {
+    sdb::trace_buffer buffer(64);
+    REQUIRE(buffer.capacity() == 64);
+
+    std::vector<std::byte> record(20);
+    std::vector<std::byte> out;
+    //each record takes 24 bytes with its length, push and pop enough to wrap several times
+    for (int i = 0; i < 10; ++i) {
+        record[0] = record[19] = std::byte(i);
+        REQUIRE(buffer.push({ record.data(), record.size() }));
+        REQUIRE(buffer.pop(out));
+        REQUIRE(out.size() == 20);
+        REQUIRE(out[0] == std::byte(i));
+        REQUIRE(out[19] == std::byte(i));
+    }
+
+    REQUIRE(buffer.push({ record.data(), record.size() }));
+    REQUIRE(buffer.push({ record.data(), record.size() }));
+    REQUIRE(!buffer.push({ record.data(), record.size() }));
+    REQUIRE(buffer.dropped() == 1);
+    REQUIRE(buffer.pushed() == 12);
+
+    REQUIRE(buffer.pop(out));
+    REQUIRE(buffer.pop(out));
+    REQUIRE(!buffer.pop(out));
+    REQUIRE(buffer.used() == 0);
 }
 
-TEST_CASE("Syscall catchpoint works", "[catchpoint]") {
-    /* our program doesn't pollute the rest */
-    auto null_fd = open("/dev/null", O_WRONLY);
-    auto proc = Process::launch("targets/anti_debugger", true, null_fd);
+TEST_CASE("Tracepoint records state without stopping", "[tracepoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
 
-    auto write_id = sdb::name_to_syscall_id("write");
-    auto policy = sdb::syscall_catch_policy::catch_some({write_id});
-    proc->set_syscall_catch_policy(policy);
+    auto proc = Process::launch("targets/hello_sdb", true, channel.get_write());
+    channel.close_write();
+
+    //at the entry point argc is at the top of the stack
+    auto offset = get_entry_point_offset("targets/hello_sdb");
+    auto load_address = get_load_address(proc->get_pid(), offset);
+    auto& tp = proc->create_tracepoint(load_address, { register_id::rsp, register_id::rip },
+                                       { { register_id::rsp, 0, 8 } });
+    REQUIRE(tp.record_size() == 20 + 8 + 8 + 8);
 
     proc->resume();
     auto reason = proc->wait_on_signal();
 
-    REQUIRE(reason.reason == sdb::process_state::stopped);
-    REQUIRE(reason.info == SIGTRAP);
-    REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
-    REQUIRE(reason.syscall_info->id == write_id);
-    REQUIRE(reason.syscall_info->entry == true);
-
-    proc->resume();
-    reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+    REQUIRE(to_string_view(channel.read()) == "Hello, sdb!\n");
+    REQUIRE(tp.hit_count() == 1);
+
+    std::stringstream csv;
+    REQUIRE(proc->dump_trace(csv, sdb::trace_format::csv) == 1);
+
+    std::string line;
+    std::vector<std::string> fields;
+    std::getline(csv, line);
+    REQUIRE(line == "tracepoint,hit,time_ns,field,value");
+    while (std::getline(csv, line)) {
+        fields.push_back(line.substr(line.rfind(',', line.rfind(',') - 1) + 1));
+    }
+    REQUIRE(fields.size() == 3);
+    std::ostringstream expected_rip;
+    expected_rip << "rip,0x" << std::hex << std::setw(16) << std::setfill('0') << load_address.addr();
+    REQUIRE(fields[1] == expected_rip.str());
+    REQUIRE(fields[2] == "mem:rsp,0100000000000000");
+    REQUIRE(proc->get_trace_buffer()->used() == 0);
+}
 
-    REQUIRE(reason.reason == sdb::process_state::stopped);
-    REQUIRE(reason.info == SIGTRAP);
-    REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
-    REQUIRE(reason.syscall_info->id == write_id);
-    REQUIRE(reason.syscall_info->entry == false);
+TEST_CASE("Deleting a tracepoint frees its address for a breakpoint", "[tracepoint]") {
+    auto proc = Process::launch("targets/hello_sdb");
+    auto offset = get_entry_point_offset("targets/hello_sdb");
+    auto load_address = get_load_address(proc->get_pid(), offset);
 
+    auto& tp = proc->create_tracepoint(load_address, { register_id::rip });
+    proc->delete_tracepoint(tp.id());
+    REQUIRE(proc->tracepoints().empty());
+    REQUIRE(proc->breakpoint_sites().empty());
 
-    close(null_fd);
+    auto& site = proc->create_breakpoint_site(load_address);
+    site.enable();
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(proc->get_pc() == load_address);
 }
 
-TEST_CASE("ELF parser", "[elf]") {
-    auto path = "targets/hello_sdb";
-    sdb::elf elf(path);
-    auto entry = elf.header().e_entry;
+TEST_CASE("Fast tracepoint records every hit without stopping", "[tracepoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
 
-    //ensure entry point offset is the _start symbol
-    REQUIRE(entry == get_entry_point_offset(path));
+    auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+    channel.close_write();
 
-    auto sym = elf.get_symbol_at_address(file_addr{ entry, elf });
-    std::string name = elf.get_string(sym.value()->st_name);
-    //starting section name
-    REQUIRE(name == "_start");
+    proc->resume();
+    proc->wait_on_signal();
 
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    auto original = proc->read_memory(func, 16);
 
-    //if ELF file is loaded at 0xcafecafe, check if entry point offset corresponds to _start function from virtual memory
-    elf.notify_loaded(virt_addr{0xcafecafe});
-    sym = elf.get_symbol_at_address(virt_addr{ 0xcafecafe + entry });
-    name = elf.get_string(sym.value()->st_name);
-    REQUIRE(name == "_start");
+    auto& tp = proc->create_fast_tracepoint(func);
+    REQUIRE(tp.is_fast());
+    REQUIRE(tp.patch_size() >= 5);
+    REQUIRE(proc->read_memory(func, 1)[0] == std::byte{ 0xe9 });
+    REQUIRE(proc->read_memory_without_traps(func, 16) == original);
 
-    auto syms = elf.get_symbols_by_name("_init");
+    proc->resume();
+    auto reason = proc->wait_on_signal();
 
-    //first element in the ELF file
+    //the trampoline must leave registers and flags as they were for the sum to come out right
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+
+    REQUIRE(proc->collect_fast_trace() == 1000);
+    REQUIRE(tp.hit_count() == 1000);
+    REQUIRE(proc->fast_trace_dropped() == 0);
+
+    std::stringstream csv;
+    REQUIRE(proc->dump_trace(csv, sdb::trace_format::csv) == 1000);
+
+    //rdi holds the argument of each call
+    std::string line;
+    std::vector<std::uint64_t> arguments;
+    while (std::getline(csv, line)) {
+        auto field = line.find(",rdi,");
+        if (field != std::string::npos) {
+            arguments.push_back(std::stoull(line.substr(field + 5), nullptr, 16));
+        }
+    }
+    REQUIRE(arguments.size() == 1000);
+    for (std::uint64_t i = 0; i < arguments.size(); ++i) {
+        REQUIRE(arguments[i] == i);
+    }
+}
+
+TEST_CASE("Breakpoints are stepped over without removing the int3", "[breakpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    auto original = proc->read_memory_without_traps(func, 16);
+    proc->create_breakpoint_site(func).enable();
+
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.reason == process_state::stopped);
+        REQUIRE(proc->get_pc() == func);
+        REQUIRE(proc->get_registers().read_by_id_as<std::uint64_t>(register_id::rdi) == i);
+
+        //every other hit single steps off the breakpoint first
+        if (i % 2) {
+            proc->step_instruction();
+            REQUIRE(proc->get_pc() > func);
+            REQUIRE(proc->get_pc() < func + 16);
+        }
+        REQUIRE(proc->read_memory(func, 1)[0] == std::byte{ 0xcc });
+    }
+    REQUIRE(proc->read_memory_without_traps(func, 16) == original);
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+}
+
+TEST_CASE("Breakpoints on function entries are passed by emulation", "[breakpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    proc->create_breakpoint_site(func).enable();
+    proc->reset_step_over_stats();
+
+    //endbr64 or push rbp, neither needs the tracee to run
+    for (std::uint64_t i = 0; i < 1000; ++i) {
+        proc->resume();
+        REQUIRE(proc->wait_on_signal().reason == process_state::stopped);
+        REQUIRE(proc->get_pc() == func);
+    }
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+
+    auto& stats = proc->get_step_over_stats();
+    REQUIRE(stats.emulated == 1000);
+    REQUIRE(stats.displaced == 0);
+    REQUIRE(stats.stepped == 0);
+}
+
+TEST_CASE("Emulated instructions match a real single step", "[breakpoint]") {
+    constexpr int steps = 15;
+    constexpr std::uint64_t arithmetic_flags = 0x8d5;
+
+    struct machine_state {
+        std::array<std::uint64_t, 6> gprs;
+        std::uint64_t flags;
+        std::vector<std::byte> stack;   /* around rsp, where the stores and pushes go */
+    };
+    auto capture = [&](Process& proc) {
+        auto& regs = proc.get_registers();
+        machine_state state;
+        state.gprs = {
+            regs.read_by_id_as<std::uint64_t>(register_id::rax), regs.read_by_id_as<std::uint64_t>(register_id::rbx),
+            regs.read_by_id_as<std::uint64_t>(register_id::rcx), regs.read_by_id_as<std::uint64_t>(register_id::rdx),
+            regs.read_by_id_as<std::uint64_t>(register_id::rsp), regs.read_by_id_as<std::uint64_t>(register_id::rip)
+        };
+        state.flags = regs.read_by_id_as<std::uint64_t>(register_id::eflags) & arithmetic_flags;
+        state.stack = proc.read_memory(virt_addr{ state.gprs[4] - 8 }, 24);
+        return state;
+    };
+
+    //the processor runs each instruction
+    auto stepped = Process::launch("targets/emulation");
+    stepped->resume();
+    REQUIRE(stepped->wait_on_signal().info == SIGTRAP);
+
+    std::vector<virt_addr> pcs;
+    std::vector<machine_state> expected;
+    for (auto i = 0; i < steps; ++i) {
+        pcs.push_back(stepped->get_pc());
+        stepped->step_instruction();
+        expected.push_back(capture(*stepped));
+    }
+
+    //a breakpoint on each one, passed by emulation where we can
+    auto emulated = Process::launch("targets/emulation");
+    emulated->resume();
+    REQUIRE(emulated->wait_on_signal().info == SIGTRAP);
+    REQUIRE(emulated->get_pc() == pcs.front());
+    for (auto pc : pcs) {
+        if (!emulated->breakpoint_sites().contains_address(pc)) {
+            emulated->create_breakpoint_site(pc).enable();
+        }
+    }
+    emulated->reset_step_over_stats();
+
+    for (auto i = 0; i < steps; ++i) {
+        if (i + 1 < steps) {
+            emulated->resume();
+            REQUIRE(emulated->wait_on_signal().reason == process_state::stopped);
+        } else {
+            emulated->step_instruction();
+        }
+        auto state = capture(*emulated);
+        INFO("after step " << i);
+        REQUIRE(state.gprs == expected[i].gprs);
+        REQUIRE(state.flags == expected[i].flags);
+        REQUIRE(state.stack == expected[i].stack);
+    }
+
+    //everything up to the ret, the last step never passed a breakpoint on resume
+    REQUIRE(emulated->get_step_over_stats().emulated == 12);
+}
+
+TEST_CASE("Core files show the code under fast tracepoints", "[tracepoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    auto original = proc->read_memory(func, 16);
+    proc->create_fast_tracepoint(func);
+
+    auto path = std::filesystem::temp_directory_path() / ("sdb-test-core." + std::to_string(proc->get_pid()));
+    proc->write_core(path);
+
+    std::ifstream core(path, std::ios::binary);
+    Elf64_Ehdr header;
+    core.read(reinterpret_cast<char*>(&header), sizeof(header));
+    std::vector<Elf64_Phdr> segments(header.e_phnum);
+    core.seekg(header.e_phoff);
+    core.read(reinterpret_cast<char*>(segments.data()), segments.size() * sizeof(Elf64_Phdr));
+
+    auto segment = std::find_if(segments.begin(), segments.end(), [&](auto& s) {
+        return s.p_type == PT_LOAD and s.p_vaddr <= func.addr() and func.addr() < s.p_vaddr + s.p_memsz;
+    });
+    REQUIRE(segment != segments.end());
+
+    std::vector<std::byte> code(original.size());
+    core.seekg(segment->p_offset + (func.addr() - segment->p_vaddr));
+    core.read(reinterpret_cast<char*>(code.data()), code.size());
+    REQUIRE(code == original);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Fast tracepoints aren't patched over a stopped thread", "[tracepoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/multi_threaded", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    //a thread stopped past the first instruction, inside what the jmp would cover
+    auto& site = proc->create_breakpoint_site(func + 1, true);
+    site.enable();
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(proc->get_pc() == func + 1);
+    proc->breakpoint_sites().remove_by_id(site.id());
+
+    //it isn't the current thread
+    proc->set_current_thread(proc->get_pid());
+    REQUIRE_THROWS_AS(proc->create_fast_tracepoint(func), sdb::error);
+    REQUIRE(proc->tracepoints().empty());
+    REQUIRE(proc->read_memory(func, 1)[0] != std::byte{ 0xe9 });
+
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+}
+
+TEST_CASE("Every thread stops at a shared breakpoint", "[thread]") {
+    auto hardware = GENERATE(false, true);
+
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/multi_threaded", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    //the threads start after this, a hardware breakpoint has to reach them too
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    proc->create_breakpoint_site(func, hardware).enable();
+
+    std::map<pid_t, int> hits;
+    for (;;) {
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        if (reason.reason != process_state::stopped) {
+            REQUIRE(reason.reason == process_state::exited);
+            REQUIRE(reason.info == 0);
+            break;
+        }
+
+        REQUIRE(reason.tid == proc->current_thread());
+        REQUIRE(reason.tid != proc->get_pid());
+        REQUIRE(proc->get_pc() == func);
+        ++hits[reason.tid];
+
+        //all-stop, nothing runs while we look
+        for (auto& [tid, thread] : proc->threads()) {
+            REQUIRE(thread.state == process_state::stopped);
+        }
+    }
+
+    REQUIRE(hits.size() == 4);
+    for (auto& [tid, count] : hits) {
+        REQUIRE(count == 100);
+    }
+}
+
+TEST_CASE("Non-stop mode only stops the thread that hits a breakpoint", "[thread]") {
+    auto hardware = GENERATE(false, true);
+
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/multi_threaded", true, channel.get_write());
+    channel.close_write();
+    proc->set_non_stop(true);
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    proc->create_breakpoint_site(func, hardware).enable();
+
+    std::map<pid_t, int> hits;
+    for (;;) {
+        //only the thread that stopped is continued, the rest never stopped
+        proc->resume(reason.tid);
+        reason = proc->wait_on_signal();
+        if (reason.reason != process_state::stopped) {
+            REQUIRE(reason.reason == process_state::exited);
+            REQUIRE(reason.info == 0);
+            break;
+        }
+
+        REQUIRE(reason.tid == proc->current_thread());
+        REQUIRE(proc->get_pc() == func);
+        ++hits[reason.tid];
+
+        //a thread the int3 step-over briefly paused may have stopped for itself, it is reported next
+        for (auto& [tid, thread] : proc->threads()) {
+            if (tid != reason.tid and thread.state == process_state::stopped) {
+                REQUIRE(thread.pending_report);
+            }
+        }
+    }
+
+    REQUIRE(hits.size() == 4);
+    for (auto& [tid, count] : hits) {
+        REQUIRE(count == 100);
+    }
+}
+
+TEST_CASE("Non-stop mode reads memory a running thread writes", "[thread]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/counting_thread", true, channel.get_write());
+    channel.close_write();
+    proc->set_non_stop(true);
+
+    //the main thread stops on its SIGTRAP while the other keeps counting
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(reason.tid == proc->get_pid());
+
+    auto counter = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+    auto first = proc->read_memory_as<std::uint64_t>(counter);
+    usleep(10000);
+    auto second = proc->read_memory_as<std::uint64_t>(counter);
+    REQUIRE(second > first);
+}
+
+TEST_CASE("Event loop waits on several tracees at once", "[event_loop]") {
+    sdb::event_loop loop;
+    auto endless = Process::launch("targets/run_endlessly");
+    auto ending = Process::launch("targets/end_immediately");
+
+    std::vector<std::pair<pid_t, stop_reason>> stops;
+    auto on_stop = [&](Process& proc, const stop_reason& reason) { stops.push_back({ proc.get_pid(), reason }); };
+    loop.watch(*endless, on_stop);
+    loop.watch(*ending, on_stop);
+
+    //with its second thread running, polling the endless one must not take the other's exit
+    endless->resume();
+    loop.poll(*endless);
+    for (auto i = 0; i < 100 and endless->threads().size() < 2; ++i) {
+        loop.run_once(100);
+    }
+    REQUIRE(endless->threads().size() == 2);
+
+    ending->resume();
+    for (auto i = 0; i < 100 and get_process_status(ending->get_pid()) != 'Z'; ++i) {
+        usleep(10000);
+    }
+    loop.poll(*endless);
+    loop.poll(*ending);
+
+    //one ends by itself, the other runs until it is interrupted
+    for (auto i = 0; i < 100 and stops.empty(); ++i) {
+        loop.run_once(100);
+    }
+    REQUIRE(stops.size() == 1);
+    REQUIRE(stops[0].first == ending->get_pid());
+    REQUIRE(stops[0].second.reason == process_state::exited);
+    REQUIRE(endless->get_state() == process_state::running);
+
+    loop.interrupt(*endless);
+    for (auto i = 0; i < 100 and stops.size() == 1; ++i) {
+        loop.run_once(100);
+    }
+    REQUIRE(stops.size() == 2);
+    REQUIRE(stops[1].first == endless->get_pid());
+    REQUIRE(stops[1].second.reason == process_state::stopped);
+    REQUIRE(stops[1].second.info == SIGSTOP);
+    REQUIRE(get_process_status(endless->get_pid()) == 't');
+
+    loop.unwatch(*endless);
+    loop.unwatch(*ending);
+}
+
+TEST_CASE("Event loop reports a stopped tracee that gets killed", "[event_loop]") {
+    sdb::event_loop loop;
+    auto proc = Process::launch("targets/run_endlessly");
+
+    std::vector<stop_reason> stops;
+    loop.watch(*proc, [&](Process&, const stop_reason& reason) { stops.push_back(reason); });
+
+    proc->resume();
+    loop.interrupt(*proc);
+    for (auto i = 0; i < 100 and stops.empty(); ++i) {
+        loop.run_once(100);
+    }
+    REQUIRE(stops.size() == 1);
+    REQUIRE(proc->get_state() == process_state::stopped);
+
+    kill(proc->get_pid(), SIGKILL);
+    for (auto i = 0; i < 100 and stops.size() == 1; ++i) {
+        loop.run_once(100);
+    }
+    REQUIRE(stops.size() == 2);
+    REQUIRE(stops[1].reason == process_state::terminated);
+    REQUIRE(stops[1].info == SIGKILL);
+
+    //nothing is left readable
+    REQUIRE_FALSE(loop.run_once(0));
+    loop.unwatch(*proc);
+}
+
+TEST_CASE("Watchpoint detects reads", "[watchpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/anti_debugger", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    //read an_innocent_function address from the pipe
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    auto &watch = proc->create_watchpoint(func, sdb::stoppoint_mode::read_write , 1);
+    watch.enable();
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    proc->step_instruction();
+    auto& soft = proc->create_breakpoint_site(func, false);
+    soft.enable();
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+
+    REQUIRE(reason.info == SIGTRAP);
+
+    proc->resume();
+    proc->wait_on_signal();
+
+    REQUIRE(to_string_view(channel.read()) == "You just got bamboozled! You bimbo\n");
+}
+
+TEST_CASE("Software watchpoints watch any range", "[watchpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+    channel.read();
+
+    proc->resume();
+    proc->wait_on_signal();
+    auto b_pointer = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    //12 bytes is too big for a debug register
+    auto& watch = proc->create_watchpoint(b_pointer, sdb::stoppoint_mode::read_write, 12, true);
+    watch.enable();
+
+    //the page can't be read by the tracee, we still can
+    REQUIRE(proc->read_memory(b_pointer, 12).size() == 12);
+
+    //b shares its page with the stack, every push and call faults on the way to printf reading it
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(reason.trap_reason == sdb::trap_type::software_watch);
+    REQUIRE(reason.software_watchpoint == watch.id());
+
+    auto& stats = proc->get_software_watch_stats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.false_positives > 0);
+    REQUIRE(stats.faults == stats.hits + stats.false_positives);
+
+    //with the protection gone the process runs to the end
+    watch.disable();
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == sdb::process_state::exited);
+}
+
+TEST_CASE("Detaching gives watched pages their protection back", "[watchpoint]") {
+    auto target = Process::launch("targets/run_endlessly", false);
+    {
+        auto proc = Process::attach(target->get_pid());
+
+        //the main thread writes its loop counter on this page
+        auto rsp = proc->get_registers().read_by_id_as<std::uint64_t>(sdb::register_id::rsp);
+        auto& watch = proc->create_watchpoint(virt_addr{ rsp & ~std::uint64_t(0xfff) }, sdb::stoppoint_mode::write, 8, true);
+        watch.enable();
+    }
+
+    //a write to a page still protected would kill it
+    usleep(100000);
+    REQUIRE(get_process_status(target->get_pid()) != 'Z');
+}
+
+TEST_CASE("Conditions compile to bytecode", "[condition]") {
+    sdb::condition_context context;
+    context.hits = 300;
+    context.value = 0;
+    context.old = 7;
+
+    REQUIRE(sdb::condition::compile("hits % 100 == 0").evaluate(context));
+    REQUIRE(sdb::condition::compile("value == 0 && old != value").evaluate(context));
+    REQUIRE(sdb::condition::compile("1 + 2 * 3 == 7").evaluate(context));
+    REQUIRE(sdb::condition::compile("(1 + 2) * 3 == 9").evaluate(context));
+    REQUIRE(sdb::condition::compile("0x10 >> 4 == 1 || hits / 0").evaluate(context));
+    REQUIRE(sdb::condition::compile("-1 == ~0").evaluate(context));
+    REQUIRE_FALSE(sdb::condition::compile("!hits").evaluate(context));
+    REQUIRE_FALSE(sdb::condition::compile("old < 5 | value").evaluate(context));
+
+    REQUIRE_THROWS_AS(sdb::condition::compile(""), sdb::error);
+    REQUIRE_THROWS_AS(sdb::condition::compile("hits =="), sdb::error);
+    REQUIRE_THROWS_AS(sdb::condition::compile("(hits"), sdb::error);
+    REQUIRE_THROWS_AS(sdb::condition::compile("nope > 1"), sdb::error);
+    REQUIRE_THROWS_AS(sdb::condition::compile("xmm0 > 1"), sdb::error);
+
+    //nesting without operands must not run the parser off the stack
+    REQUIRE(sdb::condition::compile(std::string(10, '!') + "hits").evaluate(context));
+    REQUIRE_THROWS_AS(sdb::condition::compile(std::string(100000, '!') + "hits"), sdb::error);
+    REQUIRE_THROWS_AS(sdb::condition::compile(std::string(100000, '(') + "hits"), sdb::error);
+}
+
+TEST_CASE("Conditional breakpoints only stop when the condition holds", "[breakpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+
+    auto proc = Process::launch("targets/hot_loop", true, channel.get_write());
+    channel.close_write();
+
+    proc->resume();
+    proc->wait_on_signal();
+    auto func = virt_addr(from_bytes<std::uint64_t>(channel.read().data()));
+
+    auto& site = proc->create_breakpoint_site(func);
+    site.set_condition(sdb::condition::compile("edi == 500"));
+    site.enable();
+
+    //the first 500 calls are resumed from inside wait_on_signal
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.trap_reason == sdb::trap_type::software_break);
+    REQUIRE(proc->get_pc() == func);
+    REQUIRE(proc->get_registers().read_by_id_as<std::uint32_t>(sdb::register_id::edi) == 500);
+    REQUIRE(site.hit_count() == 501);
+
+    site.set_condition(sdb::condition::compile("hits % 100 == 0"));
+    proc->resume();
+    proc->wait_on_signal();
+    REQUIRE(site.hit_count() == 600);
+    REQUIRE(proc->get_registers().read_by_id_as<std::uint32_t>(sdb::register_id::edi) == 599);
+
+    //never true, the loop runs to the end
+    site.set_condition(sdb::condition::compile("hits == 0"));
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == sdb::process_state::exited);
+    REQUIRE(site.hit_count() == 1000);
+}
+
+TEST_CASE("Syscall mapping works", "[syscall]") {
+    REQUIRE(sdb::syscall_id_to_name(0) == "read");
+    REQUIRE(sdb::name_to_syscall_id("read") == 0);
+    REQUIRE(sdb::syscall_id_to_name(62) == "kill");
+    REQUIRE(sdb::name_to_syscall_id("kill") == 62);
+
+    //every name the perfect hash knows maps back to its own id
+    for (int id = 0; id <= 448; ++id) {
+        try {
+            auto name = sdb::syscall_id_to_name(id);
+            REQUIRE(sdb::name_to_syscall_id(name) == id);
+        } catch (const sdb::error&) {
+            //ids without a syscall
+        }
+    }
+    REQUIRE_THROWS_AS(sdb::name_to_syscall_id("reed"), sdb::error);
+    REQUIRE_THROWS_AS(sdb::name_to_syscall_id(""), sdb::error);
+
+    //ids we have no name for still print
+    REQUIRE(sdb::syscall_display_name(1) == "write");
+    REQUIRE_THROWS_AS(sdb::syscall_id_to_name(1000), sdb::error);
+    REQUIRE(sdb::syscall_display_name(1000) == "syscall_1000");
+}
+
+TEST_CASE("Syscall arguments decode by type", "[catchpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+    auto proc = Process::launch("targets/hello_sdb", true, channel.get_write());
+    channel.close_write();
+
+    auto write_id = sdb::name_to_syscall_id("write");
+    proc->set_syscall_catch_policy(sdb::syscall_catch_policy::catch_some({ write_id }));
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
+    REQUIRE(reason.syscall_info->entry);
+
+    auto args = reason.syscall_info->args;
+    REQUIRE(sdb::decode_syscall(*proc, write_id, args) == "write(1, \"Hello, sdb!\\n\", 12)");
+
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(!reason.syscall_info->entry);
+    REQUIRE(sdb::decode_syscall(*proc, write_id, args, reason.syscall_info->ret) ==
+            "write(1, \"Hello, sdb!\\n\", 12) = 12");
+
+    //a failing read leaves its out buffer undecoded and shows the error
+    auto read_id = sdb::name_to_syscall_id("read");
+    std::array<std::int64_t, 6> read_args{ 42, 0x1000, 16 };
+    REQUIRE(sdb::decode_syscall(*proc, read_id, read_args, -EBADF) == "read(42, 0x1000, 16) = -1 (Bad file descriptor)");
+    REQUIRE(sdb::get_syscall_signature(sdb::name_to_syscall_id("process_mrelease")) == nullptr);
+}
+
+TEST_CASE("Syscall catchpoint works", "[catchpoint]") {
+    /* our program doesn't pollute the rest */
+    auto null_fd = open("/dev/null", O_WRONLY);
+    auto proc = Process::launch("targets/anti_debugger", true, null_fd);
+
+    auto write_id = sdb::name_to_syscall_id("write");
+    auto policy = sdb::syscall_catch_policy::catch_some({write_id});
+    proc->set_syscall_catch_policy(policy);
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+
+    REQUIRE(reason.reason == sdb::process_state::stopped);
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
+    REQUIRE(reason.syscall_info->id == write_id);
+    REQUIRE(reason.syscall_info->entry == true);
+
+    proc->resume();
+    reason = proc->wait_on_signal();
+
+    REQUIRE(reason.reason == sdb::process_state::stopped);
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
+    REQUIRE(reason.syscall_info->id == write_id);
+    REQUIRE(reason.syscall_info->entry == false);
+
+
+    close(null_fd);
+}
+
+TEST_CASE("Caught syscalls stop through a seccomp filter", "[catchpoint]") {
+    auto null_fd = open("/dev/null", O_WRONLY);
+    auto proc = Process::launch("targets/anti_debugger", true, null_fd);
+
+    auto write_id = sdb::name_to_syscall_id("write");
+    proc->set_syscall_catch_policy(sdb::syscall_catch_policy::catch_some({write_id}));
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
+    REQUIRE(reason.syscall_info->id == write_id);
+    REQUIRE(reason.syscall_info->entry);
+
+    //the filter was installed on the first resume
+    std::ifstream status("/proc/" + std::to_string(proc->get_pid()) + "/status");
+    std::string line;
+    bool filtered = false;
+    while (std::getline(status, line)) {
+        if (line.rfind("Seccomp:", 0) == 0) {
+            filtered = line.find('2') != std::string::npos;
+        }
+    }
+    REQUIRE(filtered);
+
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
+    REQUIRE_FALSE(reason.syscall_info->entry);
+
+    //the filter stays, its stops are passed over once nothing is caught
+    proc->set_syscall_catch_policy(sdb::syscall_catch_policy::catch_none());
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(reason.trap_reason != sdb::trap_type::syscall);
+
+    close(null_fd);
+}
+
+TEST_CASE("Caught syscalls still work after detaching", "[catchpoint]") {
+    auto target = Process::launch("targets/syscall_loop", false);
+    auto getpid_id = sdb::name_to_syscall_id("getpid");
+    {
+        auto proc = Process::attach(target->get_pid());
+        proc->set_syscall_catch_policy(sdb::syscall_catch_policy::catch_some({ getpid_id }));
+        proc->resume();
+        auto reason = proc->wait_on_signal();
+        REQUIRE(reason.trap_reason == sdb::trap_type::syscall);
+        REQUIRE(reason.syscall_info->id == getpid_id);
+
+        //a seccomp filter would outlive the attachment
+        std::ifstream status("/proc/" + std::to_string(proc->get_pid()) + "/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("Seccomp:", 0) == 0) {
+                REQUIRE(line.find('0') != std::string::npos);
+            }
+        }
+    }
+
+    //the loop exits as soon as getpid fails
+    usleep(100000);
+    REQUIRE(get_process_status(target->get_pid()) != 'Z');
+}
+
+TEST_CASE("Caught syscalls work in forked children", "[catchpoint]") {
+    auto proc = Process::launch("targets/forking");
+    auto getppid_id = sdb::name_to_syscall_id("getppid");
+    proc->set_syscall_catch_policy(sdb::syscall_catch_policy::catch_some({ getppid_id }));
+
+    //only the children make the syscall, their stops aren't reported. The parent stops for SIGCHLDs
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    while (reason.reason == sdb::process_state::stopped and reason.info == SIGCHLD) {
+        proc->resume();
+        reason = proc->wait_on_signal();
+    }
+    REQUIRE(reason.reason == sdb::process_state::exited);
+    REQUIRE(reason.info == 0);
+}
+
+TEST_CASE("Syscall tracing logs every syscall", "[catchpoint]") {
+    bool close_on_exec = false;
+    sdb::pipe channel(close_on_exec);
+    auto proc = Process::launch("targets/memory", true, channel.get_write());
+    channel.close_write();
+
+    //nothing is caught, the syscall stops are resumed from inside wait_on_signal
+    proc->set_syscall_tracing(true);
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(reason.trap_reason != sdb::trap_type::syscall);
+
+    auto& log = proc->get_syscall_log();
+    REQUIRE(log.size() > 0);
+
+    //the address of a went out through write
+    auto write_id = sdb::name_to_syscall_id("write");
+    bool found_write = false;
+    for (std::size_t row = 0; row < log.size(); ++row) {
+        REQUIRE(log.entry_ns(row) <= log.exit_ns(row));
+        if (log.id(row) == write_id and log.arg(row, 0) == STDOUT_FILENO) {
+            REQUIRE(log.arg(row, 2) == 8);
+            REQUIRE(log.ret(row) == 8);
+            //decoded at the exit stop, nothing reads the tracee afterwards
+            REQUIRE(log.text(row).rfind("write(1, ", 0) == 0);
+            REQUIRE(log.text(row).find(" = 8") != std::string::npos);
+            found_write = true;
+        }
+    }
+    REQUIRE(found_write);
+
+    auto summary = log.summarize();
+    auto write_summary = std::find_if(summary.begin(), summary.end(), [&](auto& s) { return s.id == write_id; });
+    REQUIRE(write_summary != summary.end());
+    REQUIRE(write_summary->count >= 1);
+    REQUIRE(write_summary->p50_ns <= write_summary->p99_ns);
+
+    std::ostringstream out;
+    log.dump(out);
+    auto dumped = out.str();
+    REQUIRE(dumped.substr(0, 8) == "SDBSYSLG");
+    REQUIRE(dumped.size() == 8 + 4 + 8 + log.size() * (2 + 6 * 8 + 8 + 8 + 8));
+}
+
+TEST_CASE("trace-syscalls prints each syscall as it returns", "[catchpoint]") {
+    //the trace goes to stderr, the program's own output and the stats to stdout
+    auto pipe = popen(SDB_TOOL_PATH " trace-syscalls targets/hello_sdb 2>&1", "r");
+    REQUIRE(pipe != nullptr);
+    std::string output;
+    char chunk[4096];
+    while (auto read = fread(chunk, 1, sizeof(chunk), pipe)) {
+        output.append(chunk, read);
+    }
+    REQUIRE(pclose(pipe) == 0);
+
+    REQUIRE(output.find("Hello, sdb!\n") != std::string::npos);
+    REQUIRE(output.find("write(1, \"Hello, sdb!\\n\", 12) = 12\n") != std::string::npos);
+    REQUIRE(std::regex_search(output, std::regex(R"(\nwrite +1 +0 )")));
+}
+
+TEST_CASE("Signals the program stops with are delivered when it resumes", "[process]") {
+    auto proc = Process::launch("targets/signals");
+
+    proc->resume();
+    auto reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.info == SIGUSR1);
+    REQUIRE_FALSE(reason.interrupted);
+
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::stopped);
+    REQUIRE(reason.info == SIGSTOP);
+
+    //its own SIGSTOP doesn't keep it stopped
+    proc->resume();
+    reason = proc->wait_on_signal();
+    REQUIRE(reason.reason == process_state::exited);
+    REQUIRE(reason.info == 0);
+}
+
+TEST_CASE("trace-syscalls hands signals on and only ends on an interrupt", "[catchpoint]") {
+    auto pipe = popen(SDB_TOOL_PATH " trace-syscalls targets/signals 2>&1", "r");
+    REQUIRE(pipe != nullptr);
+    std::string output;
+    char chunk[4096];
+    while (auto read = fread(chunk, 1, sizeof(chunk), pipe)) {
+        output.append(chunk, read);
+    }
+    REQUIRE(pclose(pipe) == 0);
+    REQUIRE(output.find("handled\n") != std::string::npos);
+}
+
+TEST_CASE("ELF parser", "[elf]") {
+    auto path = "targets/hello_sdb";
+    sdb::elf elf(path);
+    auto entry = elf.header().e_entry;
+
+    //ensure entry point offset is the _start symbol
+    REQUIRE(entry == get_entry_point_offset(path));
+
+    auto sym = elf.get_symbol_at_address(file_addr{ entry, elf });
+    std::string name = elf.get_string(sym.value()->st_name);
+    //starting section name
+    REQUIRE(name == "_start");
+
+
+    //if ELF file is loaded at 0xcafecafe, check if entry point offset corresponds to _start function from virtual memory
+    elf.notify_loaded(virt_addr{0xcafecafe});
+    sym = elf.get_symbol_at_address(virt_addr{ 0xcafecafe + entry });
+    name = elf.get_string(sym.value()->st_name);
+    REQUIRE(name == "_start");
+
+    auto syms = elf.get_symbols_by_name("_init");
+
+    //first element in the ELF file
     name = elf.get_string(syms.at(0)->st_name);
     REQUIRE(name == "_init");
+}
+
+TEST_CASE("breakpoint set --regex takes a pattern with spaces", "[breakpoint]") {
+    auto pipe = popen("printf 'breakpoint set --regex ^(main|no such function)$\\nbreakpoint list\\n' | "
+                      SDB_TOOL_PATH " targets/hello_sdb 2>&1", "r");
+    REQUIRE(pipe != nullptr);
+    std::string output;
+    char chunk[4096];
+    while (auto read = fread(chunk, 1, sizeof(chunk), pipe)) {
+        output.append(chunk, read);
+    }
+    pclose(pipe);
+    REQUIRE(output.find("1 functions matched, 1 breakpoints created\n") != std::string::npos);
+    REQUIRE(output.find("enabled, software") != std::string::npos);
+}
+
+TEST_CASE("Functions can be found by regex", "[elf]") {
+    sdb::elf elf("targets/hot_loop");
+
+    //mangled and demangled names both match, the function comes back once
+    auto matches = elf.get_functions_matching(std::regex("hot_function"));
+    REQUIRE(matches.size() == 1);
+    REQUIRE(elf.get_string(matches[0]->st_name) == "_Z12hot_functioni");
+    REQUIRE(elf.get_functions_matching(std::regex(R"(^hot_function\(int\)$)")).size() == 1);
+    REQUIRE(elf.get_functions_matching(std::regex("^_Z12hot")).size() == 1);
+
+    auto everything = elf.get_functions_matching(std::regex(""));
+    REQUIRE(everything.size() > 2);
+    REQUIRE(std::is_sorted(everything.begin(), everything.end(),
+                           [](auto lhs, auto rhs) { return lhs->st_value < rhs->st_value; }));
+    REQUIRE(elf.get_functions_matching(std::regex("no_such_function")).empty());
+}
+
+TEST_CASE("Breakpoint sites can be created in bulk", "[breakpoint]") {
+    auto proc = Process::launch("targets/run_endlessly");
+    auto& existing = proc->create_breakpoint_site(virt_addr{ 42 });
+
+    auto sites = proc->create_breakpoint_sites({ virt_addr{ 44 }, virt_addr{ 42 }, virt_addr{ 43 }, virt_addr{ 44 } });
+    REQUIRE(sites.size() == 2);
+    REQUIRE(sites[0]->address() == virt_addr{ 43 });
+    REQUIRE(sites[1]->address() == virt_addr{ 44 });
+    REQUIRE(proc->breakpoint_sites().size() == 3);
+    REQUIRE(&proc->breakpoint_sites().get_by_address(virt_addr{ 42 }) == &existing);
+    for (auto site : sites) {
+        REQUIRE(!site->is_enabled());
+        REQUIRE(!site->is_internal());
+    }
 }
\ No newline at end of file
@@ -10,6 +10,10 @@
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <fstream>
+#include <regex>
+#include <map>
+#include <functional>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <libsdb/process.hpp>
@@ -20,6 +24,7 @@
 #include <libsdb/disassembler.hpp>
 #include <libsdb/syscalls.hpp>
 #include <libsdb/target.hpp>
+#include <libsdb/event_loop.hpp>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <csignal>
@@ -27,13 +32,6 @@
 /* anonymous namespace - usage only to the current translation unit or .cpp file */
 namespace 
 {   
-    sdb::Process* g_sdb_process = nullptr;
-
-    /* signal handler that sends a SIGSTOP */
-    void handle_sigint(int) {
-        kill(g_sdb_process->get_pid(), SIGSTOP);
-    }
-
     std::unique_ptr<sdb::target> attach(int argc, const char ** argv)
     { 
         pid_t pid = 0;
@@ -56,14 +54,40 @@ namespace
 
     /* UTILITY FUNCTIONS */
 
+    /* the words of a condition command joined back together, no words clears the condition */
+    std::optional<sdb::condition> condition_from_args(const std::vector<std::string>& args, std::size_t first) {
+        std::string text;
+        for (auto i = first; i < args.size(); ++i) {
+            if (!text.empty()) text += ' ';
+            text += args[i];
+        }
+        if (text.empty()) {
+            return std::nullopt;
+        }
+        return sdb::condition::compile(text);
+    }
+
+    /* condition and hit count of a breakpoint or watchpoint for the list commands */
+    template <typename Stoppoint>
+    std::string describe_condition(const Stoppoint& point) {
+        auto& cond = point.get_condition();
+        return fmt::format("{}, hits = {}", cond ? ", if " + cond->text() : "", point.hit_count());
+    }
+
     /* gets debug information if process is stopped from SIGTRAP */
     std::string get_sigtrap_info(const sdb::Process& process, sdb::stop_reason reason) {
         if (reason.trap_reason == sdb::trap_type::software_break) {
             auto &site = process.breakpoint_sites().get_by_address(process.get_pc()); 
             return fmt::format(" (breakpoint {})", site.id());
         }
-        if (reason.trap_reason == sdb::trap_type::hardware_break) {
-            auto id = process.get_current_hardware_stoppoint();
+        if (reason.trap_reason == sdb::trap_type::hardware_break or
+            reason.trap_reason == sdb::trap_type::software_watch) {
+            std::variant<sdb::breakpoint_site::id_type, sdb::watchpoint_site::id_type> id;
+            if (reason.software_watchpoint) {
+                id.emplace<1>(*reason.software_watchpoint);
+            } else {
+                id = process.get_current_hardware_stoppoint();
+            }
 
             //returned index is hardware breakpoint
             if (id.index() == 0) {
@@ -92,8 +116,7 @@ namespace
             /* entry event */
             if (info.entry) {
                 message += "(syscall entry)\n";
-                message += fmt::format("syscall: {} ({:#x}) ", sdb::syscall_id_to_name(info.id),
-                                        fmt::join(info.args, ","));
+                message += fmt::format("syscall: {}", sdb::decode_syscall(process, info.id, info.args));
             } else {
                 /* exit event */
                 message += "(syscall exit)\n";
@@ -175,11 +198,19 @@ namespace
     breakpoint  - Commands for operating on breakpoints
     watchpoint  - Commands for operating on watchpoints
     catchpoint  - Commands for operating on catchpoints - triggered on specific event, which are syscalls
-    continue    - Resume the process
+    checkpoint  - Save a frozen copy of the process to restart from
+    continue    - Resume the process and return to the prompt, the stop is shown when it comes and Ctrl-C
+                  interrupts. continue <tid> or continue all in non-stop mode
     memory      - Commands for operating on memory
     disassemble - Disassemble machine code to assembly
+    gcore       - Write a core file of the process, default name core.<pid>
     register    - Commands for operating on registers
-    step        - Step over a single instruction
+    restart     - Continue from a checkpoint, restart <id>
+    snapshot    - Commands for capturing and comparing writable memory
+    step        - Step over a single instruction, step <tid> for another thread
+    tracepoint  - Commands for recording state at addresses without stopping
+    syscall     - Record every syscall with its latency, like strace
+    thread      - List the threads of the process and pick the one commands act on
 )";
         
         } else if (is_prefix(args[1], "memory")) {
@@ -187,6 +218,13 @@ namespace
         read <address> - default is 32 bytes
         read <address> <number of bytes> 
         write <address> <bytes>
+        maps - list mapped regions
+        find <bytes|string|u8|u16|u32|u64> <value> - search all readable memory
+            -r <low> <high>  only search this address range
+            -p <w|x|wx>      only search mappings with these permissions
+            -n <count>       stop after this many matches, default 100
+        cache - page cache hit/miss counters
+        cache reset
     )";
         /* handles registers */
         } else if (is_prefix(args[1], "register")) {
@@ -200,10 +238,15 @@ namespace
             std::cerr << R"(Available commands:
     list
     delete  <id>
-    disable <id>
-    enable  <id>
+    disable <id>... | all
+    enable  <id>... | all
     set <address>
     set <address> -h
+    set --regex <pattern> - every function with a matching mangled or demangled name
+    condition <id> <expression> - only stop when it holds, e.g. rdi > 4096 or hits % 100 == 0
+    condition <id> - stop every time again
+    stats - how breakpoints were stepped over: emulated, displaced or in place
+    stats reset
 )";
         } else if (is_prefix(args[1], "watchpoint")) {
             std::cerr << R"(Available commands:
@@ -213,6 +256,11 @@ namespace
     enable  <id>
     set <address>
     set <address> <write|rw|execute> <size in byte>
+    set <address> <write|rw> <size in byte> -s - any size, by page protection
+    condition <id> <expression> - only stop when it holds, e.g. value == 0 or old != value
+    condition <id> - stop every time again
+    stats - page faults taken by software watchpoints and how many were false positives
+    stats reset
 )";
         } else if (is_prefix(args[1], "step")) {
             std::cerr << R"(Available commands:
@@ -226,12 +274,49 @@ namespace
             std::cerr << R"(Available options:
     -c <number of instructions>
     -a <starting address>
+)";
+        } else if (is_prefix(args[1], "snapshot")) {
+            std::cerr << R"(Available commands:
+    take
+    list
+    diff <id> <id>
 )";
         } else if (is_prefix(args[1], "catchpoint")) {
             std::cerr << R"(Available commands:
     syscall
     syscall none
     syscall <list of syscall IDs or names separated by space>
+)";
+        } else if (is_prefix(args[1], "checkpoint")) {
+            std::cerr << R"(Available commands:
+    checkpoint - save the current state
+    list
+    delete <id>
+)";
+        } else if (is_prefix(args[1], "tracepoint")) {
+            std::cerr << R"(Available commands:
+    list
+    delete  <id>
+    disable <id>
+    enable  <id>
+    set <address> [registers...] [-m <address|register[+-offset]> <size>]...
+    set <address> -f - fast, jumps to a trampoline that records all GPRs without stopping
+    dump <binary|csv> <file> - write out and clear the recorded hits
+)";
+        } else if (is_prefix(args[1], "syscall")) {
+            std::cerr << R"(Available commands:
+    trace - record every syscall from now on, continue only stops where it did before
+    trace off
+    stats - count, errors, total and p50/p99 latency of each syscall recorded
+    dump <file> - write the log out in binary
+    clear
+)";
+        } else if (is_prefix(args[1], "thread")) {
+            std::cerr << R"(Available commands:
+    list - every thread, * marks the one registers, step and the pc refer to
+    select <tid>
+    mode - all-stop or non-stop
+    mode <all-stop|non-stop> - in non-stop only the thread that stops is stopped, continue resumes just the current one
 )";
         }
         
@@ -293,7 +378,12 @@ namespace
                     break;
             }
     
-            fmt::print("Process {} {} \n", target.get_proc().get_pid(), message);
+            auto& proc = target.get_proc();
+            if (proc.threads().size() > 1 and reason.reason == sdb::process_state::stopped) {
+                fmt::print("Process {} thread {} {} \n", proc.get_pid(), reason.tid, message);
+            } else {
+                fmt::print("Process {} {} \n", proc.get_pid(), message);
+            }
         }
 
     void handle_register_read(
@@ -389,8 +479,9 @@ namespace
     }
 
     void handle_breakpoint_command(
-        sdb::Process &process,
+        sdb::target& target,
         const std::vector<std::string>& args) {
+            auto& process = target.get_proc();
             /* list command */
             if (args.size() < 2) {
                 print_help({"help", "breakpoint"});
@@ -412,21 +503,49 @@ namespace
                         if (site.is_internal()) {
                             return;
                         }
-                        fmt::print("{}: address = {:#x}, {}, {}\n",
+                        fmt::print("{}: address = {:#x}, {}, {}{}\n",
                                     site.id(), site.address().addr(),
                                     site.is_enabled() ? "enabled" : "disabled",
-                                    site.is_hardware() ? "hardware" : "software");
+                                    site.is_hardware() ? "hardware" : "software",
+                                    describe_condition(site));
                     });
                 }
                 return;
             }
 
-            /* set breakpoint command */  
-            if (args.size() < 3) {
+            /* set breakpoint command, checked before stats so "s" still means set */
+            if (is_prefix(command, "set") and args.size() < 3) {
                 print_help({"help", "breakpoint"});
                 return;
             }
 
+            /* every function whose name matches, created and enabled as one batch */
+            if (is_prefix(command, "set") and args[2] == "--regex") {
+                if (args.size() < 4) {
+                    print_help({"help", "breakpoint"});
+                    return;
+                }
+
+                //the line was split on spaces, a pattern may hold some
+                std::regex pattern;
+                try {
+                    pattern = std::regex(fmt::format("{}", fmt::join(args.begin() + 3, args.end(), " ")));
+                } catch (const std::regex_error& err) {
+                    sdb::error::send(std::string("Invalid regular expression: ") + err.what());
+                }
+
+                auto& elf = target.get_elf();
+                std::vector<sdb::virt_addr> addresses;
+                for (auto symbol : elf.get_functions_matching(pattern)) {
+                    addresses.push_back(sdb::file_addr{ symbol->st_value, elf }.convert_to_virt_addr());
+                }
+
+                auto sites = process.create_breakpoint_sites(addresses);
+                process.enable_breakpoint_sites(sites);
+                fmt::print("{} functions matched, {} breakpoints created\n", addresses.size(), sites.size());
+                return;
+            }
+
             if (is_prefix(command, "set")) {
                 //converts address to 64-bit. returns std::optional
                 auto address = sdb::to_integral<std::uint64_t>(args[2], 16);
@@ -450,23 +569,63 @@ namespace
                 return;
             }
 
-            auto id = sdb::to_integral<sdb::breakpoint_site::id_type>(args[2]);
-            if (!id) {
-                std::cerr << "Command expects breakpoint id";
+            /* how resume got past breakpoints, "reset" zeroes the counters */
+            if (is_prefix(command, "stats")) {
+                auto& stats = process.get_step_over_stats();
+                fmt::print("Emulated: {}\nDisplaced: {}\nStepped in place: {}\n",
+                            stats.emulated, stats.displaced, stats.stepped);
+
+                if (args.size() == 3 and args[2] == "reset") {
+                    process.reset_step_over_stats();
+                }
                 return;
             }
 
-            if (is_prefix(command, "enable")) {
-                process.breakpoint_sites().get_by_id(*id).enable();
+            if (args.size() < 3) {
+                print_help({"help", "breakpoint"});
+                return;
             }
 
-            else if (is_prefix(command, "disable")) {
-                process.breakpoint_sites().get_by_id(*id).disable();
+            /* enable and disable take several ids or "all", applied as one batch */
+            if (is_prefix(command, "enable") or is_prefix(command, "disable")) {
+                std::vector<sdb::breakpoint_site*> sites;
+                if (args[2] == "all") {
+                    process.breakpoint_sites().for_each([&](auto& site) {
+                        if (!site.is_internal()) {
+                            sites.push_back(&site);
+                        }
+                    });
+                } else {
+                    for (auto arg = args.begin() + 2; arg != args.end(); ++arg) {
+                        auto id = sdb::to_integral<sdb::breakpoint_site::id_type>(*arg);
+                        if (!id) {
+                            std::cerr << "Command expects breakpoint id";
+                            return;
+                        }
+                        sites.push_back(&process.breakpoint_sites().get_by_id(*id));
+                    }
+                }
+
+                if (is_prefix(command, "enable")) {
+                    process.enable_breakpoint_sites(sites);
+                } else {
+                    process.disable_breakpoint_sites(sites);
+                }
+                return;
             }
 
-            else if (is_prefix(command, "delete")) {
+            auto id = sdb::to_integral<sdb::breakpoint_site::id_type>(args[2]);
+            if (!id) {
+                std::cerr << "Command expects breakpoint id";
+                return;
+            }
+
+            if (is_prefix(command, "delete")) {
                 process.breakpoint_sites().remove_by_id(*id);
             }
+            else if (is_prefix(command, "condition")) {
+                process.breakpoint_sites().get_by_id(*id).set_condition(condition_from_args(args, 3));
+            }
     }
 
     void handle_memory_read_command(
@@ -491,7 +650,11 @@ namespace
             n_bytes = *bytes_arg;
         }
 
-        auto data = process.read_memory(sdb::virt_addr{*address}, n_bytes);
+        //clip to mapped memory, print what we can and say where it stops
+        auto data = process.read_memory_partial(sdb::virt_addr{*address}, n_bytes);
+        if (data.empty()) {
+            sdb::error::send("Address is not mapped or not readable");
+        }
         //batches up the memory and use fmt::print to write in desired format
         //loops over the data 16 bytes at a time
         for (std::size_t i = 0; i < data.size(); i += 16) { 
@@ -503,6 +666,93 @@ namespace
             fmt::print("{:#016x}: {:02x}\n",
                         *address + i, fmt::join(start, end, " "));
         }
+
+        if (data.size() < static_cast<std::size_t>(n_bytes)) {
+            fmt::print("Memory is unmapped from {:#x}\n", *address + data.size());
+        }
+    }
+
+    /* turns the <type> <value> arguments of memory find into the bytes to search for */
+    std::vector<std::byte> parse_search_pattern(std::string_view type, std::string_view value) {
+        //integers are searched for in the tracee's little-endian layout
+        auto integer = [&](auto t) {
+            auto parsed = sdb::to_integral<decltype(t)>(value, 16);
+            if (!parsed) {
+                sdb::error::send("Invalid integer, expected hexadecimal prefixed with '0x'");
+            }
+            auto bytes = sdb::as_bytes(*parsed);
+            return std::vector<std::byte>(bytes, bytes + sizeof(t));
+        };
+
+        if (type == "bytes") return sdb::parse_vector(value);
+        if (type == "string") {
+            auto bytes = reinterpret_cast<const std::byte*>(value.data());
+            return std::vector<std::byte>(bytes, bytes + value.size());
+        }
+        if (type == "u8") return integer(std::uint8_t{});
+        if (type == "u16") return integer(std::uint16_t{});
+        if (type == "u32") return integer(std::uint32_t{});
+        if (type == "u64") return integer(std::uint64_t{});
+        sdb::error::send("Unknown pattern type");
+    }
+
+    void handle_memory_find_command(
+        sdb::Process& process,
+        const std::vector<std::string>& args) {
+            if (args.size() < 4) {
+                print_help({"help", "memory"});
+                return;
+            }
+
+            auto pattern = parse_search_pattern(args[2], args[3]);
+            sdb::memory_search_options options;
+            options.max_matches = 100;
+
+            //optional flags after the pattern
+            for (auto it = args.begin() + 4; it != args.end(); ++it) {
+                if (*it == "-r" and args.end() - it > 2) {
+                    auto low = sdb::to_integral<std::uint64_t>(*++it, 16);
+                    auto high = sdb::to_integral<std::uint64_t>(*++it, 16);
+                    if (!low or !high) {
+                        sdb::error::send("Invalid address format");
+                    }
+                    options.low = sdb::virt_addr{*low};
+                    options.high = sdb::virt_addr{*high};
+                } else if (*it == "-p" and it + 1 != args.end()) {
+                    auto perms = *++it;
+                    options.writable = perms.find('w') != std::string::npos;
+                    options.executable = perms.find('x') != std::string::npos;
+                } else if (*it == "-n" and it + 1 != args.end()) {
+                    auto max = sdb::to_integral<std::size_t>(*++it);
+                    if (!max) {
+                        sdb::error::send("Invalid match limit");
+                    }
+                    options.max_matches = *max;
+                } else {
+                    print_help({"help", "memory"});
+                    return;
+                }
+            }
+
+            auto result = process.search_memory({pattern.data(), pattern.size()}, options);
+            for (auto address : result.matches) {
+                fmt::print("{:#016x}\n", address.addr());
+            }
+
+            fmt::print("{} matches, scanned {:.1f} MB in {} regions in {:.3f} s ({:.1f} MB/s, {})\n",
+                        result.matches.size(), result.bytes_scanned / double(1 << 20),
+                        result.regions_scanned, result.seconds, result.throughput(), result.kernel);
+        }
+
+    /* lists the tracee's mappings like /proc/<pid>/maps */
+    void handle_memory_maps_command(sdb::Process& process) {
+        for (auto& region : process.get_memory_map()) {
+            fmt::print("{:#016x}-{:#016x} {}{}{}{} {:08x} {} {}\n",
+                        region.low.addr(), region.high.addr(),
+                        region.readable ? 'r' : '-', region.writable ? 'w' : '-',
+                        region.executable ? 'x' : '-', region.shared ? 's' : 'p',
+                        region.offset, region.inode, region.path);
+        }
     }
 
     void handle_memory_write_command
@@ -524,10 +774,38 @@ namespace
         process.write_memory(sdb::virt_addr{ *address}, {data.data(), data.size()});
     }   
 
+    /* prints page cache statistics, "reset" zeroes the counters */
+    void handle_memory_cache_command(
+        sdb::Process& process,
+        const std::vector<std::string>& args) {
+            auto& cache = process.memory_cache();
+            fmt::print("Pages cached: {}\nHits: {}\nMisses: {}\n",
+                        cache.size(), cache.hits(), cache.misses());
+
+            if (args.size() == 3 and args[2] == "reset") {
+                process.reset_memory_cache_stats();
+            }
+        }
+
     /* for handling memory commands and calls */
     void handle_memory_command(
         sdb::Process& process,
         const std::vector<std::string>& args) {
+            if (args.size() >= 2 and is_prefix(args[1], "cache")) {
+                handle_memory_cache_command(process, args);
+                return;
+            }
+
+            if (args.size() == 2 and is_prefix(args[1], "maps")) {
+                handle_memory_maps_command(process);
+                return;
+            }
+
+            if (args.size() >= 2 and is_prefix(args[1], "find")) {
+                handle_memory_find_command(process, args);
+                return;
+            }
+
             if (args.size() < 3) {
                 print_help({"help", "memory"});
                 return;
@@ -627,10 +905,12 @@ namespace
                 /* each stoppoint from stoppoints_ go into auto& site */
                 /* execute the lambda function for each instance */
                 process.watchpoint_sites().for_each([&](auto& point) {
-                    fmt::print("{}: address = {:#x}, mode = {}, size = {}, {}\n",
+                    fmt::print("{}: address = {:#x}, mode = {}, size = {}, {}{}{}\n",
                                 point.id(), point.address().addr(),
                                 mode_to_string(point.mode()), point.size(),
-                                point.is_enabled() ? "enabled" : "disabled");
+                                point.is_enabled() ? "enabled" : "disabled",
+                                point.is_software() ? ", software" : "",
+                                describe_condition(point));
                 });
             }
             return;
@@ -639,7 +919,7 @@ namespace
     void handle_watchpoint_set(sdb::Process & process, 
         const std::vector<std::string>& args) {
 
-            if (args.size() != 5) {
+            if (args.size() != 5 and !(args.size() == 6 and args[5] == "-s")) {
                 print_help({ "help", "watchpoint" });
                 return;
             }
@@ -661,8 +941,13 @@ namespace
             else if (mode_text == "rw") mode = sdb::stoppoint_mode::read_write;
             else if (mode_text == "execute") mode = sdb::stoppoint_mode::execution;
 
+            //debug registers only take aligned 1, 2, 4 and 8 byte locations
+            bool fits_hardware = (*size == 1 or *size == 2 or *size == 4 or *size == 8) and
+                                 (*address & (*size - 1)) == 0;
+            bool software = args.size() == 6 or (!fits_hardware and mode != sdb::stoppoint_mode::execution);
+
             process.create_watchpoint(
-                sdb::virt_addr{*address}, mode, *size).enable();
+                sdb::virt_addr{*address}, mode, *size, software).enable();
     }
 
     void handle_watchpoint_command(sdb::Process & process, 
@@ -685,6 +970,18 @@ namespace
                 return;
             }
 
+            /* faults on pages protected for software watchpoints, "reset" zeroes the counters */
+            if (is_prefix(command, "stats")) {
+                auto& stats = process.get_software_watch_stats();
+                fmt::print("Faults: {}\nHits: {}\nFalse positives: {}\n",
+                            stats.faults, stats.hits, stats.false_positives);
+
+                if (args.size() == 3 and args[2] == "reset") {
+                    process.reset_software_watch_stats();
+                }
+                return;
+            }
+
             //expects watchpoint id
             if (args.size() < 3) {
                 print_help({ "help", "watchpoint" });
@@ -705,6 +1002,9 @@ namespace
             else if (is_prefix(command, "delete")) {
                 process.watchpoint_sites().remove_by_id(*id);
             }
+            else if (is_prefix(command, "condition")) {
+                process.watchpoint_sites().get_by_id(*id).set_condition(condition_from_args(args, 3));
+            }
 
         }
     
@@ -750,6 +1050,413 @@ namespace
 
 
 
+    /*** HANDLING CHECKPOINTS ***/
+    void handle_checkpoint_command(sdb::Process& process, const std::vector<std::string>& args) {
+        if (args.size() == 1) {
+            auto id = process.create_checkpoint();
+            fmt::print("Checkpoint {} at {:#x}\n", id, process.get_pc().addr());
+            return;
+        }
+
+        if (is_prefix(args[1], "list")) {
+            for (auto& cp : process.checkpoints()) {
+                fmt::print("{}: process {} at {:#x}\n", cp.id, cp.pid, cp.pc.addr());
+            }
+            return;
+        }
+
+        auto id = args.size() == 3 ? sdb::to_integral<sdb::checkpoint::id_type>(args[2]) : std::nullopt;
+        if (is_prefix(args[1], "delete") and id) {
+            process.delete_checkpoint(*id);
+        } else {
+            print_help({"help", "checkpoint"});
+        }
+    }
+
+    void handle_restart_command(sdb::Process& process, const std::vector<std::string>& args) {
+        auto id = args.size() == 2 ? sdb::to_integral<sdb::checkpoint::id_type>(args[1]) : std::nullopt;
+        if (!id) {
+            std::cerr << "Command expects a checkpoint id\n";
+            return;
+        }
+
+        process.restart_checkpoint(*id);
+        fmt::print("Restarted from checkpoint {} as process {}\n", *id, process.get_pid());
+        print_disassembly(process, process.get_pc(), 8);
+    }
+
+    /*** HANDLING THREADS ***/
+    void handle_thread_command(sdb::Process& process, const std::vector<std::string>& args) {
+        if (args.size() == 1 or is_prefix(args[1], "list")) {
+            for (auto& [tid, thread] : process.threads()) {
+                auto marker = tid == process.current_thread() ? '*' : ' ';
+                if (thread.state == sdb::process_state::stopped) {
+                    fmt::print("{} {} at {:#x}\n", marker, tid, process.get_pc(tid).addr());
+                } else {
+                    fmt::print("{} {} running\n", marker, tid);
+                }
+            }
+            return;
+        }
+
+        if (is_prefix(args[1], "mode")) {
+            if (args.size() == 3 and args[2] == "non-stop") {
+                process.set_non_stop(true);
+            } else if (args.size() == 3 and args[2] == "all-stop") {
+                process.set_non_stop(false);
+            } else if (args.size() != 2) {
+                print_help({"help", "thread"});
+                return;
+            }
+            fmt::print("{}\n", process.is_non_stop() ? "non-stop" : "all-stop");
+            return;
+        }
+
+        auto tid = args.size() == 3 ? sdb::to_integral<pid_t>(args[2]) : std::nullopt;
+        if (is_prefix(args[1], "select") and tid) {
+            process.set_current_thread(*tid);
+            fmt::print("Thread {} at {:#x}\n", *tid, process.get_pc().addr());
+        } else {
+            print_help({"help", "thread"});
+        }
+    }
+
+    /*** HANDLING SNAPSHOTS ***/
+    void print_snapshot(const sdb::snapshot& snap) {
+        fmt::print("{}: {} regions, {:.1f} MB, {} pages read", snap.id(), snap.regions().size(),
+                    snap.size() / double(1 << 20), snap.pages_fetched());
+        if (snap.base_id() != 0) {
+            fmt::print(", rest copied from {}", snap.base_id());
+        }
+        fmt::print("\n");
+    }
+
+    void handle_snapshot_diff(sdb::Process& process, const std::vector<std::string>& args) {
+        auto before_id = sdb::to_integral<sdb::snapshot::id_type>(args[2]);
+        auto after_id = sdb::to_integral<sdb::snapshot::id_type>(args[3]);
+        if (!before_id or !after_id) {
+            std::cerr << "Command expects snapshot ids\n";
+            return;
+        }
+
+        auto diff = sdb::diff_snapshots(process.get_snapshot(*before_id), process.get_snapshot(*after_id));
+        for (auto& range : diff.ranges) {
+            fmt::print("{:#018x} {} bytes\n", range.address.addr(), range.size);
+        }
+        fmt::print("{} of {} compared pages changed\n", diff.pages_changed, diff.pages_compared);
+    }
+
+    void handle_snapshot_command(sdb::Process& process, const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            print_help({"help", "snapshot"});
+            return;
+        }
+
+        if (is_prefix(args[1], "take")) {
+            print_snapshot(process.take_snapshot());
+        }
+        else if (is_prefix(args[1], "list")) {
+            for (auto& snap : process.snapshots()) {
+                print_snapshot(*snap);
+            }
+        }
+        else if (is_prefix(args[1], "diff") and args.size() == 4) {
+            handle_snapshot_diff(process, args);
+        }
+        else {
+            print_help({"help", "snapshot"});
+        }
+    }
+
+    /* writes a core file, gcore <path> */
+    void handle_gcore_command(sdb::Process& process, const std::vector<std::string>& args) {
+        auto path = args.size() >= 2 ? args[1] : "core." + std::to_string(process.get_pid());
+        auto stats = process.write_core(path);
+        fmt::print("Saved {} ({} segments, {:.1f} MB written of {:.1f} MB) in {:.3f} s\n",
+                    path, stats.segments, stats.bytes_written / double(1 << 20),
+                    stats.file_size / double(1 << 20), stats.seconds);
+    }
+
+    /* memory to capture, either a hex address or register[+-offset] */
+    std::optional<sdb::tracepoint::memory_range> parse_trace_memory(std::string_view location, std::string_view size_text) {
+        auto size = sdb::to_integral<std::size_t>(size_text);
+        if (!size or *size == 0) {
+            return std::nullopt;
+        }
+
+        if (location.substr(0, 2) == "0x") {
+            auto address = sdb::to_integral<std::uint64_t>(location, 16);
+            if (!address) {
+                return std::nullopt;
+            }
+            return sdb::tracepoint::memory_range{ std::nullopt, static_cast<std::int64_t>(*address), *size };
+        }
+
+        auto split_at = location.find_first_of("+-");
+        std::int64_t offset = 0;
+        if (split_at != std::string_view::npos) {
+            auto value = sdb::to_integral<std::int64_t>(location.substr(split_at + 1));
+            if (!value) {
+                return std::nullopt;
+            }
+            offset = location[split_at] == '-' ? -*value : *value;
+        }
+        auto& info = sdb::get_register_info_by_name(location.substr(0, split_at));
+        return sdb::tracepoint::memory_range{ info.id, offset, *size };
+    }
+
+    void handle_tracepoint_set(sdb::Process& process, const std::vector<std::string>& args) {
+        auto address = sdb::to_integral<std::uint64_t>(args[2], 16);
+        if (!address) {
+            fmt::print(stderr, "Tracepoint command expects address in hexadecimal, prefixed with '0x'\n");
+            return;
+        }
+
+        if (args.size() == 4 and args[3] == "-f") {
+            auto& tp = process.create_fast_tracepoint(sdb::virt_addr{ *address });
+            fmt::print("Fast tracepoint {} set at {:#x}, patched {} bytes\n", tp.id(), tp.address().addr(), tp.patch_size());
+            return;
+        }
+
+        std::vector<sdb::register_id> registers;
+        std::vector<sdb::tracepoint::memory_range> memory;
+        for (auto it = args.begin() + 3; it != args.end(); ++it) {
+            if (*it == "-m") {
+                if (args.end() - it < 3) {
+                    print_help({ "help", "tracepoint" });
+                    return;
+                }
+                auto range = parse_trace_memory(*(it + 1), *(it + 2));
+                if (!range) {
+                    print_help({ "help", "tracepoint" });
+                    return;
+                }
+                memory.push_back(*range);
+                it += 2;
+            } else {
+                registers.push_back(sdb::get_register_info_by_name(*it).id);
+            }
+        }
+
+        auto& tp = process.create_tracepoint(sdb::virt_addr{ *address }, std::move(registers), std::move(memory));
+        fmt::print("Tracepoint {} set at {:#x}, {} bytes per hit\n", tp.id(), tp.address().addr(), tp.record_size());
+    }
+
+    void handle_tracepoint_dump(sdb::Process& process, const std::vector<std::string>& args) {
+        if (args.size() != 4 or !(args[2] == "binary" or args[2] == "csv")) {
+            print_help({ "help", "tracepoint" });
+            return;
+        }
+
+        auto format = args[2] == "binary" ? sdb::trace_format::binary : sdb::trace_format::csv;
+        std::ofstream out(args[3], format == sdb::trace_format::binary ? std::ios::binary : std::ios::out);
+        if (!out) {
+            sdb::error::send("Could not open " + args[3]);
+        }
+        auto count = process.dump_trace(out, format);
+        fmt::print("Wrote {} records to {}", count, args[3]);
+        auto dropped = process.fast_trace_dropped();
+        if (auto buffer = process.get_trace_buffer()) {
+            dropped += buffer->dropped();
+        }
+        if (dropped > 0) {
+            fmt::print(", {} dropped because the buffer was full", dropped);
+        }
+        fmt::print("\n");
+    }
+
+    void print_syscall_stats(const sdb::syscall_log& log) {
+        fmt::print("{:<20} {:>10} {:>8} {:>14} {:>10} {:>10}\n", "syscall", "calls", "errors", "total (us)", "p50 (us)", "p99 (us)");
+        for (auto& summary : log.summarize()) {
+            fmt::print("{:<20} {:>10} {:>8} {:>14.1f} {:>10.1f} {:>10.1f}\n",
+                        sdb::syscall_display_name(summary.id), summary.count, summary.errors,
+                        summary.total_ns / 1e3, summary.p50_ns / 1e3, summary.p99_ns / 1e3);
+        }
+    }
+
+    /* syscalls logged since the last call as decoded at their exit stops, a cleared log starts over */
+    template <typename Print>
+    void stream_syscalls(const sdb::Process& process, std::size_t& printed, Print print) {
+        auto& log = process.get_syscall_log();
+        if (log.size() < printed) {
+            printed = 0;
+        }
+        for (; printed < log.size(); ++printed) {
+            print(log.text(printed));
+        }
+    }
+
+    /* a line for each tracepoint hit since the last call, fast tracepoint hits are collected first */
+    template <typename Print>
+    void stream_tracepoint_hits(sdb::Process& process, std::map<sdb::tracepoint::id_type, std::uint64_t>& seen,
+                                Print print) {
+        process.collect_fast_trace();
+        process.tracepoints().for_each([&](auto& tp) {
+            auto& last = seen[tp.id()];
+            if (tp.hit_count() > last) {
+                print(fmt::format("Tracepoint {}: {} hits (+{})", tp.id(), tp.hit_count(), tp.hit_count() - last));
+            }
+            last = tp.hit_count();
+        });
+    }
+
+    void write_syscall_log(const sdb::syscall_log& log, const std::string& path) {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            sdb::error::send("Could not open " + path);
+        }
+        log.dump(out);
+        fmt::print("Wrote {} syscalls to {}\n", log.size(), path);
+    }
+
+    void handle_syscall_command(sdb::Process& process, const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            print_help({ "help", "syscall" });
+            return;
+        }
+
+        if (is_prefix(args[1], "trace")) {
+            process.set_syscall_tracing(args.size() < 3 or args[2] != "off");
+        } else if (is_prefix(args[1], "stats")) {
+            print_syscall_stats(process.get_syscall_log());
+        } else if (is_prefix(args[1], "dump") and args.size() == 3) {
+            write_syscall_log(process.get_syscall_log(), args[2]);
+        } else if (is_prefix(args[1], "clear")) {
+            process.clear_syscall_log();
+        } else {
+            print_help({ "help", "syscall" });
+        }
+    }
+
+    /*
+    * sdb trace-syscalls <-p pid | program> [-o file]
+    * Record every syscall until the process ends or Ctrl-C, then print the stats
+    */
+    int trace_syscalls(int argc, const char** argv) {
+        std::optional<std::string> output;
+        if (argc >= 2 and argv[argc - 2] == std::string_view("-o")) {
+            output = argv[argc - 1];
+            argc -= 2;
+        }
+        if (argc < 2) {
+            std::cerr << "Usage: sdb trace-syscalls <-p pid | program> [-o file]\n";
+            return EXIT_FAILURE;
+        }
+
+        auto target = attach(argc, argv);
+        auto& process = target->get_proc();
+
+        //runs without a prompt until the process ends or Ctrl-C stops it, syscalls are printed as they are logged.
+        //Any other signal it stops with is handed on to it as it is resumed
+        sdb::event_loop loop;
+        bool done = false;
+        loop.watch(process, [&](sdb::Process&, const sdb::stop_reason& reason) {
+            if (reason.reason != sdb::process_state::stopped or reason.interrupted) {
+                done = true;
+            } else {
+                process.resume();
+            }
+        });
+        loop.on_interrupt([&] { loop.interrupt(process); });
+
+        process.set_syscall_tracing(true);
+        process.resume();
+        loop.poll(process);
+
+        std::size_t printed = 0;
+        for (;;) {
+            stream_syscalls(process, printed, [&](const std::string& line) { std::cerr << line << '\n'; });
+            if (done) {
+                break;
+            }
+            loop.run_once();
+        }
+
+        print_syscall_stats(process.get_syscall_log());
+        if (output) {
+            write_syscall_log(process.get_syscall_log(), *output);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    void handle_tracepoint_command(sdb::Process& process, const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            print_help({ "help", "tracepoint" });
+            return;
+        }
+
+        auto command = args[1];
+        if (is_prefix(command, "list")) {
+            //hit counts of fast tracepoints only move as records are collected
+            process.collect_fast_trace();
+            if (process.tracepoints().empty()) {
+                fmt::print("No tracepoints set\n");
+                return;
+            }
+            fmt::print("Current tracepoints:\n");
+            process.tracepoints().for_each([](auto& tp) {
+                std::vector<std::string_view> names;
+                for (auto reg : tp.registers()) {
+                    names.push_back(sdb::get_register_info_by_id(reg).name);
+                }
+                fmt::print("{}: address = {:#x}, {}, {}, hits = {}, registers = [{}], memory ranges = {}\n",
+                           tp.id(), tp.address().addr(), tp.is_enabled() ? "enabled" : "disabled",
+                           tp.is_fast() ? "fast" : "trap", tp.hit_count(), fmt::join(names, ", "), tp.memory().size());
+            });
+            return;
+        }
+
+        if (args.size() < 3) {
+            print_help({ "help", "tracepoint" });
+            return;
+        }
+
+        if (is_prefix(command, "set")) {
+            handle_tracepoint_set(process, args);
+            return;
+        }
+        if (is_prefix(command, "dump")) {
+            handle_tracepoint_dump(process, args);
+            return;
+        }
+
+        auto id = sdb::to_integral<sdb::tracepoint::id_type>(args[2]);
+        if (!id) {
+            std::cerr << "Command expects tracepoint id\n";
+            return;
+        }
+
+        if (is_prefix(command, "enable")) {
+            process.tracepoints().get_by_id(*id).enable();
+        } else if (is_prefix(command, "disable")) {
+            process.tracepoints().get_by_id(*id).disable();
+        } else if (is_prefix(command, "delete")) {
+            process.delete_tracepoint(*id);
+        } else {
+            print_help({ "help", "tracepoint" });
+        }
+    }
+
+    /*
+    * Threads continue and step act on: the one named by a tid argument, every thread for continue all,
+    * else every thread in all-stop mode and the current one in non-stop mode
+    */
+    std::optional<std::optional<pid_t>> parse_thread_selector(sdb::Process& process,
+                                                              const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            return process.is_non_stop() ? std::optional<pid_t>(process.current_thread()) : std::nullopt;
+        }
+        if (args[1] == "all") {
+            return std::optional<pid_t>();
+        }
+        auto tid = sdb::to_integral<pid_t>(args[1]);
+        if (!tid) {
+            std::cerr << "Expected a thread id or all\n";
+            return std::nullopt;
+        }
+        return tid;
+    }
+
     void handle_stop(sdb::target& target, sdb::stop_reason& reason) {
         print_stop_reason(target, reason);
 
@@ -760,14 +1467,27 @@ namespace
     }
     
 
-    /* execute command based on input */
-    void handle_command(std::unique_ptr<sdb::target>& target, std::string_view line)
+    /* what can be done while the process runs, anything else needs it stopped */
+    bool runs_alongside_process(const std::vector<std::string>& args) {
+        auto& command = args[0];
+        return is_prefix(command, "help") or is_prefix(command, "quit") or is_prefix(command, "syscall") or
+               is_prefix(command, "thread") or
+               (is_prefix(command, "tracepoint") and args.size() > 1 and is_prefix(args[1], "list"));
+    }
+
+    /* execute command based on input, continue returns at once and the stop comes in through the loop */
+    void handle_command(std::unique_ptr<sdb::target>& target, sdb::event_loop& loop, std::string_view line)
     {
         /* explicit cast to std::string to prevent std::string::reference object */
         auto args = split(line, ' ');
         auto command = args[0];
         sdb::Process * process = &target->get_proc();
 
+        if (process->get_state() == sdb::process_state::running and !runs_alongside_process(args)) {
+            std::cerr << "Process is running, Ctrl-C interrupts it\n";
+            return;
+        }
+
         // std::uint64_t data_64 {0};
         // std::uint32_t data_32 {0};
         // std::uint16_t data_16 {0};
@@ -780,10 +1500,12 @@ namespace
             /* raw bytes we are reading from so need to convert it to 64 bytes */
             // data = process->get_registers().read_by_id_as<std::uint64_t>(sdb::register_id::rax);
             // process->get_registers().write_by_id(sdb::register_id::rax, data_8);
-            process->resume();
-            auto reason = process->wait_on_signal();
-
-            handle_stop(*target, reason);
+            auto selector = parse_thread_selector(*process, args);
+            if (!selector) {
+                return;
+            }
+            process->resume(*selector);
+            loop.poll(*process);
         } 
         else if (is_prefix(command, "help")) {
             print_help(args);
@@ -792,9 +1514,16 @@ namespace
             handle_register_command(*process, args);
         } 
         else if (is_prefix(command, "breakpoint")) {
-            handle_breakpoint_command(*process, args);
+            handle_breakpoint_command(*target, args);
         }
         else if (is_prefix(command, "step")) {
+            auto selector = parse_thread_selector(*process, args);
+            if (!selector) {
+                return;
+            }
+            if (*selector) {
+                process->set_current_thread(**selector);
+            }
             auto reason = process->step_instruction();
             handle_stop(*target, reason);
         }
@@ -809,6 +1538,27 @@ namespace
         } else if (is_prefix(command, "catchpoint")) {
             handle_catchpoint_command(*process, args);
         }
+        else if (is_prefix(command, "checkpoint")) {
+            handle_checkpoint_command(*process, args);
+        }
+        else if (is_prefix(command, "restart")) {
+            handle_restart_command(*process, args);
+        }
+        else if (is_prefix(command, "gcore")) {
+            handle_gcore_command(*process, args);
+        }
+        else if (is_prefix(command, "snapshot")) {
+            handle_snapshot_command(*process, args);
+        }
+        else if (is_prefix(command, "tracepoint")) {
+            handle_tracepoint_command(*process, args);
+        }
+        else if (is_prefix(command, "syscall")) {
+            handle_syscall_command(*process, args);
+        }
+        else if (is_prefix(command, "thread")) {
+            handle_thread_command(*process, args);
+        }
         else if (is_prefix(command, "quit")) {
             return;
         }
@@ -818,14 +1568,65 @@ namespace
     }
 
 
+    /* print something while readline has the prompt and a half typed line up, both are drawn again below it */
+    template <typename F>
+    void print_above_prompt(F&& print) {
+        auto point = rl_point;
+        char* line = rl_copy_text(0, rl_end);
+        rl_save_prompt();
+        rl_replace_line("", 0);
+        rl_redisplay();
+
+        print();
+        std::cout.flush();
+        std::cerr.flush();
+
+        rl_restore_prompt();
+        rl_replace_line(line, 0);
+        rl_point = point;
+        rl_redisplay();
+        free(line);
+    }
+
+    /*
+    * The prompt is read through readline's callback interface from an event loop that also waits on the
+    * process, so the prompt stays usable while it runs and stops, tracepoint hits and syscalls show up
+    * as they happen
+    */
     void main_loop(std::unique_ptr<sdb::target> & target) 
     {
-        /* reading user input using readline */
-        char * line = nullptr;
+        sdb::event_loop loop;
+        auto& process = target->get_proc();
+        bool done = false;
+
+        loop.watch(process, [&](sdb::Process&, const sdb::stop_reason& reason) {
+            auto stop = reason;
+            print_above_prompt([&] { handle_stop(*target, stop); });
+        });
+
+        //Ctrl-C stops a running process, at the prompt it only drops the line being typed
+        loop.on_interrupt([&] {
+            if (process.get_state() == sdb::process_state::running) {
+                loop.interrupt(process);
+                return;
+            }
+            rl_replace_line("", 0);
+            std::cout << '\n';
+            rl_on_new_line();
+            rl_redisplay();
+        });
+
+        /* readline hands lines to a plain function, it can't capture */
+        static std::function<void(char*)> on_line;
+        on_line = [&](char* line) {
+            /* EOF */
+            if (line == nullptr) {
+                std::cout << '\n';
+                done = true;
+                rl_callback_handler_remove();
+                return;
+            }
 
-        /* from readline, if readline reads an EOF market, it returns nullptr */
-        while ((line = readline("sdb> ")) != nullptr) 
-        {
             std::string line_str;
 
             /* if the line is empty, we retrieve from history the line */
@@ -846,15 +1647,38 @@ namespace
 
             /* handle the command if we receive one */
             if (!line_str.empty()) {
+                done = is_prefix(split(line_str, ' ')[0], "quit");
                 try {
-                    handle_command(target, line_str);
+                    handle_command(target, loop, line_str);
                 } catch (const sdb::error & err) {
                     std::cout << err.what() << '\n';
                 }
             }
-
+            //readline would put the prompt up again
+            if (done) {
+                rl_callback_handler_remove();
+            }
+        };
+
+        //SIGINT comes through the event loop
+        rl_catch_signals = 0;
+        rl_callback_handler_install("sdb> ", [](char* line) { on_line(line); });
+        loop.add_fd(STDIN_FILENO, [] { rl_callback_read_char(); });
+
+        std::size_t syscalls_printed = 0;
+        std::map<sdb::tracepoint::id_type, std::uint64_t> tracepoint_hits;
+        auto print_line = [](const std::string& line) { print_above_prompt([&] { std::cout << line << '\n'; }); };
+        while (!done) {
+            //a failure while handling a stop costs that stop, not the session
+            try {
+                //fast tracepoint hits never wake us, they are collected on a timer while the process runs
+                loop.run_once(process.get_state() == sdb::process_state::running ? 100 : -1);
+                stream_syscalls(process, syscalls_printed, print_line);
+                stream_tracepoint_hits(process, tracepoint_hits, print_line);
+            } catch (const sdb::error& err) {
+                print_line(err.what());
+            }
         }
-        
     }
 
 }
@@ -871,15 +1695,12 @@ int main(int argc, const char ** argv)
     int value = 42;
 
     try {
-        auto target = attach(argc, argv);
-        g_sdb_process = &target->get_proc();
-
-        if (signal(SIGINT, handle_sigint) ==  SIG_ERR) {
-            std::cerr << "Error occurred while setting the signal handler\n";
-            return EXIT_FAILURE;
+        /* argv[1] takes the place of the program name */
+        if (argv[1] == std::string_view("trace-syscalls")) {
+            return trace_syscalls(argc - 1, argv + 1);
         }
 
-        /* install handle_sigint */
+        auto target = attach(argc, argv);
         main_loop(target);
     }
     catch (const sdb::error& err) {